@@ -0,0 +1,202 @@
+#ifndef NN_ACTIVATION_HPP
+#define NN_ACTIVATION_HPP
+
+#include <type_traits>
+#include <cstddef>
+
+#include <cmath> // ::exp(...), ::tanh(...)
+
+
+
+inline namespace nn {
+
+	/* Activation policies: passing one of these to Neurode or Stripe
+	 * (instead of a function pointer) lets the compiler inline the
+	 * activation, and its derivative, into the layers' loops.
+	 * A policy provides
+	 *     double operator () (double x) const;  // the activation
+	 *     double derive(double y) const;        // its derivative
+	 * where (y) is the activation's output, as cached by Stripe::train.
+	 * nncli's original tanh derivative took the output too, but applied
+	 * tanh to it again (1 - tanh(y)^2): the policies compute the actual
+	 * derivative (1 - y^2), the function-pointer API keeps the caller's.
+	 * The templated members of Neurode and Stripe are instantiated
+	 * for every policy listed in NN_ACTIVATION_POLICIES. */
+	namespace activation {
+
+		/* Vectorized approximations: the error is below 1e-15 for
+		 * PRECISE, 1e-8 for FAST and 1e-4 for FASTEST (absolute for tanh
+		 * and logistic, relative for exp). The inputs and outputs may be
+		 * the same array; the fused overloads also write the derivatives,
+		 * computed from the outputs at no extra cost. */
+		enum class Accuracy {
+			PRECISE, FAST, FASTEST
+		};
+
+		void exp(const double* x, double* y, size_t n, Accuracy = Accuracy::FAST);
+
+		void tanh(const double* x, double* y, size_t n, Accuracy = Accuracy::FAST);
+		void tanh(const double* x, double* y, double* dy, size_t n, Accuracy = Accuracy::FAST);
+
+		// 1 / (1 + exp(-x))
+		void logistic(const double* x, double* y, size_t n, Accuracy = Accuracy::FAST);
+		void logistic(const double* x, double* y, double* dy, size_t n, Accuracy = Accuracy::FAST);
+
+		/* Single-precision arrays, for TypedStripe: the error is
+		 * about 1e-6 for PRECISE and FAST, and 1e-4 for FASTEST */
+		void exp(const float* x, float* y, size_t n, Accuracy = Accuracy::FAST);
+		void tanh(const float* x, float* y, size_t n, Accuracy = Accuracy::FAST);
+		void logistic(const float* x, float* y, size_t n, Accuracy = Accuracy::FAST);
+
+
+		struct Policy { };
+
+		template<typename T>
+		using if_policy = std::enable_if_t<std::is_base_of<Policy, T>::value>;
+
+
+		struct Tanh : Policy {
+			inline double operator () (double x) const { return ::tanh(x); }
+			inline double derive(double y) const { return 1.0 - (y*y); }
+		};
+
+		/* Shifted by -1, as the original nncli activation;
+		 * its derivative is s * (1 - s), where s = y + 1 */
+		struct Logistic : Policy {
+			inline double operator () (double x) const { return (1.0 / (1.0 + ::exp(-x))) - 1.0; }
+			inline double derive(double y) const { return (y + 1.0) * -y; }
+		};
+
+		struct Relu : Policy {
+			inline double operator () (double x) const { return (x > 0.0)? x : 0.0; }
+			inline double derive(double x) const { return (x > 0.0)? 1.0 : 0.0; }
+		};
+
+		struct Sign : Policy {
+			inline double operator () (double x) const { return (x > 0.0)? 1.0 : -1.0; }
+			inline double derive(double) const { return 0.0; }
+		};
+
+		/* Wraps the function pointers of the original API:
+		 * every activation is an indirect call */
+		struct Function : Policy {
+			double (*act)(double);
+			double (*deriv)(double);
+
+			constexpr Function(double (*a)(double), double (*d)(double) = nullptr):
+					act (a), deriv (d)
+			{ }
+
+			inline double operator () (double x) const { return act(x); }
+			inline double derive(double x) const { return deriv(x); }
+		};
+
+		/* Approximations of Tanh and Logistic, applied to whole layers
+		 * at once; when training, the fused overloads compute the
+		 * derivatives along with the outputs */
+		struct FastTanh : Policy {
+			Accuracy accuracy;
+
+			constexpr FastTanh(Accuracy a = Accuracy::FAST): accuracy (a) { }
+
+			inline double operator () (double x) const {
+				tanh(&x, &x, 1, accuracy);
+				return x;
+			}
+			inline double derive(double y) const { return 1.0 - (y*y); }
+		};
+
+		struct FastLogistic : Policy {
+			Accuracy accuracy;
+
+			constexpr FastLogistic(Accuracy a = Accuracy::FAST): accuracy (a) { }
+
+			inline double operator () (double x) const {
+				logistic(&x, &x, 1, accuracy);
+				return x - 1.0;
+			}
+			inline double derive(double y) const { return (y + 1.0) * -y; }
+		};
+
+
+		/* Applies the activation to every value; the layers
+		 * of Neurode and Stripe go through here */
+		template<typename Activation, typename Scalar>
+		inline void apply(const Activation& act, Scalar* values, size_t n) {
+			for(size_t i=0; i < n; ++i)
+				values[i] = act(values[i]);
+		}
+
+		/* In double, Tanh and Logistic go through the PRECISE
+		 * approximations, within 1e-15 of libm, rather than a call
+		 * per value; float layers keep libm, whose results do not
+		 * depend on the instruction set (as QuantizedStripe's must not) */
+		inline void apply(const Tanh&, double* values, size_t n) {
+			tanh(values, values, n, Accuracy::PRECISE);
+		}
+
+		inline void apply(const Logistic&, double* values, size_t n) {
+			logistic(values, values, n, Accuracy::PRECISE);
+			for(size_t i=0; i < n; ++i)
+				values[i] -= 1.0;
+		}
+
+		template<typename Scalar>
+		inline void apply(const FastTanh& act, Scalar* values, size_t n) {
+			tanh(values, values, n, act.accuracy);
+		}
+
+		template<typename Scalar>
+		inline void apply(const FastLogistic& act, Scalar* values, size_t n) {
+			logistic(values, values, n, act.accuracy);
+			for(size_t i=0; i < n; ++i)
+				values[i] -= 1.0;
+		}
+
+		/* Same as above, also writing the derivative at every
+		 * output; Stripe::train goes through here */
+		template<typename Activation>
+		inline void apply(const Activation& act, double* values, double* derivatives, size_t n) {
+			for(size_t i=0; i < n; ++i) {
+				values[i] = act(values[i]);
+				derivatives[i] = act.derive(values[i]);
+			}
+		}
+
+		inline void apply(const Tanh&, double* values, double* derivatives, size_t n) {
+			tanh(values, values, derivatives, n, Accuracy::PRECISE);
+		}
+
+		inline void apply(const Logistic&, double* values, double* derivatives, size_t n) {
+			logistic(values, values, derivatives, n, Accuracy::PRECISE);
+			for(size_t i=0; i < n; ++i)
+				values[i] -= 1.0;
+		}
+
+		inline void apply(const FastTanh& act, double* values, double* derivatives, size_t n) {
+			tanh(values, values, derivatives, n, act.accuracy);
+		}
+
+		inline void apply(const FastLogistic& act, double* values, double* derivatives, size_t n) {
+			logistic(values, values, derivatives, n, act.accuracy);
+			for(size_t i=0; i < n; ++i)
+				values[i] -= 1.0;
+		}
+
+	}
+
+}
+
+
+/* Expands (X) for every policy the templated
+ * members of Neurode and Stripe are instantiated for */
+#define NN_ACTIVATION_POLICIES(X) \
+	X(nn::activation::Tanh) \
+	X(nn::activation::Logistic) \
+	X(nn::activation::Relu) \
+	X(nn::activation::Sign) \
+	X(nn::activation::FastTanh) \
+	X(nn::activation::FastLogistic) \
+	X(nn::activation::Function)
+
+#endif
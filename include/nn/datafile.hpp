@@ -0,0 +1,116 @@
+#ifndef NN_DATAFILE_HPP
+#define NN_DATAFILE_HPP
+
+#include "nn/nn.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+
+
+inline namespace nn {
+
+	/* Binary data set files, read through mmap(2) without any parsing
+	 * or copying, so that they can be larger than the available memory.
+	 *
+	 * Layout (native endianness, all fields little-endian on x86):
+	 *
+	 *   offset  size  field
+	 *        0     8  magic, the characters "PIXNNDAT"
+	 *        8     4  version (uint32), currently 1
+	 *       12     4  dtype (uint32): 1 = IEEE-754 binary64 (double)
+	 *       16     8  input_size  (uint64), values per row of inputs
+	 *       24     8  output_size (uint64), values per row of outputs
+	 *       32     8  rows (uint64)
+	 *       40     8  data_offset (uint64), from the start of the file
+	 *       48    16  reserved, zero
+	 *
+	 * The rows start at data_offset; every row holds input_size
+	 * input values immediately followed by output_size output values. */
+	namespace datafile {
+		constexpr char MAGIC[8] = { 'P', 'I', 'X', 'N', 'N', 'D', 'A', 'T' };
+		constexpr uint32_t VERSION = 1;
+		constexpr uint32_t DTYPE_F64 = 1;
+		constexpr uint64_t HEADER_SIZE = 64;
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t dtype;
+			uint64_t input_size;
+			uint64_t output_size;
+			uint64_t rows;
+			uint64_t data_offset;
+			uint64_t reserved[2];
+		};
+
+		static_assert(sizeof(Header) == HEADER_SIZE, "data file header must be 64 bytes");
+	}
+
+
+	/* Writes a data file one row at a time, so that files larger
+	 * than memory can be produced; the row count is written
+	 * to the header by close() */
+	class DataFileWriter {
+	protected:
+		FILE* file;
+		datafile::Header header;
+
+	public:
+		DataFileWriter(const std::string& path, size_t input_size, size_t output_size);
+		DataFileWriter(const DataFileWriter&) = delete;
+		~DataFileWriter();
+
+		DataFileWriter& operator = (const DataFileWriter&) = delete;
+
+		void append(const double* inputs, const double* outputs);
+		void append(const DataView&);
+		void close();
+
+		inline size_t size() const { return header.rows; }
+	};
+
+
+	/* A read-only data file mapped in memory: its rows are
+	 * exposed as a DataView, pointing straight into the mapping */
+	class MappedDataSet {
+	public:
+		/* Access pattern hints, passed to madvise(2) */
+		enum class Access { NORMAL, SEQUENTIAL, RANDOM };
+
+	protected:
+		void* mapping;
+		size_t mapping_size;
+		datafile::Header header;
+
+	public:
+		MappedDataSet(const std::string& path, Access = Access::SEQUENTIAL);
+		MappedDataSet(const MappedDataSet&) = delete;
+		MappedDataSet(MappedDataSet&&);
+		~MappedDataSet();
+
+		MappedDataSet& operator = (const MappedDataSet&) = delete;
+		MappedDataSet& operator = (MappedDataSet&&);
+
+		void advise(Access);
+
+		/* Asks the kernel to start reading the given rows,
+		 * e.g. the next batch of a random access pattern */
+		void prefetch(size_t first_row, size_t rows);
+
+		inline size_t  inputSize() const { return header.input_size; }
+		inline size_t outputSize() const { return header.output_size; }
+		inline size_t size() const { return header.rows; }
+		inline bool  empty() const { return header.rows == 0; }
+
+		DataView view() const;
+		inline operator DataView () const { return view(); }
+	};
+
+
+	void write_data_file(const std::string& path, const DataView&);
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef NN_KERNELS_HPP
+#define NN_KERNELS_HPP
+
+#include <cstddef>
+
+
+
+inline namespace nn {
+
+	/* Vectorized building blocks for the hot loops of
+	 * Perceptron, Neurode and Stripe; the implementation is
+	 * selected at runtime, based on what the CPU supports. */
+	namespace kernel {
+
+		enum class InstructionSet {
+			SCALAR, SSE2, AVX2, AVX512
+		};
+
+		InstructionSet instruction_set();
+		bool supports(InstructionSet);
+		const char* name(InstructionSet);
+
+		/* Forces the given instruction set, unless it is not
+		 * supported by the CPU - in which case false is returned
+		 * and nothing changes */
+		bool set_instruction_set(InstructionSet);
+
+
+		// sum(a[i] * b[i])
+		double dot(const double* a, const double* b, size_t n);
+
+		// y[i] += alpha * x[i]
+		void axpy(double alpha, const double* x, double* y, size_t n);
+
+		/* out[r] = dot(w + (r * cols), x, cols) + bias[r],
+		 * for a row-major (rows * cols) matrix */
+		void matvec(
+				const double* w, const double* x, const double* bias,
+				double* out, size_t rows, size_t cols);
+
+		/* y = (x * w) + bias, where x is a row-major (rows * inner)
+		 * matrix, w is a row-major (inner * cols) matrix and
+		 * the bias is added to every row of y */
+		void gemm(
+				const double* x, const double* w, const double* bias,
+				double* y, size_t rows, size_t inner, size_t cols);
+
+		/* Single-precision versions of the above, used by TypedStripe;
+		 * twice as many values fit in a vector register.
+		 * SSE2 uses the scalar implementation. */
+		float dot(const float* a, const float* b, size_t n);
+		void axpy(float alpha, const float* x, float* y, size_t n);
+		void matvec(
+				const float* w, const float* x, const float* bias,
+				float* out, size_t rows, size_t cols);
+		void gemm(
+				const float* x, const float* w, const float* bias,
+				float* y, size_t rows, size_t inner, size_t cols);
+
+	}
+
+}
+
+#endif
@@ -3,6 +3,9 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+
+#include "nn/activation.hpp"
 
 
 
@@ -25,13 +28,138 @@ inline namespace nn {
 	using DataSet = std::vector<DataRow>;
 
 
+	/* A non-owning view over samples laid out with a fixed stride,
+	 * such as the rows of a DataMatrix */
+	struct DataView {
+		const double* inputs;
+		const double* outputs;
+		size_t input_size;
+		size_t output_size;
+		size_t input_stride;
+		size_t output_stride;
+		size_t rows;
+
+		inline const double*  inputRow(size_t i) const { return  inputs + (i *  input_stride); }
+		inline const double* outputRow(size_t i) const { return outputs + (i * output_stride); }
+
+		inline size_t size() const { return rows; }
+		inline bool  empty() const { return rows == 0; }
+	};
+
+
+	/* A data set stored as two contiguous, aligned matrices: the
+	 * inputs of all samples, and their outputs; rows can be
+	 * passed as they are to Stripe::train */
+	class DataMatrix {
+	protected:
+		size_t input_size;
+		size_t output_size;
+		size_t rows;
+		size_t capacity;
+		double* inputs;
+		double* outputs;
+
+	public:
+		DataMatrix(size_t input_size, size_t output_size, size_t capacity = 0);
+		DataMatrix(size_t input_size, size_t output_size, const DataSet&);
+		DataMatrix(const DataMatrix&);
+		DataMatrix(DataMatrix&&);
+		~DataMatrix();
+
+		DataMatrix& operator = (const DataMatrix&);
+		DataMatrix& operator = (DataMatrix&&);
+
+		void append(const double* inputs, const double* outputs);
+		void append(const DataRow&);
+		void pop();
+		void clear();
+		void reserve(size_t rows);
+
+		inline       double*  inputRow(size_t i)       { return  inputs + (i *  input_size); }
+		inline const double*  inputRow(size_t i) const { return  inputs + (i *  input_size); }
+		inline       double* outputRow(size_t i)       { return outputs + (i * output_size); }
+		inline const double* outputRow(size_t i) const { return outputs + (i * output_size); }
+
+		constexpr size_t  inputSize() const { return  input_size; }
+		constexpr size_t outputSize() const { return output_size; }
+		constexpr size_t size() const { return rows; }
+		constexpr bool  empty() const { return rows == 0; }
+
+		inline DataView view() const {
+			return DataView {
+					inputs, outputs,
+					input_size, output_size,
+					input_size, output_size,
+					rows }; }
+
+		inline operator DataView () const { return view(); }
+	};
+
+
+	enum class WeightLayout {
+		ROW_MAJOR,   // Each row holds the weights of one output
+		COLUMN_MAJOR // Each row holds the weights of one input
+	};
+
+
+	/* Cache-line aligned buffers, used for weight matrices */
+	double* alloc_buffer(size_t count);
+	void free_buffer(double* buffer);
+	void* alloc_aligned(size_t bytes);
+	void free_aligned(void* buffer);
+
+
+	/* A read-only view over a row (or column) of a Neurode's
+	 * weight matrix, as returned by a const Neurode */
+	class PerceptronView {
+	protected:
+		size_t input_size;
+		size_t stride;
+		const double* weights;
+		const double* bias;
+
+	public:
+		constexpr PerceptronView(size_t inputs, const double* w, size_t s, const double* b):
+				input_size (inputs), stride (s), weights (w), bias (b)
+		{ }
+
+		double guess(activation_func, const double* inputs) const;
+
+		inline std::vector<double> getWeights() const {
+			std::vector<double> r;  r.reserve(input_size);
+			for(size_t i=0; i < input_size; ++i)
+				r.push_back(weights[i * stride]);
+			return r;
+		}
+
+		constexpr double getBias() const {
+			return *bias; }
+	};
+
+
+	/* A Perceptron constructed on its own owns its weights;
+	 * otherwise, it is a lightweight view over a row (or column)
+	 * of a Neurode's weight matrix.
+	 * Copy-constructing a view makes another view over the same
+	 * weights, while copying an owning Perceptron copies its weights.
+	 * Assigning always copies the weights and the bias: into the
+	 * Neurode's matrix for a view, which must have as many inputs
+	 * (so that neurode[i] = p writes the weights of p into neurode),
+	 * or into the Perceptron's own storage otherwise. */
 	class Perceptron {
 	protected:
 		size_t input_size;
+		size_t stride;
 		double* weights;
+		double* bias;
+		double* storage; // Only set if the weights are owned
+
+		// Copies the weights and bias of (src), as described above
+		void copyWeights(const Perceptron& src);
 
 	public:
 		Perceptron(size_t input_size);
+		Perceptron(size_t input_size, double* weights, size_t stride, double* bias);
 		Perceptron(const Perceptron&);
 		Perceptron(Perceptron&&);
 		~Perceptron();
@@ -39,24 +167,25 @@ inline namespace nn {
 		Perceptron& operator = (const Perceptron&);
 		Perceptron& operator = (Perceptron&&);
 
-		double guess(activation_func, double* inputs) const;
-		void learn(activation_func_deriv, double* inputs, double error, double rate);
+		inline PerceptronView view() const {
+			return PerceptronView(input_size, weights, stride, bias); }
+
+		inline double guess(activation_func act, const double* inputs) const {
+			return view().guess(act, inputs); }
+
+		void learn(activation_func_deriv, const double* inputs, double error, double rate);
 		void train(activation_func_deriv, DataSet& data, double rate);
 
 		void randomize();
 
 		inline std::vector<double> getWeights() const {
-			std::vector<double> r;  r.reserve(input_size);
-			for(size_t i=0; i < input_size; ++i)
-				r.push_back(weights[i]);
-			return r;
-		}
+			return view().getWeights(); }
 
 		inline double getBias() const {
-			return weights[input_size]; }
+			return *bias; }
 
 		inline void setBias(double value) {
-			weights[input_size] = value; }
+			*bias = value; }
 	};
 
 
@@ -64,10 +193,23 @@ inline namespace nn {
 	protected:
 		size_t  input_size;
 		size_t output_size;
-		std::vector<Perceptron> perceptrons;
+		WeightLayout layout;
+
+		/* A single allocation, holding the (input_size * output_size)
+		 * weight matrix followed by the output_size biases */
+		double* weights;
+		bool owns_weights;
+
+		// out = weights * in + biases, before the activation
+		void weightedSums(const double* in, double* out) const;
 
 	public:
-		Neurode(size_t inputs, size_t outputs);
+		Neurode(size_t inputs, size_t outputs, WeightLayout = WeightLayout::ROW_MAJOR);
+
+		/* Uses the given weights (and biases) in place, without copying
+		 * them: they must outlive the Neurode. Copies of the
+		 * Neurode own their weights. */
+		Neurode(size_t inputs, size_t outputs, WeightLayout, double* weights);
 		Neurode(const Neurode&);
 		Neurode(Neurode&&);
 		virtual ~Neurode();
@@ -75,17 +217,96 @@ inline namespace nn {
 		Neurode& operator = (const Neurode&);
 		Neurode& operator = (Neurode&&);
 
-		void guess(activation_func, double* inputs, double* outputs) const;
-		void learn(activation_func, double* inputs, double* errors, double rate);
+		void guess(activation_func, const double* inputs, double* outputs) const;
+		void learn(activation_func, const double* inputs, const double* errors, double rate);
 		void train(activation_func, DataSet& data, double rate);
 
+		/* Evaluates (rows) contiguous input rows at once,
+		 * writing (rows) contiguous output rows */
+		void guessBatch(activation_func, const double* inputs, size_t rows, double* outputs) const;
+
+		/* Same as above, with the activation inlined */
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guess(const Activation&, const double* inputs, double* outputs) const;
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guessBatch(const Activation&, const double* inputs, size_t rows, double* outputs) const;
+
+		/* Same as guess, also writing the activation's
+		 * derivative at every output, as used for training */
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guess(const Activation&, const double* inputs, double* outputs, double* derivatives) const;
+
+		/* Treating this Neurode as a gradient buffer, adds the
+		 * contribution of one sample: gradient += errors x inputs */
+		void accumulate(const double* inputs, const double* errors);
+
+		/* weights -= rate * gradient; the gradient must have the same
+		 * shape and layout as this Neurode, or NeuralException is thrown */
+		void descend(const Neurode& gradient, double rate);
+
+		void zero();
+
+		/* Copies the weights and biases of a Neurode with
+		 * the same shape and layout, without reallocating */
+		void copyWeights(const Neurode&);
+
+		/* Writes the weight matrix in column-major order,
+		 * i.e. as an (inputSize() * outputSize()) row-major matrix */
+		void copyColumns(double* dst) const;
+
 		void randomize();
 
 		constexpr size_t  inputSize() const { return  input_size; }
 		constexpr size_t outputSize() const { return output_size; }
+		constexpr WeightLayout weightLayout() const { return layout; }
+
+		constexpr bool sameShape(const Neurode& other) const {
+			return
+				(other.input_size == input_size) &&
+				(other.output_size == output_size) &&
+				(other.layout == layout);
+		}
 
-		inline       Perceptron& operator [] (unsigned i)       { return perceptrons[i]; }
-		inline const Perceptron& operator [] (unsigned i) const { return perceptrons[i]; }
+		inline       double* weightData()       { return weights; }
+		inline const double* weightData() const { return weights; }
+		inline       double* biasData()       { return weights + (input_size * output_size); }
+		inline const double* biasData() const { return weights + (input_size * output_size); }
+
+		/* The returned Perceptrons are views over the Neurode's weights,
+		 * read-only if the Neurode is const; neurode[i] = p copies
+		 * the weights of p into row (or column) i */
+		Perceptron operator [] (unsigned i);
+		PerceptronView operator [] (unsigned i) const;
+	};
+
+
+	class Gradient;
+	class Stripe;
+
+
+	/* Scratch memory for evaluating a Stripe: threads evaluating the
+	 * same Stripe concurrently must each use their own.
+	 * It only grows, so once sized for a Stripe (as by the
+	 * constructor), evaluating it never allocates. */
+	class Workspace {
+	protected:
+		double* buffer;
+		size_t capacity;
+
+	public:
+		Workspace();
+		Workspace(const Stripe&);
+		Workspace(const Workspace&) = delete;
+		Workspace(Workspace&&);
+		~Workspace();
+
+		Workspace& operator = (const Workspace&) = delete;
+		Workspace& operator = (Workspace&&);
+
+		// Returns at least (count) doubles, reallocating if needed
+		double* reserve(size_t count);
+
+		constexpr size_t size() const { return capacity; }
 	};
 
 
@@ -99,17 +320,38 @@ inline namespace nn {
 
 	private:
 		/* _forward and _backward are internal buffers
-		 * used for the back-propagation algorithm;
-		 * additionally, _forward is checked to be ==nullptr
-		 * to see if the stripe has been moved */
+		 * used for the back-propagation algorithm */
 		mutable double** _forward;
 		mutable double** _backward;
 
+		/* A single cache-line aligned allocation, holding the weights
+		 * (unless they are mapped from a checkpoint), the _forward and
+		 * _backward buffers, and their arrays of pointers; every
+		 * buffer starts on its own cache line */
+		void* _arena;
+
+		/* Checkpoint loaded through mmap(2), which the
+		 * neurodes' weights point into */
+		void* _mapping;
+		size_t _mapping_size;
+
+		Stripe(std::vector<Neurode>&& neurodes, void* mapping, size_t mapping_size);
+
+		/* Places the scratch buffers in a new arena and, if
+		 * (with_weights), makes the neurodes views over
+		 * uninitialized weights in the same arena */
+		void allocateArena(bool with_weights);
+
+		// Doubles held by _forward[i] and _backward[i]
+		inline size_t scratchSize(size_t i) const {
+			return (i < neurodes_count)? neurodes[i].inputSize() : output_size; }
+
 	public:
 		Stripe(
 				size_t inputs,
 				std::vector<size_t> hidden_layer_sizes,
-				size_t outputs
+				size_t outputs,
+				WeightLayout = WeightLayout::ROW_MAJOR
 		);
 		Stripe(const Stripe&);
 		Stripe(Stripe&&);
@@ -118,28 +360,169 @@ inline namespace nn {
 		Stripe& operator = (const Stripe&);
 		Stripe& operator = (Stripe&&);
 
-		void guess(activation_func, double* inputs, double* outputs) const;
+		/* The evaluation members are thread-safe: without a Workspace,
+		 * they use one private to the calling thread */
+		void guess(activation_func, const double* inputs, double* outputs) const;
+
+		/* Evaluates (rows) contiguous input rows, one layer at a time
+		 * over tiles of rows, writing (rows) contiguous output rows */
+		void guessBatch(activation_func, const double* inputs, size_t rows, double* outputs) const;
+
+		double train(
+				activation_func, activation_func_deriv,
+				const double* inputs, const double* expect_outputs,
+				double rate);
 
 		double train(
 				activation_func, activation_func_deriv,
-				double* inputs, double* expect_outputs,
+				DataSet& data, long long int which,
 				double rate);
 
+		double train(
+				activation_func, activation_func_deriv,
+				const DataView& data, long long int which,
+				double rate);
+
+		/* Mini-batch training: the gradients of (batch_size) consecutive
+		 * rows, starting from (which), are accumulated and then
+		 * applied once, averaged over the batch.
+		 * If (which) is negative, the whole data set is trained
+		 * one batch at a time. */
+		double train(
+				activation_func, activation_func_deriv,
+				DataSet& data, long long int which,
+				double rate, size_t batch_size);
+
 		double train(
 				activation_func, activation_func_deriv,
 				DataSet& data, long long int which,
+				double rate, size_t batch_size,
+				Gradient& buffer);
+
+		double train(
+				activation_func, activation_func_deriv,
+				const DataView& data, long long int which,
+				double rate, size_t batch_size);
+
+		double train(
+				activation_func, activation_func_deriv,
+				const DataView& data, long long int which,
+				double rate, size_t batch_size,
+				Gradient& buffer);
+
+		/* Adds the gradient of a single sample to the buffer,
+		 * without altering the weights; returns the average error */
+		double accumulate(
+				activation_func, activation_func_deriv,
+				const double* inputs, const double* expect_outputs,
+				Gradient& buffer) const;
+
+		/* Same as the corresponding overloads above, with the
+		 * activation (and its derivative) inlined into the loops;
+		 * the pointer-based overloads use activation::Function */
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guess(const Activation&, const double* inputs, double* outputs) const;
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guessBatch(const Activation&, const double* inputs, size_t rows, double* outputs) const;
+
+		/* Same as above, with caller-owned scratch memory */
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guess(const Activation&, const double* inputs, double* outputs, Workspace&) const;
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guessBatch(const Activation&, const double* inputs, size_t rows, double* outputs, Workspace&) const;
+
+		/* Doubles of scratch memory used by guess and guessBatch */
+		size_t workspaceSize() const;
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		double train(
+				const Activation&,
+				const double* inputs, const double* expect_outputs,
 				double rate);
 
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		double train(
+				const Activation&,
+				const DataView& data, long long int which,
+				double rate);
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		double train(
+				const Activation&,
+				const DataView& data, long long int which,
+				double rate, size_t batch_size,
+				Gradient& buffer);
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		double accumulate(
+				const Activation&,
+				const double* inputs, const double* expect_outputs,
+				Gradient& buffer) const;
+
+		/* Applies the average of the accumulated gradients */
+		void apply(const Gradient&, double rate);
+
+		/* Copies the weights of a Stripe with the same
+		 * shape, without reallocating anything */
+		void copyWeights(const Stripe&);
+
+		/* Writes a binary checkpoint of the stripe; (activation) is
+		 * an identifier of the caller's choice, returned by load.
+		 * The file is replaced atomically. */
+		void save(
+				const std::string& path,
+				uint32_t activation = 0,
+				const Gradient* optimizer_state = nullptr) const;
+
+		/* Maps a checkpoint in memory, privately: the weights are
+		 * used in place, and are only copied when modified.
+		 * The optimizer state, if requested and present, is copied
+		 * into a Gradient of the same shape. */
+		static Stripe load(
+				const std::string& path,
+				uint32_t* activation = nullptr,
+				Gradient* optimizer_state = nullptr);
+
 		void randomize();
 
 		constexpr size_t  inputSize() const { return  input_size; }
 		constexpr size_t outputSize() const { return output_size; }
 
+		constexpr size_t neurodeCount() const { return neurodes_count; }
+
 		inline       Neurode& operator [] (unsigned i)       { return neurodes[i]; }
 		inline const Neurode& operator [] (unsigned i) const { return neurodes[i]; }
 	};
 
 
+	/* Per-layer gradient buffers, shaped like the Stripe
+	 * they were created from */
+	class Gradient {
+	protected:
+		std::vector<Neurode> layers;
+		size_t samples;
+
+	public:
+		Gradient(const Stripe&);
+
+		void clear();
+
+		/* Adds the gradients (and samples) of another buffer
+		 * created from the same Stripe */
+		void merge(const Gradient&);
+
+		inline void addSample() { ++samples; }
+		inline void setSampleCount(size_t value) { samples = value; }
+		constexpr size_t sampleCount() const { return samples; }
+		inline size_t layerCount() const { return layers.size(); }
+
+		inline       Neurode& operator [] (unsigned i)       { return layers[i]; }
+		inline const Neurode& operator [] (unsigned i) const { return layers[i]; }
+	};
+
+
 	class NeuralException {
 	protected:
 		std::string description;
@@ -0,0 +1,159 @@
+#ifndef NN_PRECISION_HPP
+#define NN_PRECISION_HPP
+
+#include "nn/nn.hpp"
+
+#include <cstdint>
+#include <cstring> // memcpy(...)
+#include <type_traits>
+
+
+
+inline namespace nn {
+
+	/* 16-bit storage formats: they are converted to float
+	 * before any arithmetic, and never computed with directly */
+	namespace precision {
+
+		// The upper half of a float, rounded to nearest even
+		struct bf16 {
+			uint16_t bits;
+
+			bf16() = default;
+			inline explicit bf16(float value) {
+				uint32_t u;  memcpy(&u, &value, sizeof(u));
+				if((u & 0x7FFFFFFFu) > 0x7F800000u) {
+					bits = (u >> 16) | 0x0040u; // Keeps NaNs quiet
+				} else {
+					bits = (u + 0x7FFFu + ((u >> 16) & 1u)) >> 16;
+				}
+			}
+
+			inline operator float() const {
+				uint32_t u = static_cast<uint32_t>(bits) << 16;
+				float r;  memcpy(&r, &u, sizeof(r));
+				return r;
+			}
+		};
+
+		// IEEE 754 half precision
+		struct fp16 {
+			uint16_t bits;
+
+			fp16() = default;
+			explicit fp16(float value);
+			operator float() const;
+		};
+
+		void convert(const bf16* in, float* out, size_t n);
+		void convert(const fp16* in, float* out, size_t n);
+
+		/* The type arithmetic is done in, for a given
+		 * storage type: float, unless the weights are double */
+		template<typename Weight> struct compute { using type = float; };
+		template<> struct compute<double> { using type = double; };
+
+	}
+
+
+	/* A copy of a Stripe, with its weights stored as (Weight):
+	 * float, double, precision::bf16 or precision::fp16.
+	 * Arithmetic is done in float (or in double, for double weights);
+	 * float halves the memory traffic and doubles the SIMD width
+	 * of the double-precision Stripe.
+	 * Each layer is stored column-major if it has more outputs than
+	 * inputs, row-major otherwise: evaluating it and updating it
+	 * then take few, long vector operations rather than many short
+	 * ones, where a wider vector would make no difference.
+	 * The 16-bit formats are meant for inference only, and cannot
+	 * be trained: their weights are converted to float on the fly.
+	 * As Stripe's, the evaluation members are thread-safe: without a
+	 * Workspace, they (and train) use one private to the calling thread.
+	 * The members are instantiated for every policy in
+	 * NN_ACTIVATION_POLICIES. */
+	template<typename Weight>
+	class TypedStripe {
+	public:
+		using Scalar = typename precision::compute<Weight>::type;
+
+		static constexpr bool TRAINABLE =
+				std::is_same<Weight, float>::value || std::is_same<Weight, double>::value;
+
+	protected:
+		/* Like Neurode: the (output_size * input_size) matrix,
+		 * followed by the biases, in a single allocation */
+		struct Layer {
+			size_t input_size;
+			size_t output_size;
+			WeightLayout layout;
+			Weight* weights;
+
+			// Where the weight from input (j) to output (o) is
+			constexpr size_t at(size_t o, size_t j) const {
+				return (layout == WeightLayout::ROW_MAJOR)?
+						(o * input_size) + j : (j * output_size) + o; }
+		};
+
+		size_t input_size;
+		size_t output_size;
+		size_t biggest_neurode;
+		size_t biggest_layer; // Weights and biases of the largest layer
+		std::vector<Layer> layers;
+
+		// Scalars needed to convert a layer's weights, if they are not Scalar
+		constexpr size_t convertedSize() const {
+			return std::is_same<Weight, Scalar>::value? 0 : biggest_layer; }
+
+		/* The layer's weights as Scalar: converted into (scratch),
+		 * unless they already are */
+		const Scalar* computeWeights(size_t layer, Scalar* scratch) const;
+
+	public:
+		TypedStripe(const Stripe&);
+		TypedStripe(const TypedStripe&);
+		TypedStripe(TypedStripe&&);
+		~TypedStripe();
+
+		TypedStripe& operator = (const TypedStripe&);
+		TypedStripe& operator = (TypedStripe&&);
+
+		/* Converts the weights of a Stripe with the same shape,
+		 * without reallocating anything */
+		void copyWeights(const Stripe&);
+
+		// Converts the weights back into a Stripe with the same shape
+		void exportWeights(Stripe&) const;
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guess(const Activation&, const Scalar* inputs, Scalar* outputs) const;
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guessBatch(const Activation&, const Scalar* inputs, size_t rows, Scalar* outputs) const;
+
+		/* Same as above, with caller-owned scratch memory */
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guess(const Activation&, const Scalar* inputs, Scalar* outputs, Workspace&) const;
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guessBatch(const Activation&, const Scalar* inputs, size_t rows, Scalar* outputs, Workspace&) const;
+
+		/* Doubles of scratch memory used by guess, guessBatch and train */
+		size_t workspaceSize() const;
+
+		/* Same as Stripe::train; only for float and double weights */
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		Scalar train(
+				const Activation&,
+				const Scalar* inputs, const Scalar* expect_outputs,
+				Scalar rate);
+
+		constexpr size_t  inputSize() const { return  input_size; }
+		constexpr size_t outputSize() const { return output_size; }
+		inline size_t layerCount() const { return layers.size(); }
+	};
+
+	using FloatStripe = TypedStripe<float>;
+
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef NN_QUANTIZED_HPP
+#define NN_QUANTIZED_HPP
+
+#include "nn/nn.hpp"
+#include "nn/activation.hpp"
+
+#include <cstdint>
+
+
+
+inline namespace nn {
+
+	/* An inference-only copy of a trained Stripe, with 8-bit weights.
+	 * Each output has its own scale, max(|w|) / 127 over its weights,
+	 * and its products are accumulated as 32-bit integers before being
+	 * scaled back to float, where the biases and the activation are
+	 * applied.
+	 * The inputs of every layer are quantized row by row to
+	 * [-127, 127]; as neither operand reaches -128, the byte products
+	 * (pmaddubsw, AVX-512 VNNI) never saturate, and every
+	 * instruction set gives exactly the same accumulators.
+	 * Rounding the activations of every row to 8 bits is what limits
+	 * the precision: a pre-activation that sums 128 of them is off by
+	 * up to about 1%, which can move a 2x128x128x1 network's tanh
+	 * output by 0.2 where it crosses zero (nntest bounds it at 0.25).
+	 * As Stripe's, the evaluation members are thread-safe: without a
+	 * Workspace, they use one private to the calling thread.
+	 * The members are instantiated for every policy in
+	 * NN_ACTIVATION_POLICIES. */
+	class QuantizedStripe {
+	protected:
+		/* The weights are interleaved for the vector units: for every
+		 * group of 16 outputs and every 4 consecutive inputs, a block
+		 * of 64 bytes holds the 4 weights of each output in turn.
+		 * The inputs are zero-padded to a multiple of 4 (chunks),
+		 * and the outputs to a multiple of 16 (groups).
+		 * The weights are followed by the sum of each output's
+		 * weights, that VNNI needs to offset its inputs,
+		 * by the scale of each output and by the biases */
+		struct Layer {
+			size_t input_size;
+			size_t output_size;
+			size_t chunks;
+			size_t groups;
+			int8_t* weights;
+			int32_t* sums;
+			float* scales;
+			float* biases;
+		};
+
+		size_t input_size;
+		size_t output_size;
+		size_t biggest_neurode;
+		size_t biggest_chunks;
+		size_t biggest_groups;
+		std::vector<Layer> layers;
+
+		/* Evaluates up to a tile of rows, with the scratch memory
+		 * of (ws): the float activations of two layers, their
+		 * quantized copy with the scale of each row, and the
+		 * integer accumulators */
+		template<typename Activation>
+		void forward(const Activation&, const float* inputs, size_t rows, float* outputs, Workspace& ws) const;
+
+	public:
+		QuantizedStripe(const Stripe&);
+		QuantizedStripe(const QuantizedStripe&);
+		QuantizedStripe(QuantizedStripe&&);
+		~QuantizedStripe();
+
+		QuantizedStripe& operator = (const QuantizedStripe&);
+		QuantizedStripe& operator = (QuantizedStripe&&);
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guess(const Activation&, const float* inputs, float* outputs) const;
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guessBatch(const Activation&, const float* inputs, size_t rows, float* outputs) const;
+
+		/* Same as above, with caller-owned scratch memory */
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guess(const Activation&, const float* inputs, float* outputs, Workspace&) const;
+
+		template<typename Activation, typename = activation::if_policy<Activation>>
+		void guessBatch(const Activation&, const float* inputs, size_t rows, float* outputs, Workspace&) const;
+
+		/* Doubles of scratch memory used by guess and guessBatch */
+		size_t workspaceSize() const;
+
+		constexpr size_t  inputSize() const { return  input_size; }
+		constexpr size_t outputSize() const { return output_size; }
+		inline size_t layerCount() const { return layers.size(); }
+
+		// Bytes taken by the weights, sums, scales and biases of every layer
+		size_t weightBytes() const;
+	};
+
+}
+
+#endif
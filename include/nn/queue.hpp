@@ -0,0 +1,85 @@
+#ifndef NN_QUEUE_HPP
+#define NN_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+
+
+inline namespace nn {
+
+	/* A bounded, lock-free, single-producer single-consumer queue:
+	 * exactly one thread may push and exactly one thread may pop.
+	 * Neither operation ever blocks; push fails if the queue is full,
+	 * pop fails if it is empty. The capacity is rounded up to a
+	 * power of two. */
+	template<typename T>
+	class SpscQueue {
+	protected:
+		static constexpr size_t CACHE_LINE = 64;
+
+		size_t mask;
+		T* slots;
+
+		/* head is only written by the consumer, tail by the producer;
+		 * keeping them on separate cache lines avoids false sharing */
+		alignas(CACHE_LINE) std::atomic<size_t> head;
+		alignas(CACHE_LINE) std::atomic<size_t> tail;
+
+	public:
+		SpscQueue(size_t capacity):
+				mask (1),
+				slots (nullptr),
+				head (0),
+				tail (0)
+		{
+			while(mask < capacity)  mask <<= 1;
+			slots = new T[mask];
+			mask -= 1;
+		}
+
+		SpscQueue(const SpscQueue&) = delete;
+
+		~SpscQueue() {
+			if(slots != nullptr) {
+				delete[] slots;  slots = nullptr;
+			}
+		}
+
+		SpscQueue& operator = (const SpscQueue&) = delete;
+
+
+		/* The value is only moved from if the push succeeds */
+		bool push(T&& value) {
+			size_t t = tail.load(std::memory_order_relaxed);
+			if(t - head.load(std::memory_order_acquire) > mask)
+				return false;
+			slots[t & mask] = std::move(value);
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool push(const T& value) {
+			return push(T(value));
+		}
+
+		bool pop(T& dst) {
+			size_t h = head.load(std::memory_order_relaxed);
+			if(h == tail.load(std::memory_order_acquire))
+				return false;
+			dst = std::move(slots[h & mask]);
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		inline size_t capacity() const { return mask + 1; }
+
+		/* Only a hint, when called by neither the producer nor the consumer */
+		inline bool empty() const {
+			return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+	};
+
+}
+
+#endif
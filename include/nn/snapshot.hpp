@@ -0,0 +1,62 @@
+#ifndef NN_SNAPSHOT_HPP
+#define NN_SNAPSHOT_HPP
+
+#include "nn/nn.hpp"
+
+#include <atomic>
+#include <cstddef>
+
+
+
+inline namespace nn {
+
+	/* Consistent copies of a Stripe's weights, handed from a writer
+	 * (e.g. a training thread) to a single reader (e.g. a renderer)
+	 * through a lock-free triple buffer: publish fills a spare copy
+	 * and swaps it in, acquire swaps out the latest published one.
+	 * Neither ever blocks or allocates, and the reader never sees a
+	 * copy that is being written to.
+	 * Calls to publish must not overlap, and only one thread
+	 * may acquire. */
+	class StripeSnapshot {
+	protected:
+		static constexpr unsigned FRESH = 4; // Set once published, cleared once acquired
+
+		Stripe* slots[3];
+		size_t epochs[3];
+
+		unsigned back;  // Only used by the writer
+		unsigned front; // Only used by the reader
+		std::atomic<unsigned> middle;
+		size_t published;
+
+	public:
+		/* Every copy starts with the weights of (stripe),
+		 * and any published Stripe must have the same shape */
+		StripeSnapshot(const Stripe& stripe);
+		StripeSnapshot(const StripeSnapshot&) = delete;
+		~StripeSnapshot();
+
+		StripeSnapshot& operator = (const StripeSnapshot&) = delete;
+
+		// Copies the weights of (stripe) into the next snapshot
+		void publish(const Stripe& stripe);
+
+		/* Returns the latest published snapshot, which stays valid
+		 * (and unchanged) until the next call; the reader may use it
+		 * freely, including its non-thread-safe const members */
+		const Stripe& acquire();
+
+		/* Whether a snapshot was published since the last acquire:
+		 * a writer may skip publishing until it is taken */
+		inline bool pending() const {
+			return 0 != (middle.load(std::memory_order_acquire) & FRESH); }
+
+		/* Numbers the snapshot returned by the last acquire: 0 for
+		 * the initial weights, then n for the n-th one published */
+		inline size_t epoch() const { return epochs[front]; }
+	};
+
+}
+
+#endif
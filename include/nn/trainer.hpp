@@ -0,0 +1,111 @@
+#ifndef NN_TRAINER_HPP
+#define NN_TRAINER_HPP
+
+#include "nn/nn.hpp"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+
+inline namespace nn {
+
+	/* Trains a Stripe over a DataSet with multiple threads,
+	 * each worker computing the gradients of its own shard
+	 * of every batch on a private replica of the Stripe. */
+	class ParallelTrainer {
+	public:
+		enum class Mode {
+			/* The workers' gradients are summed (each worker reducing
+			 * a slice of the weights) and applied once per batch:
+			 * the result does not depend on thread timing */
+			SYNCHRONOUS,
+
+			/* Every worker applies its own batches to the shared Stripe
+			 * as soon as they are computed, without any locking
+			 * (Hogwild!-style): concurrent updates may overwrite
+			 * each other, in exchange for no synchronization at all */
+			HOGWILD
+		};
+
+	protected:
+		struct Worker {
+			Stripe replica;
+			Gradient gradient;
+			double error;
+			std::thread thread;
+
+			Worker(const Stripe&);
+		};
+
+		/* A spinning barrier: batches are usually short, and
+		 * blocking on a condition variable would cost more
+		 * than the batch itself */
+		class Barrier {
+		protected:
+			size_t count;
+			std::atomic<size_t> waiting;
+			std::atomic<size_t> phase;
+
+		public:
+			Barrier(size_t count);
+			void wait();
+		};
+
+		Stripe& stripe;
+		activation_func act;
+		activation_func_deriv deriv;
+		Mode mode;
+
+		std::vector<Worker*> workers;
+		Barrier barrier;
+
+		/* Current job, published to the workers by
+		 * incrementing the generation */
+		std::mutex mutex;
+		std::condition_variable job_cond;
+		std::condition_variable done_cond;
+		size_t generation;
+		size_t done_count;
+		bool stopping;
+		DataSet* data; // If nullptr, (view) holds the samples
+		DataView view;
+		double rate;
+		size_t batch_size;
+
+		size_t rowCount() const;
+		void getRow(size_t i, const double** inputs, const double** outputs) const;
+
+		double run(double rate, size_t batch_size);
+		void work(size_t index);
+		void runSynchronous(size_t index);
+		void runHogwild(size_t index);
+		void reduce(size_t index, size_t batch_rows);
+
+	public:
+		ParallelTrainer(
+				Stripe& stripe,
+				activation_func, activation_func_deriv,
+				size_t threads = std::thread::hardware_concurrency(),
+				Mode = Mode::SYNCHRONOUS);
+		ParallelTrainer(const ParallelTrainer&) = delete;
+		~ParallelTrainer();
+
+		ParallelTrainer& operator = (const ParallelTrainer&) = delete;
+
+		/* Trains every row of the data set once, and returns the
+		 * average error; each batch is split among the workers */
+		double epoch(DataSet& data, double rate, size_t batch_size);
+		double epoch(const DataView& data, double rate, size_t batch_size);
+
+		inline size_t threadCount() const { return workers.size(); }
+		constexpr Mode getMode() const { return mode; }
+		inline void setMode(Mode value) { mode = value; }
+	};
+
+}
+
+#endif
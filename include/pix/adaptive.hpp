@@ -0,0 +1,49 @@
+#ifndef PIX_ADAPTIVE_HPP
+#define PIX_ADAPTIVE_HPP
+
+#include "region.hpp"
+
+#include <cstddef>
+
+
+
+inline namespace pix {
+
+	/* Evaluates (count) points at once: the point i is the pixel
+	 * (coords[2*i], coords[2*i + 1]), its value goes to values[i] */
+	using field_func_t =
+		void(*)(void* static_data, const unsigned* coords, size_t count, double* values);
+
+
+	/* Samples a scalar field over an area without evaluating it at
+	 * every pixel: the field is evaluated at the corners of a grid
+	 * of (cellSize()) pixels, and each cell whose corners differ by
+	 * more than (threshold()), or lie on both sides of zero, is split
+	 * in four, down to single pixels; the pixels of the other cells
+	 * are interpolated (bilinearly) from their corners.
+	 * Smooth areas cost a few evaluations per cell, and only the
+	 * cells crossed by a zero (or a steep slope) are evaluated at
+	 * every pixel. Features smaller than a cell, that do not reach
+	 * its corners, may be missed.
+	 * Each level of the subdivision is evaluated as a single batch. */
+	class AdaptiveSampler {
+	protected:
+		unsigned cell_size; // A power of two
+		double max_delta;
+
+	public:
+		AdaptiveSampler(unsigned cell_size = 8, double threshold = 0.05);
+
+		constexpr unsigned cellSize() const { return cell_size; }
+		constexpr double threshold() const { return max_delta; }
+		inline void setThreshold(double t) { max_delta = t; }
+
+		/* Writes (area.width * area.height) values, row-major, one per
+		 * pixel of (area); returns how many of them were evaluated.
+		 * It may be called from several threads at once. */
+		size_t sample(const Rect& area, void* data, field_func_t, double* values) const;
+	};
+
+}
+
+#endif
@@ -1,17 +1,21 @@
 #ifndef PIX_BOX_HPP
 #define PIX_BOX_HPP
 
+#include "pix/globject.hpp"
+#include "pix/shader.hpp"
 #include "pix/canvas.hpp"
+#include "pix/region.hpp"
 
 
 
 inline namespace pix {
 
 	class Box : public Canvas {
-	private:
-		mutable bool cached = false;
-
 	protected:
+		/* The pixels changed since the last upload: the texture's
+		 * storage is allocated once, then only these are updated */
+		DirtyRegion dirty;
+
 		gla::ShaderProgram& shader;
 		gla::VertexArray va;
 		gla::VertexBuffer vb;
@@ -20,6 +24,10 @@ inline namespace pix {
 		glm::vec4 color;
 
 		GLuint texture_id;
+		GLint min_filter;
+
+		constexpr bool usesMipmaps() const {
+			return (min_filter != GL_NEAREST) && (min_filter != GL_LINEAR); }
 
 	public:
 		Box(
@@ -29,27 +37,44 @@ inline namespace pix {
 				glm::vec4 color = glm::vec4(1.0f),
 				glm::vec2 top_left = glm::vec2(1.0, -1.0),
 				glm::vec2 bottom_right = glm::vec2(-1.0, 1.0),
-				GLfloat depth = 0.0f
+				GLfloat depth = 0.0f,
+				PixelFormat format = PixelFormat::RGBA8
 		);
 
 		void draw();
 		void updateTexture();
 
-		/* Below: state-altering functions that trigger the cache */
+		/* Sets the texture's filters; the mipmaps are only
+		 * generated if (min) uses them */
+		void setFilters(GLint min, GLint mag);
+
+		/* Below: state-altering functions that mark pixels to upload */
 
 		inline void setPixel(unsigned x, unsigned y, glm::vec4 c) {
-			cached = false;  Canvas::setPixel(x, y, c); }
+			dirty.add(x, y);  Canvas::setPixel(x, y, c); }
 
 		inline void fill(glm::vec4 c) {
-			cached = false;  Canvas::fill(c); }
+			dirty.addAll();  Canvas::fill(c); }
 
 		inline void computePixels(void* d, color_func_t f) {
-			cached = false;  Canvas::computePixels(d, f); }
+			dirty.addAll();  Canvas::computePixels(d, f); }
 
 		inline void computePixels(static_color_func_t f) {
-			cached = false;  Canvas::computePixels(f); }
+			dirty.addAll();  Canvas::computePixels(f); }
+
+		inline void computePixels(void* d, color_func_t f, ThreadPool& p) {
+			dirty.addAll();  Canvas::computePixels(d, f, p); }
+
+		inline void computePixels(static_color_func_t f, ThreadPool& p) {
+			dirty.addAll();  Canvas::computePixels(f, p); }
+
+		inline void computeTiles(void* d, tile_func_t f, unsigned size = 64) {
+			dirty.addAll();  Canvas::computeTiles(d, f, size); }
+
+		inline void computeTiles(void* d, tile_func_t f, ThreadPool& p, unsigned size = 64) {
+			dirty.addAll();  Canvas::computeTiles(d, f, p, size); }
 
-		/* Above: state-altering functions that trigger the cache */
+		/* Above: state-altering functions that mark pixels to upload */
 	};
 
 }
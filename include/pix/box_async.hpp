@@ -2,16 +2,44 @@
 #define PIX_BOX_ASYNC_HPP
 
 #include "pix/box.hpp"
+#include "pix/ring.hpp"
 
 #include <mutex>
+#include <vector>
+#include <cstdint>
 
 
 
 inline namespace pix {
 
+	/* The OpenGL backend of BufferRing: pixel unpack buffers,
+	 * persistently and coherently mapped, and sync objects */
+	struct GLBuffers {
+		using buffer_t = GLuint;
+		using fence_t = GLsync;
+
+		buffer_t createBuffer(size_t bytes, void** mapping);
+		void destroyBuffer(buffer_t);
+		fence_t insertFence();
+		bool waitFence(fence_t);
+		void deleteFence(fence_t);
+	};
+
+
+	/* A Box that can be drawn into from another thread, and that
+	 * streams its dirty pixels through a ring of pixel buffers: the
+	 * GPU copies a frame's pixels while the next one is computed */
 	class AsyncBox : public Box {
 	protected:
+		static constexpr size_t RING_SLOTS = 3;
+
 		std::mutex mutex;
+		GLBuffers buffers;
+		BufferRing<GLBuffers>* ring; // nullptr if persistent mappings are unsupported
+		std::vector<uint8_t> staging; // Converted pixels, without a ring
+		PixelFormat upload_format; // The canvas' own format, unless set otherwise
+
+		void upload();
 
 	public:
 		AsyncBox(
@@ -21,12 +49,26 @@ inline namespace pix {
 				glm::vec4 color = glm::vec4(1.0f),
 				glm::vec2 top_left = glm::vec2(1.0, -1.0),
 				glm::vec2 bottom_right = glm::vec2(-1.0, 1.0),
-				GLfloat depth = 0.0f
+				GLfloat depth = 0.0f,
+				PixelFormat format = PixelFormat::RGBA8
 		);
+		AsyncBox(const AsyncBox&) = delete;
+		~AsyncBox();
+
+		AsyncBox& operator = (const AsyncBox&) = delete;
 
 		void draw();
 		void updateTexture();
 
+		/* The pixels are converted to the upload format while being
+		 * packed, e.g. to send an RGBA32F canvas as RGBA8; without
+		 * persistent mappings, they are packed in client memory */
+		constexpr PixelFormat uploadFormat() const { return upload_format; }
+		inline void setUploadFormat(PixelFormat value) { upload_format = value; }
+
+		// How many uploads had to wait for the GPU to release a buffer
+		inline size_t stallCount() const { return (ring != nullptr)? ring->stallCount() : 0; }
+
 		inline       std::mutex& getMutex()       { return mutex; }
 		inline const std::mutex& getMutex() const { return mutex; }
 	};
@@ -1,8 +1,8 @@
 #ifndef PIX_CANVAS_HPP
 #define PIX_CANVAS_HPP
 
-#include "globject.hpp"
-#include "shader.hpp"
+#include "threadpool.hpp"
+#include "pixels.hpp"
 
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
@@ -18,17 +18,41 @@ inline namespace pix {
 		glm::vec4(*)(unsigned int x, unsigned int y);
 
 
+	/* A rectangle of a Canvas, with access to its RGBA values as
+	 * floats: the pixel (x + i, y + j) of the canvas starts at
+	 * pixels[(j * stride) + (4 * i)]. For RGBA32F canvases, these
+	 * are the canvas' own values; for other formats, a copy that
+	 * is packed back once the tile is computed. */
+	struct Tile {
+		unsigned int x, y;
+		unsigned int width, height;
+		float* pixels;
+		size_t stride; // Floats between two rows
+	};
+
+	/* Computes every pixel of a tile at once, which lets the
+	 * producer batch (or vectorize) its work instead of being
+	 * called once per pixel */
+	using tile_func_t =
+		void(*)(void* static_data, const Tile&);
+
+
+	/* The pixels are stored in the canvas' PixelFormat, and
+	 * converted from (and to) floats by every member; RGBA8,
+	 * the default, takes a quarter of the memory of RGBA32F.
+	 * A Canvas does not depend on OpenGL: Box draws one. */
 	class Canvas {
 	protected:
 		unsigned int width, height;
-		GLfloat* data;
+		PixelFormat format;
+		uint8_t* data; // (width * height) pixels, of pixel_size(format) bytes
 
 	public:
-		Canvas(unsigned width, unsigned height);
+		Canvas(unsigned width, unsigned height, PixelFormat = PixelFormat::RGBA8);
 		Canvas(const Canvas &) = delete;
 
-		inline Canvas(unsigned side_length):
-				Canvas::Canvas(side_length, side_length)
+		inline Canvas(unsigned side_length, PixelFormat f = PixelFormat::RGBA8):
+				Canvas::Canvas(side_length, side_length, f)
 		{ }
 
 		~Canvas();
@@ -40,9 +64,28 @@ inline namespace pix {
 
 		constexpr unsigned int getWidth() const { return width; }
 		constexpr unsigned int getHeight() const { return height; }
+		constexpr PixelFormat getFormat() const { return format; }
+
+		// Converts the row (y) to (format), into (dst)
+		void readRow(unsigned y, PixelFormat format, void* dst) const;
 
 		void computePixels(void* data, color_func_t);
 		void computePixels(static_color_func_t);
+
+		/* Same as above, with the rows split in bands that the pool's
+		 * threads compute concurrently: the callback must be
+		 * thread-safe, as it is called from several threads at once
+		 * (with the same static_data), in no particular order */
+		void computePixels(void* data, color_func_t, ThreadPool&);
+		void computePixels(static_color_func_t, ThreadPool&);
+
+		/* Splits the canvas in tiles of at most (tile_size) pixels
+		 * per side, in row-major order, and computes each one */
+		void computeTiles(void* data, tile_func_t, unsigned tile_size = 64);
+
+		/* Same as above, with the tiles computed concurrently by the
+		 * pool's threads: the callback must be thread-safe */
+		void computeTiles(void* data, tile_func_t, ThreadPool&, unsigned tile_size = 64);
 	};
 
 
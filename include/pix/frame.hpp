@@ -0,0 +1,79 @@
+#ifndef PIX_FRAME_HPP
+#define PIX_FRAME_HPP
+
+#include "pix/canvas.hpp"
+
+#include <string>
+#include <vector>
+#include <exception>
+#include <cstdio>
+
+
+
+inline namespace pix {
+
+	enum class FrameFormat {
+		PNG, // RGBA, one file per frame
+		PPM, // RGB (binary P6) over the background color, one file per frame
+		RAW  // RGBA8 frames appended to a single stream, e.g. for ffmpeg's rawvideo
+	};
+
+	/* Parses "png", "ppm" or "raw"; returns false if (name) is none of them */
+	bool parse_frame_format(const std::string& name, FrameFormat* format);
+
+
+	class FrameException : public std::exception {
+	private:
+		std::string msg;
+	public:
+		FrameException(const std::string& message);
+
+		const char * what() const noexcept;
+	};
+
+
+	/* Writes canvases to image files, without OpenGL or a display.
+	 * The rows are written from the canvas' last one to its first,
+	 * so that the images look like a Box drawn in a window.
+	 * For PNG and PPM, a (path) containing a single conversion
+	 * %u or %d, with an optional width (e.g. "surface_%04u.png"),
+	 * is given the frame's index; otherwise, every frame replaces
+	 * the previous one. "%%" is a literal '%', and any other use
+	 * of '%' throws a FrameException.
+	 * For RAW, (path) is the stream, "-" being the standard output. */
+	class FrameWriter {
+	protected:
+		std::string path;
+		FrameFormat format;
+		std::string prefix, suffix; // Around the frame's index, if numbered
+		bool numbered;
+		unsigned index_width;
+		char index_pad;
+		FILE* stream; // Only used by RAW
+		unsigned frames;
+		glm::vec4 background;
+		std::vector<uint8_t> image;
+
+		std::string framePath() const;
+		void writePng(FILE*, unsigned width, unsigned height) const;
+		void writePpm(FILE*, unsigned width, unsigned height) const;
+
+	public:
+		FrameWriter(const std::string& path, FrameFormat);
+		FrameWriter(const FrameWriter&) = delete;
+		~FrameWriter();
+
+		FrameWriter& operator = (const FrameWriter&) = delete;
+
+		void write(const Canvas&);
+
+		constexpr unsigned frameCount() const { return frames; }
+		constexpr FrameFormat getFormat() const { return format; }
+
+		// The color under transparent pixels, for PPM; white by default
+		inline void setBackground(glm::vec4 color) { background = color; }
+	};
+
+}
+
+#endif
@@ -37,6 +37,11 @@ inline namespace pix {
 		inline void close() { glfwSetWindowShouldClose(glfw_window, GL_TRUE); }
 
 		void pollEvents();
+
+		/* Processes events as they arrive, for at most (timeout_s)
+		 * seconds: returns early if one arrives */
+		void waitEvents(double timeout_s);
+
 		void swapBuffers();
 	};
 
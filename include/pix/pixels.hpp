@@ -0,0 +1,41 @@
+#ifndef PIX_PIXELS_HPP
+#define PIX_PIXELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+
+
+inline namespace pix {
+
+	/* How a Canvas stores its RGBA values */
+	enum class PixelFormat {
+		RGBA8,   // Unsigned bytes, for values in [0, 1]: 4 bytes per pixel
+		RGBA16F, // Half-precision floats: 8 bytes per pixel
+		RGBA32F  // Single-precision floats: 16 bytes per pixel
+	};
+
+	constexpr size_t pixel_size(PixelFormat f) {
+		return
+			(f == PixelFormat::RGBA8)?   4 :
+			(f == PixelFormat::RGBA16F)? 8 : 16;
+	}
+
+
+	/* Conversions of (count) values (not pixels), vectorized where
+	 * the CPU allows it; every path gives the same results.
+	 * Bytes are round(clamp(x, 0, 1) * 255), NaN giving 0;
+	 * halves are rounded to nearest, ties to even. */
+	void pack_rgba8(const float* src, uint8_t* dst, size_t count);
+	void unpack_rgba8(const uint8_t* src, float* dst, size_t count);
+	void pack_rgba16f(const float* src, uint16_t* dst, size_t count);
+	void unpack_rgba16f(const uint16_t* src, float* dst, size_t count);
+
+	/* Same as above, for (pixels) RGBA pixels of any format */
+	void pack_pixels(const float* src, PixelFormat, void* dst, size_t pixels);
+	void unpack_pixels(const void* src, PixelFormat, float* dst, size_t pixels);
+	void convert_pixels(const void* src, PixelFormat from, void* dst, PixelFormat to, size_t pixels);
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef PIX_REFINE_HPP
+#define PIX_REFINE_HPP
+
+#include "canvas.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+
+inline namespace pix {
+
+	/* A deterministic order for recomputing a canvas over several
+	 * frames, instead of all of it at once: the pixels are split in
+	 * passes, each pass being one pixel per block of (side * side)
+	 * pixels, so that every pixel is recomputed once every
+	 * passCount() passes. Within a block, passes follow a Bayer
+	 * (ordered dithering) matrix: the first 4^n passes compute a
+	 * regular grid, (side / 2^n) pixels apart.
+	 * After restart(), the pixels of the first cycle that have not
+	 * been computed yet are filled with the closest computed pixel
+	 * of their block, which shows the whole canvas after the first
+	 * frame, then refines it frame after frame.
+	 * A frame computes as many passes as its time budget allows,
+	 * from the measured time of the previous frames. */
+	class Refinement {
+	public:
+		static constexpr unsigned MAX_PASSES = 1024; // Blocks of 32x32 pixels
+
+	protected:
+		unsigned side; // A power of two
+		std::vector<uint16_t> ranks; // The pass of each pixel of a block
+		unsigned first; // The current frame's first pass
+		unsigned count; // The current frame's number of passes
+		unsigned refined; // Passes computed since restart(), up to passCount()
+		unsigned outdated; // Passes to compute before the canvas is up to date
+		double pass_time; // Estimated seconds per pass, 0 if unknown
+
+	public:
+		/* (passes) is rounded up to a power of 4, up to MAX_PASSES;
+		 * a single pass recomputes every pixel of every frame */
+		Refinement(unsigned passes = 16);
+
+		void setPassCount(unsigned passes);
+		inline unsigned passCount() const { return side * side; }
+		constexpr unsigned blockSide() const { return side; }
+
+		// The pass in which the pixel (x, y) is computed
+		inline unsigned rank(unsigned x, unsigned y) const {
+			return ranks[((y & (side-1)) * side) + (x & (side-1))]; }
+
+		/* Whether the cycle following restart() is still
+		 * filling the pixels it did not compute yet */
+		inline bool coarse() const { return refined < passCount(); }
+
+		// Starts again from a canvas where nothing was computed yet
+		void restart();
+
+		/* Every pixel has to be computed again (e.g. the source
+		 * changed), but the canvas is kept as it is meanwhile */
+		void invalidate();
+
+		/* Whether every pixel was computed since the
+		 * last invalidate() or restart() */
+		inline bool upToDate() const { return outdated == 0; }
+
+		/* Decides the passes of the next frame: as many as
+		 * (budget_s) seconds allow, or one if it is not positive */
+		void beginFrame(double budget_s = 0.0);
+
+		// Whether the current frame computes the pixel (x, y)
+		inline bool computes(unsigned x, unsigned y) const {
+			return ((rank(x, y) + passCount() - first) % passCount()) < count; }
+
+		/* Fills the pixels of the tile that were never computed since
+		 * restart() (if coarse()) with the closest computed pixel of
+		 * their block: the tile must start on a multiple of blockSide() */
+		void fillTile(const Tile&) const;
+
+		/* Ends the current frame, which took (elapsed_s) seconds
+		 * to compute its passes */
+		void endFrame(double elapsed_s);
+
+		constexpr unsigned framePasses() const { return count; }
+		constexpr double passTime() const { return pass_time; }
+	};
+
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef PIX_REGION_HPP
+#define PIX_REGION_HPP
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+
+
+inline namespace pix {
+
+	struct Rect {
+		unsigned int x, y;
+		unsigned int width, height;
+	};
+
+
+	/* The parts of a width*height area that changed since the last
+	 * clear(), tracked with a granularity of (tile) pixels per side.
+	 * It does not depend on OpenGL, so that it can be tested
+	 * without a GPU. */
+	class DirtyRegion {
+	protected:
+		unsigned int width, height;
+		unsigned int tile;
+		unsigned int columns, rows;
+		std::vector<uint8_t> dirty; // One per tile, row-major
+		size_t dirty_count;
+
+		inline void mark(unsigned column, unsigned row) {
+			uint8_t& d = dirty[(row * columns) + column];
+			dirty_count += (d == 0);
+			d = 1;
+		}
+
+	public:
+		DirtyRegion(unsigned w, unsigned h, unsigned tile_size = 16):
+				width (w),  height (h),
+				tile ((tile_size < 1)? 1 : tile_size),
+				columns ((w + tile - 1) / tile),
+				rows ((h + tile - 1) / tile),
+				dirty (columns * rows, 0),
+				dirty_count (0)
+		{ }
+
+		inline void add(unsigned x, unsigned y) {
+			if((x < width) && (y < height))
+				mark(x / tile, y / tile);
+		}
+
+		// The rectangle is clipped to the area
+		void add(Rect r) {
+			if((r.x >= width) || (r.y >= height) || (r.width == 0) || (r.height == 0))
+				return;
+			unsigned last_x = ((r.width  > width  - r.x)? width  : r.x + r.width)  - 1;
+			unsigned last_y = ((r.height > height - r.y)? height : r.y + r.height) - 1;
+			for(unsigned row = r.y / tile; row <= last_y / tile; ++row)
+				for(unsigned column = r.x / tile; column <= last_x / tile; ++column)
+					mark(column, row);
+		}
+
+		inline void addAll() {
+			std::fill(dirty.begin(), dirty.end(), 1);
+			dirty_count = dirty.size();
+		}
+
+		inline void clear() {
+			std::fill(dirty.begin(), dirty.end(), 0);
+			dirty_count = 0;
+		}
+
+		inline bool empty() const { return dirty_count == 0; }
+		inline bool full() const { return dirty_count == dirty.size(); }
+
+		/* Covers the dirty tiles with few rectangles, clipped to the
+		 * area: the runs of dirty tiles of each row of tiles, merged
+		 * with the runs right below them when they span the same
+		 * columns. A full region is a single rectangle. */
+		std::vector<Rect> rects() const {
+			std::vector<Rect> r;
+			if(empty())  return r;
+			if(full()) {
+				r.push_back(Rect { 0, 0, width, height });
+				return r;
+			}
+
+			/* (open) holds the rectangles that reach the previous
+			 * row of tiles, and may be extended downwards */
+			std::vector<Rect> open;
+			std::vector<Rect> next;
+			for(unsigned row = 0; row < rows; ++row) {
+				next.clear();
+				for(unsigned column = 0; column < columns; ) {
+					if(! dirty[(row * columns) + column]) {
+						++column;  continue;
+					}
+					unsigned first = column;
+					while((column < columns) && dirty[(row * columns) + column])  ++column;
+					unsigned x = first * tile;
+					unsigned y = row * tile;
+					Rect run = {
+						x, y,
+						((column * tile > width)? width : column * tile) - x,
+						((y + tile > height)? height : y + tile) - y };
+
+					bool merged = false;
+					for(Rect& o : open) {
+						if((o.x == run.x) && (o.width == run.width)) {
+							o.height += run.height;
+							next.push_back(o);
+							o.width = 0; // Taken
+							merged = true;
+							break;
+						}
+					}
+					if(! merged)  next.push_back(run);
+				}
+				for(const Rect& o : open)
+					if(o.width != 0)  r.push_back(o);
+				std::swap(open, next);
+			}
+			r.insert(r.end(), open.begin(), open.end());
+			return r;
+		}
+
+		constexpr unsigned int getWidth() const { return width; }
+		constexpr unsigned int getHeight() const { return height; }
+		constexpr unsigned int tileSize() const { return tile; }
+	};
+
+}
+
+#endif
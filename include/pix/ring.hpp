@@ -0,0 +1,105 @@
+#ifndef PIX_RING_HPP
+#define PIX_RING_HPP
+
+#include <vector>
+#include <cstddef>
+
+
+
+inline namespace pix {
+
+	/* A ring of persistently mapped buffers, for streaming uploads:
+	 * the producer writes into one slot while the GPU may still read
+	 * the previous ones, and only waits when it comes back to a slot
+	 * whose fence has not been signaled yet.
+	 * The graphics API is reached through (Backend), so that the
+	 * bookkeeping can be tested without a GPU; it provides
+	 *     using buffer_t = ...;  using fence_t = ...;
+	 *     buffer_t createBuffer(size_t bytes, void** mapping);
+	 *     void destroyBuffer(buffer_t);
+	 *     fence_t insertFence();              // after the slot's commands
+	 *     bool waitFence(fence_t);            // true if it had to block
+	 *     void deleteFence(fence_t);          */
+	template<typename Backend>
+	class BufferRing {
+	public:
+		using buffer_t = typename Backend::buffer_t;
+		using fence_t = typename Backend::fence_t;
+
+	protected:
+		struct Slot {
+			buffer_t buffer;
+			void* mapping;
+			fence_t fence;
+			bool fenced;
+		};
+
+		Backend& backend;
+		size_t bytes;
+		std::vector<Slot> slots;
+		size_t current;
+		size_t stalls;
+
+	public:
+		BufferRing(Backend& b, size_t slot_count, size_t slot_bytes):
+				backend (b),
+				bytes (slot_bytes),
+				slots (),
+				current (0),
+				stalls (0)
+		{
+			if(slot_count < 1)  slot_count = 1;
+			slots.reserve(slot_count);
+			for(size_t i=0; i < slot_count; ++i) {
+				Slot s = { };
+				s.buffer = backend.createBuffer(bytes, &s.mapping);
+				s.fenced = false;
+				slots.push_back(s);
+			}
+		}
+
+		BufferRing(const BufferRing&) = delete;
+
+		~BufferRing() {
+			for(Slot& s : slots) {
+				if(s.fenced)  backend.deleteFence(s.fence);
+				backend.destroyBuffer(s.buffer);
+			}
+		}
+
+		BufferRing& operator = (const BufferRing&) = delete;
+
+
+		/* Returns the mapping of the current slot, once the GPU
+		 * is done with its previous contents */
+		void* acquire() {
+			Slot& s = slots[current];
+			if(s.fenced) {
+				if(backend.waitFence(s.fence))  ++stalls;
+				backend.deleteFence(s.fence);
+				s.fenced = false;
+			}
+			return s.mapping;
+		}
+
+		/* Fences the commands issued from the current slot,
+		 * and moves on to the next one */
+		void submit() {
+			Slot& s = slots[current];
+			s.fence = backend.insertFence();
+			s.fenced = true;
+			current = (current + 1) % slots.size();
+		}
+
+		inline buffer_t buffer() const { return slots[current].buffer; }
+
+		inline size_t slotCount() const { return slots.size(); }
+		constexpr size_t slotBytes() const { return bytes; }
+
+		// How many times acquire had to wait for the GPU
+		constexpr size_t stallCount() const { return stalls; }
+	};
+
+}
+
+#endif
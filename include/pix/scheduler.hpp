@@ -0,0 +1,69 @@
+#ifndef PIX_SCHEDULER_HPP
+#define PIX_SCHEDULER_HPP
+
+#include <cstddef>
+
+
+
+inline namespace pix {
+
+	/* Paces a loop at a fixed frame interval, and measures the
+	 * phases each frame is made of, so that the work of a phase
+	 * can be sized to the time the other ones leave.
+	 * Phases are numbered in the order they run, and times are
+	 * seconds of any monotonic clock, passed by the caller:
+	 *     wait for waitTime(now), or until something happens;
+	 *     if(due(now)) {
+	 *         beginFrame(now);
+	 *         beginPhase(0, now);  ...  beginPhase(1, now);  ...
+	 *         endFrame(now);
+	 *     }
+	 * A frame that starts more than an interval late does not try
+	 * to catch up: the frames that were missed are skipped. */
+	class FrameScheduler {
+	public:
+		static constexpr unsigned MAX_PHASES = 8;
+
+	protected:
+		double interval;
+		double deadline; // The end of the current frame, and the start of the next
+		double phase_start;
+		unsigned phase; // MAX_PHASES outside of a phase
+		double estimates[MAX_PHASES]; // Moving averages, negative until measured
+		size_t frames;
+		size_t late;
+
+		void endPhase(double now);
+
+	public:
+		FrameScheduler(double interval_s, double now);
+
+		constexpr double frameInterval() const { return interval; }
+
+		// Seconds before the next frame is due
+		inline double waitTime(double now) const {
+			return (deadline > now)? deadline - now : 0.0; }
+
+		inline bool due(double now) const { return now >= deadline; }
+
+		void beginFrame(double now);
+		void beginPhase(unsigned phase, double now); // Ends the previous one
+		void endFrame(double now);
+
+		/* Seconds left before the end of the current frame, minus
+		 * the estimated duration of the phases after (phase) */
+		double timeLeft(unsigned phase, double now) const;
+
+		// The estimated duration of (phase), 0 if it never ran
+		inline double phaseTime(unsigned p) const {
+			return (estimates[p] > 0.0)? estimates[p] : 0.0; }
+
+		constexpr size_t frameCount() const { return frames; }
+
+		// How many frames ended after their deadline
+		constexpr size_t lateFrames() const { return late; }
+	};
+
+}
+
+#endif
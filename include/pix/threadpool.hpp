@@ -0,0 +1,74 @@
+#ifndef PIX_THREADPOOL_HPP
+#define PIX_THREADPOOL_HPP
+
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+
+
+inline namespace pix {
+
+	using task_func_t = void(*)(void* data, size_t index);
+
+
+	/* A persistent pool of threads, that runs batches of
+	 * independent tasks. Every participant starts with a contiguous
+	 * share of the batch; once its own share is exhausted, it steals
+	 * the second half of the biggest remaining one, so uneven tasks
+	 * do not leave threads idle at the end of a batch. */
+	class ThreadPool {
+	protected:
+		/* The tasks [begin, end) left to a participant:
+		 * the owner takes from the front, thieves from the back */
+		struct alignas(64) Queue {
+			std::mutex mutex;
+			size_t begin;
+			size_t end;
+		};
+
+		std::vector<std::thread> workers;
+		Queue* queues; // One per worker, then one for the calling thread
+
+		/* Current batch, published to the workers by
+		 * incrementing the generation */
+		std::mutex mutex;
+		std::mutex run_mutex;
+		std::condition_variable job_cond;
+		std::condition_variable done_cond;
+		size_t generation;
+		size_t done_count;
+		bool stopping;
+		void* job_data;
+		task_func_t job_func;
+
+		void work(size_t index);
+		void drain(size_t index);
+		bool steal(size_t index);
+
+	public:
+		/* (threads) counts the calling thread, which takes part
+		 * in every batch: a pool of 1 runs everything in place */
+		ThreadPool(size_t threads = std::thread::hardware_concurrency());
+		ThreadPool(const ThreadPool&) = delete;
+		~ThreadPool();
+
+		ThreadPool& operator = (const ThreadPool&) = delete;
+
+		/* Calls (func)(data, i) for every i in [0, count), from any
+		 * of the pool's threads, and returns once all of them are done.
+		 * The tasks must not throw; concurrent calls to run()
+		 * are serialized. */
+		void run(size_t count, void* data, task_func_t func);
+
+		inline size_t threadCount() const { return workers.size() + 1; }
+
+		// A pool with one thread per core, created on first use
+		static ThreadPool& shared();
+	};
+
+}
+
+#endif
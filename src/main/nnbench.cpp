@@ -0,0 +1,340 @@
+#include "nn/nn.hpp"
+#include "nn/kernels.hpp"
+#include "nn/trainer.hpp"
+#include "nn/precision.hpp"
+#include "nn/quantized.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <cmath> // ::fabs(...), ::tanh(...)
+
+
+
+namespace {
+
+	constexpr size_t GRID_SIZE = 128;
+	constexpr size_t TRAINING_ROWS = 20000;
+	constexpr size_t TRAINING_BATCH = 256;
+	constexpr double MIN_BENCH_S = 0.5;
+
+	double act_tanh(double x) { return ::tanh(x); }
+	double act_tanh_deriv(double x) { x = ::tanh(x);  return 1.0 - (x*x); }
+
+
+	/* Repeats the function until at least MIN_BENCH_S seconds
+	 * have passed, and returns the average time of a call */
+	template<typename Func>
+	double measure(Func f) {
+		using clock = std::chrono::steady_clock;
+		size_t runs = 0;
+		auto begin = clock::now();
+		std::chrono::duration<double> elapsed;
+		do {
+			f();
+			++runs;
+			elapsed = clock::now() - begin;
+		} while(elapsed.count() < MIN_BENCH_S);
+		return elapsed.count() / runs;
+	}
+
+	void report(const char* what, double seconds, double baseline) {
+		std::cout
+				<< std::setw(32) << std::left << what
+				<< std::setw(12) << std::right << std::fixed << std::setprecision(3)
+				<< (seconds * 1000.0) << " ms"
+				<< std::setw(10) << std::setprecision(2) << (baseline / seconds) << "x\n";
+	}
+
+
+	// Pixel coordinates of the decision surface, in [-1, 1)
+	std::vector<double> grid_inputs() {
+		std::vector<double> inputs;  inputs.reserve(GRID_SIZE * GRID_SIZE * 2);
+		for(size_t y=0; y < GRID_SIZE; ++y)
+		for(size_t x=0; x < GRID_SIZE; ++x) {
+			inputs.push_back((static_cast<double>(x) - (GRID_SIZE/2)) / (GRID_SIZE/2));
+			inputs.push_back((static_cast<double>(y) - (GRID_SIZE/2)) / (GRID_SIZE/2));
+		}
+		return inputs;
+	}
+
+
+	/* Evaluates the decision surface of a 2-32-16-1 stripe,
+	 * as nncli does for every frame */
+	void bench_surface() {
+		Stripe n = Stripe(2, { 32, 16 }, 1);
+		std::vector<double> inputs = grid_inputs();
+		std::vector<double> outputs = std::vector<double>(GRID_SIZE * GRID_SIZE);
+
+		std::cout << "Decision surface, " << GRID_SIZE << 'x' << GRID_SIZE << " rows\n";
+		double single = measure([&] () {
+			for(size_t i=0; i < GRID_SIZE * GRID_SIZE; ++i)
+				n.guess(act_tanh, inputs.data() + (i * 2), outputs.data() + i);
+		});
+		report("Stripe::guess", single, single);
+		double batch = measure([&] () {
+			n.guessBatch(act_tanh, inputs.data(), GRID_SIZE * GRID_SIZE, outputs.data());
+		});
+		report("Stripe::guessBatch", batch, single);
+
+		/* nncli evaluates the surface in many small batches (the
+		 * adaptive sampling's, or one per tile) with an inlined
+		 * policy: row-major layers are transposed for every batch,
+		 * column-major ones (as nncli's) are used in place */
+		constexpr size_t SMALL_BATCH = 16;
+		Stripe columns = Stripe(2, { 32, 16 }, 1, WeightLayout::COLUMN_MAJOR);
+		double rows = measure([&] () {
+			for(size_t i=0; i < GRID_SIZE * GRID_SIZE; i += SMALL_BATCH)
+				n.guessBatch(activation::Tanh(), inputs.data() + (i * 2), SMALL_BATCH, outputs.data() + i);
+		});
+		report("16-row batches (row-major)", rows, rows);
+		report("16-row batches (column-major)", measure([&] () {
+			for(size_t i=0; i < GRID_SIZE * GRID_SIZE; i += SMALL_BATCH)
+				columns.guessBatch(activation::Tanh(), inputs.data() + (i * 2), SMALL_BATCH, outputs.data() + i);
+		}), rows);
+	}
+
+
+	/* Compares the function-pointer API with the inlined policy,
+	 * for the evaluation of the decision surface and for training */
+	template<typename Activation>
+	void bench_activation(const char* name) {
+		activation_func act   = [] (double x) { return Activation()(x); };
+		activation_func deriv = [] (double x) { return Activation().derive(x); };
+		Stripe n = Stripe(2, { 32, 16 }, 1);
+		std::vector<double> inputs = grid_inputs();
+		std::vector<double> outputs = std::vector<double>(GRID_SIZE * GRID_SIZE);
+		DataMatrix data = DataMatrix(2, 1, GRID_SIZE * GRID_SIZE);
+		for(size_t i=0; i < GRID_SIZE * GRID_SIZE; ++i) {
+			const double* in = inputs.data() + (i * 2);
+			double out = (in[0] * in[1] > 0.0)? 1.0 : -1.0;
+			data.append(in, &out);
+		}
+
+		std::cout << '\n' << name << '\n';
+		double pointer = measure([&] () {
+			n.guessBatch(act, inputs.data(), GRID_SIZE * GRID_SIZE, outputs.data());
+		});
+		report("guessBatch (pointer)", pointer, pointer);
+		double inlined = measure([&] () {
+			n.guessBatch(Activation(), inputs.data(), GRID_SIZE * GRID_SIZE, outputs.data());
+		});
+		report("guessBatch (inlined)", inlined, pointer);
+		pointer = measure([&] () { n.train(act, deriv, data, -1, 0.001); });
+		report("train (pointer)", pointer, pointer);
+		inlined = measure([&] () { n.train(Activation(), data, -1, 0.001); });
+		report("train (inlined)", inlined, pointer);
+	}
+
+
+	/* Compares the approximations with libm, on their own
+	 * and inside the layers, for every accuracy tier */
+	void bench_approximations() {
+		using activation::Accuracy;
+		constexpr Accuracy tiers[] = { Accuracy::PRECISE, Accuracy::FAST, Accuracy::FASTEST };
+		constexpr const char* tier_names[] = { "precise", "fast", "fastest" };
+		std::vector<double> x = grid_inputs();
+		std::vector<double> y = std::vector<double>(x.size());
+
+		std::cout << "\nApproximations, " << x.size() << " values\n";
+		double libm = measure([&] () {
+			for(size_t i=0; i < x.size(); ++i)
+				y[i] = ::tanh(x[i] * 4.0);
+		});
+		report("::tanh", libm, libm);
+		for(size_t t=0; t < 3; ++t) {
+			std::string what = std::string("activation::tanh (") + tier_names[t] + ")";
+			report(what.c_str(), measure([&] () {
+				activation::tanh(x.data(), y.data(), x.size(), tiers[t]);
+			}), libm);
+		}
+
+		Stripe n = Stripe(2, { 32, 16 }, 1);
+		std::vector<double> outputs = std::vector<double>(GRID_SIZE * GRID_SIZE);
+		double exact = measure([&] () {
+			n.guessBatch(activation::Tanh(), x.data(), GRID_SIZE * GRID_SIZE, outputs.data());
+		});
+		report("guessBatch (Tanh)", exact, exact);
+		for(size_t t=0; t < 3; ++t) {
+			std::string what = std::string("guessBatch (FastTanh, ") + tier_names[t] + ")";
+			activation::FastTanh fast = activation::FastTanh(tiers[t]);
+			report(what.c_str(), measure([&] () {
+				n.guessBatch(fast, x.data(), GRID_SIZE * GRID_SIZE, outputs.data());
+			}), exact);
+		}
+
+		DataMatrix data = DataMatrix(2, 1, GRID_SIZE * GRID_SIZE);
+		for(size_t i=0; i < GRID_SIZE * GRID_SIZE; ++i) {
+			double out = (x[i*2] * x[(i*2) + 1] > 0.0)? 1.0 : -1.0;
+			data.append(x.data() + (i*2), &out);
+		}
+		/* Both derive from the cached outputs (1 - y^2), the approximation
+		 * along with its outputs: the same gradient, computed faster */
+		exact = measure([&] () { n.train(activation::Tanh(), data, -1, 0.001); });
+		report("train (Tanh)", exact, exact);
+		report("train (FastTanh, fast)", measure([&] () {
+			n.train(activation::FastTanh(), data, -1, 0.001);
+		}), exact);
+	}
+
+
+	/* Accuracy against speed: the decision surface and a training
+	 * epoch, for every weight type of TypedStripe, against Stripe */
+	template<typename Weight>
+	void bench_weight_type(
+			const char* name, const Stripe& baseline,
+			const std::vector<double>& inputs, const std::vector<double>& expected,
+			double baseline_time
+	) {
+		using Scalar = typename TypedStripe<Weight>::Scalar;
+		TypedStripe<Weight> typed = TypedStripe<Weight>(baseline);
+		std::vector<Scalar> typed_inputs = std::vector<Scalar>(inputs.begin(), inputs.end());
+		std::vector<Scalar> outputs = std::vector<Scalar>(expected.size());
+		double time = measure([&] () {
+			typed.guessBatch(activation::FastTanh(), typed_inputs.data(), outputs.size(), outputs.data());
+		});
+		double worst = 0.0;
+		for(size_t i=0; i < outputs.size(); ++i)
+			worst = std::max(worst, std::fabs(expected[i] - outputs[i]));
+		std::string what = std::string("guessBatch (") + name + ")";
+		report(what.c_str(), time, baseline_time);
+		std::cout << std::setw(32) << "" << "  max. error " << std::scientific << std::setprecision(1)
+		          << worst << std::fixed << '\n';
+	}
+
+	void bench_precision() {
+		Stripe n = Stripe(2, { 32, 16 }, 1);
+		std::vector<double> inputs = grid_inputs();
+		std::vector<double> expected = std::vector<double>(GRID_SIZE * GRID_SIZE);
+
+		std::cout << "\nPrecision, " << GRID_SIZE << 'x' << GRID_SIZE << " rows\n";
+		double baseline = measure([&] () {
+			n.guessBatch(activation::FastTanh(), inputs.data(), expected.size(), expected.data());
+		});
+		report("guessBatch (Stripe)", baseline, baseline);
+		bench_weight_type<double>("double", n, inputs, expected, baseline);
+		bench_weight_type<float>("float", n, inputs, expected, baseline);
+		bench_weight_type<precision::fp16>("fp16", n, inputs, expected, baseline);
+		bench_weight_type<precision::bf16>("bf16", n, inputs, expected, baseline);
+
+		std::vector<float> inputs_f = std::vector<float>(inputs.begin(), inputs.end());
+		std::vector<double> targets;
+		std::vector<float> targets_f;
+		for(size_t i=0; i < GRID_SIZE * GRID_SIZE; ++i) {
+			targets.push_back((inputs[i*2] * inputs[(i*2) + 1] > 0.0)? 1.0 : -1.0);
+			targets_f.push_back(targets.back());
+		}
+		TypedStripe<double> typed_double = TypedStripe<double>(n);
+		TypedStripe<float> typed = TypedStripe<float>(n);
+		baseline = measure([&] () {
+			for(size_t i=0; i < targets.size(); ++i)
+				n.train(activation::FastTanh(), inputs.data() + (i*2), &targets[i], 0.001);
+		});
+		report("train (Stripe)", baseline, baseline);
+		/* Against the same TypedStripe in double,
+		 * only the width of the weights differs */
+		report("train (double)", measure([&] () {
+			for(size_t i=0; i < targets.size(); ++i)
+				typed_double.train(activation::FastTanh(), inputs.data() + (i*2), &targets[i], 0.001);
+		}), baseline);
+		report("train (float)", measure([&] () {
+			for(size_t i=0; i < targets.size(); ++i)
+				typed.train(activation::FastTanh(), inputs_f.data() + (i*2), &targets_f[i], 0.001f);
+		}), baseline);
+	}
+
+	/* The decision surface of a wider network, with 8-bit weights
+	 * against float and double ones; also reports the memory taken */
+	void bench_quantized() {
+		Stripe n = Stripe(2, { 128, 128 }, 1);
+		std::vector<double> inputs = grid_inputs();
+		std::vector<float> inputs_f = std::vector<float>(inputs.begin(), inputs.end());
+		std::vector<double> expected = std::vector<double>(GRID_SIZE * GRID_SIZE);
+		std::vector<float> outputs = std::vector<float>(expected.size());
+		auto act = activation::FastTanh();
+
+		std::cout << "\nQuantization, " << GRID_SIZE << 'x' << GRID_SIZE << " rows\n";
+		double baseline = measure([&] () {
+			n.guessBatch(act, inputs.data(), expected.size(), expected.data());
+		});
+		report("guessBatch (Stripe)", baseline, baseline);
+		TypedStripe<float> typed = TypedStripe<float>(n);
+		report("guessBatch (float)", measure([&] () {
+			typed.guessBatch(act, inputs_f.data(), outputs.size(), outputs.data());
+		}), baseline);
+		QuantizedStripe quantized = QuantizedStripe(n);
+		report("guessBatch (int8)", measure([&] () {
+			quantized.guessBatch(act, inputs_f.data(), outputs.size(), outputs.data());
+		}), baseline);
+
+		double worst = 0.0;
+		for(size_t i=0; i < outputs.size(); ++i)
+			worst = std::max(worst, std::fabs(expected[i] - outputs[i]));
+		size_t double_bytes = 0;
+		for(size_t i=0; i < n.neurodeCount(); ++i)
+			double_bytes += (n[i].inputSize() + 1) * n[i].outputSize() * sizeof(double);
+		std::cout << std::setw(32) << "" << "  max. error " << std::scientific << std::setprecision(1)
+		          << worst << std::fixed << '\n'
+		          << std::setw(32) << "" << "  " << quantized.weightBytes() << " bytes of weights, "
+		          << double_bytes << " as double\n";
+	}
+
+
+	/* Reports the training throughput of ParallelTrainer for
+	 * increasing thread counts; the efficiency is the speedup
+	 * over one thread, divided by the number of threads */
+	void bench_scaling(ParallelTrainer::Mode mode, const char* mode_name) {
+		DataSet ds;  ds.reserve(TRAINING_ROWS);
+		for(size_t i=0; i < TRAINING_ROWS; ++i) {
+			double x = nn::random();
+			double y = nn::random();
+			ds.push_back(DataRow { { x, y }, { (x * y > 0.0)? 1.0 : -1.0 } });
+		}
+
+		size_t max_threads = std::thread::hardware_concurrency();
+		if(max_threads < 1)  max_threads = 1;
+
+		std::cout << "\nParallelTrainer (" << mode_name << "), "
+		          << TRAINING_ROWS << " rows, batches of " << TRAINING_BATCH << '\n';
+		std::vector<size_t> thread_counts;
+		for(size_t threads = 1; threads < max_threads; threads *= 2)
+			thread_counts.push_back(threads);
+		thread_counts.push_back(max_threads);
+
+		double single = 0.0;
+		for(size_t threads : thread_counts) {
+			Stripe n = Stripe(2, { 32, 16 }, 1);
+			ParallelTrainer trainer = ParallelTrainer(n, act_tanh, act_tanh_deriv, threads, mode);
+			double epoch = measure([&] () { trainer.epoch(ds, 0.01, TRAINING_BATCH); });
+			if(threads == 1)  single = epoch;
+			std::cout
+					<< std::setw(4) << std::right << threads << " thread(s)"
+					<< std::setw(14) << std::fixed << std::setprecision(0)
+					<< (TRAINING_ROWS / epoch) << " rows/s"
+					<< std::setw(10) << std::setprecision(2) << (single / epoch) << "x"
+					<< std::setw(10) << std::setprecision(1)
+					<< (100.0 * single / (epoch * threads)) << "% efficiency\n";
+		}
+	}
+
+}
+
+
+
+int main(int argn, char** args) {
+	std::cout << "Kernels: " << kernel::name(kernel::instruction_set()) << "\n\n";
+	bench_surface();
+	bench_activation<activation::Tanh>("Tanh");
+	bench_activation<activation::Logistic>("Logistic");
+	bench_activation<activation::Relu>("Relu");
+	bench_activation<activation::Sign>("Sign");
+	bench_approximations();
+	bench_precision();
+	bench_quantized();
+	bench_scaling(ParallelTrainer::Mode::SYNCHRONOUS, "synchronous");
+	bench_scaling(ParallelTrainer::Mode::HOGWILD, "Hogwild");
+	return EXIT_SUCCESS;
+}
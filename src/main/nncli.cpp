@@ -1,13 +1,21 @@
 #include "nn/nn.hpp"
+#include "nn/queue.hpp"
+#include "nn/snapshot.hpp"
 #include "pix/pix.hpp"
+#include "pix/frame.hpp"
+#include "pix/refine.hpp"
+#include "pix/adaptive.hpp"
+#include "pix/scheduler.hpp"
 
 #include <iostream>
 #include <chrono>
+#include <string>
 
 #include <queue>
 
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 
 #include <cmath> // ::exp(...), ::tanh(...)
@@ -17,10 +25,15 @@
 constexpr int BOX_SIZE = 128;
 constexpr int TRAINING_SIZE = (BOX_SIZE < 128)? BOX_SIZE : 128;
 constexpr double CLICK_REPEAT_S = 0.125;
-constexpr double GRANULARITY = 16;
+constexpr unsigned GRANULARITY = 16; // Frames between two computations of a pixel
 constexpr double FRAME_INTERVAL_S = 1.0 / 60.0;
+constexpr double FRAME_MARGIN_S = FRAME_INTERVAL_S / 8.0; // Kept free of surface computations
 constexpr double PRINT_INTERVAL_S = 0.5;
 constexpr double DEF_LEARNING_RATE = 0.00001;
+constexpr size_t QUEUE_CAPACITY = 1024;
+constexpr unsigned HEADLESS_FRAMES = 60;
+constexpr unsigned HEADLESS_EPOCHS_PER_FRAME = 4;
+constexpr double HEADLESS_LEARNING_RATE = 0.001;
 
 
 
@@ -80,44 +93,112 @@ namespace {
 	}
 
 
+	/* Changes to the training data, sent from the UI thread
+	 * to the trainer's own copy of the data set */
+	struct DataEvent {
+		enum class Type { PUSH, POP, CLEAR } type;
+		DataRow row;
+	};
+
+	using DataQueue = SpscQueue<DataEvent>;
+
+
 	class Trainer {
 	protected:
+		/* Wakes the worker up when it has no data to train on */
+		struct Idle {
+			std::mutex mutex;
+			std::condition_variable cond;
+		};
+
 		Stripe* n;
-		DataSet* ds;
-		double rate;
-		std::thread worker;
+		StripeSnapshot* snapshot;
+		DataSet ds;
+		DataQueue queue;
+		std::queue<DataEvent> backlog; // Events that did not fit in the queue
+		std::atomic<double> rate; // Set by the window's thread, read by the worker
+		std::atomic<bool> stopping;
+		Idle idle;
 		std::mutex mutex;
+		std::thread worker; // Last, as it uses the other members as soon as it starts
+
+		static void apply_event(DataSet& ds, DataEvent& event) {
+			switch(event.type) {
+				case DataEvent::Type::PUSH:   ds.push_back(std::move(event.row));  break;
+				case DataEvent::Type::POP:    if(! ds.empty())  ds.pop_back();     break;
+				case DataEvent::Type::CLEAR:  ds.clear();                          break;
+			}
+		}
 
 		static void worker_func(
-				Stripe** n, DataSet** ds,
+				Stripe* n, StripeSnapshot* snapshot,
+				DataSet* ds, DataQueue* queue,
 				activation_func act,
 				activation_func_deriv deriv,
-				double* rate,
+				std::atomic<double>* rate,
+				std::atomic<bool>* stopping,
+				Idle* idle,
 				std::mutex* mutex
 		) {
-			bool die = false;
-			do {
+			bool dirty = false; // Trained since the last snapshot
+			DataEvent event;
+			while(! stopping->load()) {
+				/* New data is drained between training steps, and
+				 * never waits for the lock */
+				while(queue->pop(event))
+					apply_event(*ds, event);
+
+				if(ds->empty()) {
+					if(dirty) {
+						auto lock = std::unique_lock<std::mutex>(*mutex);
+						snapshot->publish(*n);
+						dirty = false;
+					}
+					/* Sleeps until an event is sent, or stop() is called */
+					auto idle_lock = std::unique_lock<std::mutex>(idle->mutex);
+					idle->cond.wait(idle_lock, [stopping, queue] () {
+						return stopping->load() || ! queue->empty(); });
+					continue;
+				}
+
 				auto lock = std::unique_lock<std::mutex>(*mutex);
-				if(*n == nullptr) {
-					die = true;
-				} else {
-					int random = std::rand();
-					if(random < 0)  random = -random;
-					(*n)->train(act, deriv, **ds, random, *rate);
+				int random = std::rand();
+				if(random < 0)  random = -random;
+				n->train(act, deriv, *ds, random, rate->load());
+				dirty = true;
+
+				/* A new snapshot is only copied once the renderer
+				 * has taken the previous one */
+				if(! snapshot->pending()) {
+					snapshot->publish(*n);
+					dirty = false;
 				}
-			} while(! die);
+			}
+		}
+
+		/* Locking the mutex before notifying ensures that the worker
+		 * is either waiting, or yet to check its condition */
+		void wake() {
+			{ auto lock = std::unique_lock<std::mutex>(idle.mutex); }
+			idle.cond.notify_one();
 		}
 
 	public:
 		Trainer(
-				Stripe* neurode, DataSet* dataset,
+				Stripe* neurode, StripeSnapshot* snap,
 				activation_func activate, activation_func_deriv derivate,
 				double learning_rate
 		):
 				n (neurode),
-				ds (dataset),
+				snapshot (snap),
+				ds (),
+				queue (QUEUE_CAPACITY),
 				rate (learning_rate),
-				worker (worker_func, &n, &ds, activate, derivate, &rate, &mutex)
+				stopping (false),
+				idle (),
+				worker (
+					worker_func, n, snapshot, &ds, &queue, activate, derivate,
+					&rate, &stopping, &idle, &mutex)
 		{ }
 
 		~Trainer() { stop(); }
@@ -126,12 +207,35 @@ namespace {
 			return std::unique_lock<std::mutex>(mutex);
 		}
 
-		inline double getLearningRate() const { return rate; }
-		inline void setLearningRate(double value) { rate = value; }
+		/* Sends an event to the worker thread, without blocking;
+		 * events are kept in order, even if the queue is full */
+		void submit(DataEvent event) {
+			flush();
+			if(! backlog.empty() || ! queue.push(std::move(event)))
+				backlog.push(std::move(event));
+			wake();
+		}
+
+		/* Retries sending the events that did not fit in the queue */
+		void flush() {
+			bool sent = false;
+			while(! backlog.empty() && queue.push(std::move(backlog.front()))) {
+				backlog.pop();
+				sent = true;
+			}
+			if(sent)  wake();
+		}
+
+		inline double getLearningRate() const { return rate.load(); }
+		inline void setLearningRate(double value) { rate.store(value); }
 
 		void stop() {
-			if(n != nullptr) {
-				n = nullptr;
+			if(worker.joinable()) {
+				{
+					auto lock = std::unique_lock<std::mutex>(idle.mutex);
+					stopping.store(true);
+				}
+				idle.cond.notify_one();
 				worker.join();
 			}
 		}
@@ -154,7 +258,7 @@ namespace {
 	enum class Action {
 		NONE, RESET, REGEN, RATE_UP, RATE_DOWN,
 		GRAN_UP, GRAN_DOWN, QUIT, SHOW_TRAINING,
-		SHOW_DERIVS, UNDO
+		SHOW_DERIVS, UNDO, ADAPTIVE, STATS
 	};
 
 	struct Click {
@@ -184,6 +288,8 @@ namespace {
 				case GLFW_KEY_END:        stored_action = Action::GRAN_DOWN;      break;
 				case GLFW_KEY_ESCAPE:     stored_action = Action::QUIT;           break;
 				case GLFW_KEY_DELETE:     stored_action = Action::UNDO;           break;
+				case GLFW_KEY_A:          stored_action = Action::ADAPTIVE;       break;
+				case GLFW_KEY_F:          stored_action = Action::STATS;          break;
 			}
 		}
 	}
@@ -194,48 +300,190 @@ namespace {
 		clicks.push(Click{ window, x, y, button, action, mods });
 	}
 
+	bool refresh_requested = true;
+
+	void refresh_callback(GLFWwindow*) {
+		refresh_requested = true;
+	}
+
+
+	/* The phases of a frame, in order */
+	enum Phase : unsigned {
+		PHASE_EVENTS, PHASE_SNAPSHOT, PHASE_SURFACE, PHASE_UPLOAD, PHASE_DRAW,
+		PHASE_COUNT
+	};
+
+	constexpr const char* PHASE_NAMES[PHASE_COUNT] = {
+		"events", "snapshot", "surface", "upload", "draw" };
+
 }
 
 
 
-void poll_nn(Stripe n, pix::AsyncBox& box, activation_func act, size_t pix_throughput) {
-	struct pack {
-		Stripe& n;
-		activation_func act;
-		size_t pix_throughput;
-		pix::AsyncBox& box;
-	} packed = pack { n, act, pix_throughput, box };
-	/*box.computePixels([] (unsigned x, unsigned y) {
-		if((x == 0 && y == 0)
-		|| (x == 3 && y == 3)
-		|| (x == 4 && y == 4)) return glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
-		else return glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
-	});*/
-	box.computePixels(&packed, [] (void* packed, unsigned x, unsigned y) -> glm::vec4 {
-		double inputs[2] = {
-			(static_cast<double>(x) - (BOX_SIZE/2)) / (BOX_SIZE/2),
-			(static_cast<double>(y) - (BOX_SIZE/2)) / (BOX_SIZE/2)
-		};
-		pack* unpacked = reinterpret_cast<pack*>(packed);
-		if(
-				(unpacked->pix_throughput == 0) ||
-				(::rand() % (unpacked->pix_throughput) == 0)
-		) {
-			double dguess;
-			unpacked->n.guess(unpacked->act, inputs, &dguess);
-			float guess = dguess;
-			if(guess >  1.0f)  guess =  1.0f;
-			else
-			if(guess < -1.0f)  guess = -1.0f;
-			if(guess > 0.0f) {
-				return glm::vec4(1.0f, 0.6f, 0.0f, guess);
-			} else {
-				return glm::vec4(0.0f, 0.6f, 1.0f, -guess);
+glm::vec4 guess_color(double dguess) {
+	float guess = dguess;
+	if(guess >  1.0f)  guess =  1.0f;
+	else
+	if(guess < -1.0f)  guess = -1.0f;
+	if(guess > 0.0f) {
+		return glm::vec4(1.0f, 0.6f, 0.0f, guess);
+	} else {
+		return glm::vec4(0.0f, 0.6f, 1.0f, -guess);
+	}
+}
+
+
+constexpr unsigned POLL_TILE_SIZE = 32;
+
+/* Tiles are either computed a few refinement passes at a time,
+ * or entirely, with an adaptive sampler; they are computed by the
+ * shared thread pool, so only the count of evaluations is shared */
+template<typename Activation>
+struct PollTiles {
+	const Stripe& n;
+	const Activation& act;
+	const pix::Refinement* refinement;
+	const pix::AdaptiveSampler* sampler;
+	std::atomic<size_t> evaluations;
+};
+
+struct PollScratch {
+	std::vector<unsigned> coords;
+	std::vector<double> inputs;
+	std::vector<double> guesses;
+};
+
+thread_local PollScratch poll_scratch;
+
+inline void write_color(const pix::Tile& tile, unsigned x, unsigned y, double guess) {
+	glm::vec4 color = guess_color(guess);
+	float* ptr = tile.pixels + (y * tile.stride) + (4 * x);
+	ptr[0] = color[0];
+	ptr[1] = color[1];
+	ptr[2] = color[2];
+	ptr[3] = color[3];
+}
+
+template<typename Activation>
+void poll_field(void* data, const unsigned* coords, size_t count, double* values) {
+	auto& poll = *static_cast<PollTiles<Activation>*>(data);
+	std::vector<double>& inputs = poll_scratch.inputs;
+	inputs.resize(2 * count);
+	for(size_t i=0; i < 2 * count; ++i)
+		inputs[i] = (static_cast<double>(coords[i]) - (BOX_SIZE/2)) / (BOX_SIZE/2);
+	poll.n.guessBatch(poll.act, inputs.data(), count, values);
+	poll.evaluations += count;
+}
+
+/* The network's outputs are sampled adaptively, and the
+ * ones between the evaluated pixels interpolated */
+template<typename Activation>
+void poll_tile_adaptive(void* data, const pix::Tile& tile) {
+	auto& poll = *static_cast<PollTiles<Activation>*>(data);
+	std::vector<double>& guesses = poll_scratch.guesses;
+	guesses.resize(static_cast<size_t>(tile.width) * tile.height);
+	pix::Rect area = { tile.x, tile.y, tile.width, tile.height };
+	poll.sampler->sample(area, &poll, poll_field<Activation>, guesses.data());
+	for(unsigned y=0; y < tile.height; ++y)
+		for(unsigned x=0; x < tile.width; ++x)
+			write_color(tile, x, y, guesses[(y * tile.width) + x]);
+}
+
+/* The pixels of the tile to recompute are gathered first,
+ * then the network evaluates all of them as a single batch */
+template<typename Activation>
+void poll_tile(void* data, const pix::Tile& tile) {
+	auto& poll = *static_cast<PollTiles<Activation>*>(data);
+	std::vector<unsigned>& coords = poll_scratch.coords;
+	std::vector<double>& inputs = poll_scratch.inputs;
+	std::vector<double>& guesses = poll_scratch.guesses;
+	coords.clear();
+	inputs.clear();
+	for(unsigned y=0; y < tile.height; ++y) {
+		for(unsigned x=0; x < tile.width; ++x) {
+			if(poll.refinement->computes(tile.x + x, tile.y + y)) {
+				coords.push_back(x);
+				coords.push_back(y);
+				inputs.push_back((static_cast<double>(tile.x + x) - (BOX_SIZE/2)) / (BOX_SIZE/2));
+				inputs.push_back((static_cast<double>(tile.y + y) - (BOX_SIZE/2)) / (BOX_SIZE/2));
 			}
-		} else {
-			return unpacked->box.getPixel(x, y);
 		}
-	});
+	}
+
+	guesses.resize(coords.size() / 2);
+	poll.n.guessBatch(poll.act, inputs.data(), guesses.size(), guesses.data());
+	poll.evaluations += guesses.size();
+	for(size_t i=0; i < guesses.size(); ++i)
+		write_color(tile, coords[2*i], coords[(2*i)+1], guesses[i]);
+	poll.refinement->fillTile(tile);
+}
+
+/* (Target) is either a window's AsyncBox or a headless Canvas;
+ * the tiles start on multiples of the refinement's blocks, as
+ * POLL_TILE_SIZE is a multiple of any of them.
+ * Returns how many pixels the network evaluated. */
+template<typename Target, typename Activation>
+size_t poll_nn(
+		const Stripe& n, Target& box, const Activation& act,
+		const pix::Refinement* refinement, const pix::AdaptiveSampler* sampler
+) {
+	PollTiles<Activation> poll = { n, act, refinement, sampler, { 0 } };
+	pix::ThreadPool& pool = pix::ThreadPool::shared();
+	if(sampler != nullptr) {
+		box.computeTiles(&poll, poll_tile_adaptive<Activation>, pool, POLL_TILE_SIZE);
+	} else {
+		box.computeTiles(&poll, poll_tile<Activation>, pool, POLL_TILE_SIZE);
+	}
+	return poll.evaluations.load();
+}
+
+/* The surface uses the vectorized tanh, which is visually
+ * indistinguishable from the one used for training */
+template<typename Target>
+size_t poll_nn(
+		const Stripe& n, Target& box, bool show_derivs,
+		const pix::Refinement* refinement, const pix::AdaptiveSampler* sampler
+) {
+	if(show_derivs) {
+		return poll_nn(n, box, activation::Function(act_tanh_deriv), refinement, sampler);
+	} else {
+		return poll_nn(n, box, activation::FastTanh(), refinement, sampler);
+	}
+}
+
+/* Computes as many of the refinement's passes as (budget_s) allows */
+template<typename Target>
+size_t poll_nn(const Stripe& n, Target& box, bool show_derivs, pix::Refinement& refinement, double budget_s) {
+	static_assert(POLL_TILE_SIZE * POLL_TILE_SIZE >= pix::Refinement::MAX_PASSES, "Tiles must align with refinement blocks");
+	auto begin = std::chrono::steady_clock::now();
+	refinement.beginFrame(budget_s);
+	size_t evaluations = poll_nn(n, box, show_derivs, &refinement, nullptr);
+	refinement.endFrame(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+	return evaluations;
+}
+
+/* Computes the whole surface, evaluating the network mostly
+ * near the decision boundary */
+template<typename Target>
+size_t poll_nn(const Stripe& n, Target& box, bool show_derivs, const pix::AdaptiveSampler& sampler) {
+	return poll_nn(n, box, show_derivs, nullptr, &sampler);
+}
+
+template<typename Target>
+void draw_training(Target& box, const DataSet& ds) {
+	/* Inputs of exactly 1.0 are drawn on the last row (or column);
+	 * points outside of the canvas are not drawn */
+	for(const DataRow& r : ds) {
+		double x = (r.inputs[0] * (BOX_SIZE/2.0)) + (BOX_SIZE/2.0);
+		double y = (r.inputs[1] * (BOX_SIZE/2.0)) + (BOX_SIZE/2.0);
+		if(! ((x >= 0.0) && (x <= BOX_SIZE) && (y >= 0.0) && (y <= BOX_SIZE)))
+			continue;
+		box.setPixel(
+			(x < BOX_SIZE)? static_cast<unsigned>(x) : (BOX_SIZE - 1),
+			(y < BOX_SIZE)? static_cast<unsigned>(y) : (BOX_SIZE - 1),
+			glm::vec4(r.outputs[0], 0.0f, -r.outputs[0], 1.0f)
+		);
+	}
 }
 
 
@@ -258,8 +506,9 @@ void add_point(
 		}
 		if(0 != (mod & GLFW_MOD_SHIFT))  put_value /= 2.0;
 		if((button == GLFW_MOUSE_BUTTON_MIDDLE) || (put_value != 0.0)) {
-			auto t_lock = trainer.acquireLock();
-			dataset.push_back({{ x, y }, { put_value }});
+			DataRow row = {{ x, y }, { put_value }};
+			dataset.push_back(row);
+			trainer.submit(DataEvent { DataEvent::Type::PUSH, std::move(row) });
 		}
 	}
 }
@@ -284,8 +533,72 @@ void process_clicks(
 }
 
 
+/* Trains on generated data without a window, writing the decision
+ * surface of every frame with a FrameWriter: the pixels go through
+ * the same tiles as the window's, but only the CPU is involved */
+int run_headless(pix::FrameFormat format, const std::string& path, unsigned frames, bool adaptive) {
+	using clock = std::chrono::steady_clock;
+	using seconds = std::chrono::duration<double>;
+
+	Stripe n = Stripe(2, { 32, 16 }, 1, WeightLayout::COLUMN_MAJOR);
+	DataSet ds = gen_data(TRAINING_SIZE);
+	Gradient gradient = Gradient(n);
+	pix::Canvas canvas = pix::Canvas(BOX_SIZE);
+	pix::Refinement every_pixel = pix::Refinement(1);
+	pix::AdaptiveSampler sampler;
+	size_t evaluations = 0;
+	seconds train_time = seconds(0), render_time = seconds(0), write_time = seconds(0);
+
+	try {
+		pix::FrameWriter writer = pix::FrameWriter(path, format);
+		for(unsigned frame=0; frame < frames; ++frame) {
+			auto t0 = clock::now();
+			for(unsigned i=0; i < HEADLESS_EPOCHS_PER_FRAME; ++i)
+				n.train(act_tanh, act_tanh_deriv, ds, -1, HEADLESS_LEARNING_RATE, 1, gradient);
+			auto t1 = clock::now();
+			evaluations += adaptive?
+				poll_nn(n, canvas, false, sampler) :
+				poll_nn(n, canvas, false, every_pixel, 0.0);
+			draw_training(canvas, ds);
+			auto t2 = clock::now();
+			writer.write(canvas);
+			auto t3 = clock::now();
+			train_time += t1 - t0;
+			render_time += t2 - t1;
+			write_time += t3 - t2;
+		}
+	} catch(pix::FrameException& ex) {
+		std::cerr << ex.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	/* The standard output may be the frame stream */
+	std::cerr
+		<< frames << " frames of " << BOX_SIZE << 'x' << BOX_SIZE << ": "
+		<< "training " << (train_time.count() * 1000.0 / frames) << " ms, "
+		<< "rendering " << (render_time.count() * 1000.0 / frames) << " ms, "
+		<< "writing " << (write_time.count() * 1000.0 / frames) << " ms per frame; "
+		<< (evaluations / frames) << " pixels evaluated per frame"
+		<< std::endl;
+	return EXIT_SUCCESS;
+}
+
+
 int main(int argn, char** args) {
-	Stripe n = Stripe(2, { 32, 16 }, 1);
+	if((argn > 1) && (std::string(args[1]) == "--headless")) {
+		pix::FrameFormat format;
+		if((argn < 4) || ! pix::parse_frame_format(args[2], &format)) {
+			std::cerr << "Usage: " << args[0] << " --headless <png|ppm|raw> <path> [frames [adaptive]]" << std::endl;
+			return EXIT_FAILURE;
+		}
+		unsigned frames = (argn > 4)? std::strtoul(args[4], nullptr, 10) : HEADLESS_FRAMES;
+		bool adaptive = (argn > 5) && (std::string(args[5]) == "adaptive");
+		return run_headless(format, args[3], (frames > 0)? frames : 1, adaptive);
+	}
+
+	/* Column-major, so that every tile's guessBatch
+	 * uses the weights in place, without transposing them */
+	Stripe n = Stripe(2, { 32, 16 }, 1, WeightLayout::COLUMN_MAJOR);
 	//DataSet ds = gen_data(TRAINING_SIZE);
 	DataSet ds;
 
@@ -293,91 +606,150 @@ int main(int argn, char** args) {
 	pix::Window* window = new pix::Window(650, 650, "Pixnn");
 	gla::ShaderProgram& shader = pix::get_shader();
 	pix::AsyncBox frame = pix::AsyncBox(shader, BOX_SIZE, BOX_SIZE);
-	Trainer trainer = Trainer(&n, &ds, act_tanh, act_tanh_deriv, DEF_LEARNING_RATE);
+	StripeSnapshot snapshot = StripeSnapshot(n);
+	Trainer trainer = Trainer(&n, &snapshot, act_tanh, act_tanh_deriv, DEF_LEARNING_RATE);
 
 	bool show_training = true;
 	bool show_derivs = false;
+	bool adaptive = false;
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 
-	double last_time = 0.0;
 	double time = 0.0;
-	size_t granularity = GRANULARITY;
+	pix::Refinement refinement = pix::Refinement(GRANULARITY);
+	pix::AdaptiveSampler sampler;
 	glfwSetTime(time);
+	pix::FrameScheduler scheduler = pix::FrameScheduler(FRAME_INTERVAL_S, glfwGetTime());
+	size_t drawn_epoch = 0;
+	int last_width = 0, last_height = 0;
 
 	glfwSetKeyCallback(*window, key_callback);
 	glfwSetMouseButtonCallback(*window, mouse_button_callback);
+	glfwSetWindowRefreshCallback(*window, refresh_callback);
 
-	poll_nn(n, frame, show_derivs? act_tanh_deriv : act_tanh, 0);
-
+	/* The loop sleeps until the next frame is due, or until an event
+	 * arrives; frames where nothing changed compute, upload and draw
+	 * nothing, and the surface uses the time the other phases leave */
 	while(! window->shouldClose()) {
+		window->waitEvents(scheduler.waitTime(glfwGetTime()));
 		time = glfwGetTime();
-		if((time - last_time) > FRAME_INTERVAL_S) {
-			last_time = time;
-
-			int win_width, win_height;
-			glfwGetFramebufferSize(*window, &win_width, &win_height);
-			glViewport(0, 0, win_width, win_height);
-			window->pollEvents();
-			process_clicks(trainer, ds, win_width, win_height, time);
-
-			if(mouse_pressed) {
-				if(mouse_pressed_last + CLICK_REPEAT_S < time) {
-					mouse_pressed_last = time;
-					double x, y;
-					glfwGetCursorPos(*window, &x, &y);
-					add_point(
-							x, y, last_click.button, last_click.mods,
-							trainer, ds, win_width, win_height);
-				}
+		if(! scheduler.due(time))  continue;
+		scheduler.beginFrame(time);
+
+		scheduler.beginPhase(PHASE_EVENTS, time);
+		bool changed = (stored_action != Action::NONE) || ! clicks.empty();
+		int win_width, win_height;
+		glfwGetFramebufferSize(*window, &win_width, &win_height);
+		bool resized = (win_width != last_width) || (win_height != last_height);
+		last_width = win_width;  last_height = win_height;
+		process_clicks(trainer, ds, win_width, win_height, time);
+		trainer.flush();
+
+		if(mouse_pressed) {
+			if(mouse_pressed_last + CLICK_REPEAT_S < time) {
+				mouse_pressed_last = time;
+				double x, y;
+				glfwGetCursorPos(*window, &x, &y);
+				add_point(
+						x, y, last_click.button, last_click.mods,
+						trainer, ds, win_width, win_height);
+				changed = true;
 			}
+		}
+
+		switch(stored_action) {
+			case Action::QUIT:           window->close();  break;
+			case Action::SHOW_TRAINING:
+				show_training = ! show_training;
+				std::cout << "----- " << (show_training? "Show":"Hid")
+				          << "ing training data -----\n";
+				break;
+			case Action::SHOW_DERIVS:
+				show_derivs = ! show_derivs;
+				refinement.restart();
+				std::cout << "----- " << (show_derivs? "En":"Dis")
+				          << "abled derivative mode -----\n";
+				break;
+			case Action::ADAPTIVE:
+				adaptive = ! adaptive;
+				std::cout << "----- " << (adaptive? "En":"Dis")
+				          << "abled adaptive sampling -----\n";
+				break;
+			case Action::STATS: {
+				std::cout << "Frame times (ms):";
+				for(unsigned p=0; p < PHASE_COUNT; ++p)
+					std::cout << ' ' << PHASE_NAMES[p] << ' ' << (scheduler.phaseTime(p) * 1000.0);
+				std::cout << "; " << scheduler.lateFrames() << " late frames out of "
+				          << scheduler.frameCount() << '\n';
+			} break;
+			case Action::RATE_UP: {
+				trainer.setLearningRate(trainer.getLearningRate() * 2.0);
+				std::cout << "Rate: " << trainer.getLearningRate() << '\n';
+			} break;
+			case Action::RATE_DOWN: {
+				trainer.setLearningRate(trainer.getLearningRate() / 2.0);
+				std::cout << "Rate: " << trainer.getLearningRate() << '\n';
+			} break;
+			case Action::GRAN_UP: {
+				refinement.setPassCount(refinement.passCount() * 4);
+				std::cout << "Granularity: " << refinement.passCount() << '\n';
+			} break;
+			case Action::GRAN_DOWN: {
+				refinement.setPassCount(refinement.passCount() / 4);
+				std::cout << "Granularity: " << refinement.passCount() << '\n';
+			} break;
+			case Action::RESET: {
+				auto lock = trainer.acquireLock();
+				n.randomize();
+				snapshot.publish(n);
+				refinement.restart();
+				std::cout << "-----  NN reset  -----" << '\n';
+			} break;
+			case Action::REGEN: {
+				ds.resize(0);
+				trainer.submit(DataEvent { DataEvent::Type::CLEAR, { } });
+				std::cout << "-----  Canvas cleared  -----" << '\n';
+			} break;
+			case Action::UNDO: {
+				if(! ds.empty())  ds.pop_back();
+				trainer.submit(DataEvent { DataEvent::Type::POP, { } });
+				std::cout << "-----  Undo last point  -----" << '\n';
+			} break;
+			default:  break;
+		}
+		stored_action = Action::NONE;
 
-			switch(stored_action) {
-				case Action::QUIT:           window->close();  break;
-				case Action::SHOW_TRAINING:
-					show_training = ! show_training;
-					std::cout << "----- " << (show_training? "Show":"Hid")
-					          << "ing training data -----\n";
-					break;
-				case Action::SHOW_DERIVS:
-					show_derivs = ! show_derivs;
-					std::cout << "----- " << (show_derivs? "En":"Dis")
-					          << "abled derivative mode -----\n";
-					break;
-				case Action::RATE_UP: {
-					trainer.setLearningRate(trainer.getLearningRate() * 2.0);
-					std::cout << "Rate: " << trainer.getLearningRate() << '\n';
-				} break;
-				case Action::RATE_DOWN: {
-					trainer.setLearningRate(trainer.getLearningRate() / 2.0);
-					std::cout << "Rate: " << trainer.getLearningRate() << '\n';
-				} break;
-				case Action::GRAN_UP: {
-					granularity *= 2;
-					std::cout << "Granularity: " << granularity << '\n';
-				} break;
-				case Action::GRAN_DOWN: {
-					granularity /= 2;  if(granularity < 1)  granularity = 1;
-					std::cout << "Granularity: " << granularity << '\n';
-				} break;
-				case Action::RESET: {
-					auto lock = trainer.acquireLock();
-					n.randomize();
-					poll_nn(n, frame, show_derivs? act_tanh_deriv : act_tanh, 0);
-					std::cout << "-----  NN reset  -----" << '\n';
-				} break;
-				case Action::REGEN: {
-					auto lock = trainer.acquireLock();
-					ds.resize(0);
-					std::cout << "-----  Canvas cleared  -----" << '\n';
-				} break;
-				case Action::UNDO: {
-					auto lock = trainer.acquireLock();
-					ds.pop_back();
-					std::cout << "-----  Undo last point  -----" << '\n';
-				} break;
-				default:  break;
+		scheduler.beginPhase(PHASE_SNAPSHOT, glfwGetTime());
+		const Stripe& stripe = snapshot.acquire();
+		if(snapshot.epoch() != drawn_epoch) {
+			drawn_epoch = snapshot.epoch();
+			changed = true;
+		}
+		if(changed)  refinement.invalidate();
+
+		/* Adaptive sampling always computes the whole surface;
+		 * progressive refinement computes as many passes as
+		 * the frame allows, until every pixel is up to date */
+		scheduler.beginPhase(PHASE_SURFACE, glfwGetTime());
+		bool computed = false;
+		if(adaptive) {
+			if(changed) {
+				poll_nn(stripe, frame, show_derivs, sampler);
+				computed = true;
 			}
+		} else if(! refinement.upToDate()) {
+			double budget = scheduler.timeLeft(PHASE_SURFACE, glfwGetTime()) - FRAME_MARGIN_S;
+			poll_nn(stripe, frame, show_derivs, refinement, budget);
+			computed = true;
+		}
+		if(show_training && (computed || changed))  draw_training(frame, ds);
 
+		scheduler.beginPhase(PHASE_UPLOAD, glfwGetTime());
+		frame.updateTexture();
+
+		scheduler.beginPhase(PHASE_DRAW, glfwGetTime());
+		bool redraw = computed || changed || resized || refresh_requested;
+		if(redraw) {
+			glViewport(0, 0, win_width, win_height);
 			glClear(GL_COLOR_BUFFER_BIT);
 
 			// Enable transparency
@@ -386,21 +758,13 @@ int main(int argn, char** args) {
 			glEnable(GL_BLEND);
 			glEnable(GL_ALPHA_TEST);
 
-			poll_nn(n, frame, show_derivs? act_tanh_deriv : act_tanh, granularity);
-
-			if(show_training)
-			for(DataRow& r : ds) {
-				auto lock = trainer.acquireLock();
-				frame.setPixel(
-					((r.inputs[0] * (BOX_SIZE/2.0)) + (BOX_SIZE/2.0)),
-					((r.inputs[1] * (BOX_SIZE/2.0)) + (BOX_SIZE/2.0)),
-					glm::vec4(r.outputs[0], 0.0f, -r.outputs[0], 1.0f)
-				);
-			}
 			frame.draw();
-
+		}
+		/* Waiting for the buffer swap is not part of the frame's work */
+		scheduler.endFrame(glfwGetTime());
+		if(redraw) {
 			window->swapBuffers();
-			stored_action = Action::NONE;
+			refresh_requested = false;
 		}
 	}
 
@@ -1,25 +1,976 @@
+#include "nn/nn.hpp"
+#include "nn/kernels.hpp"
+#include "nn/trainer.hpp"
+#include "nn/queue.hpp"
+#include "nn/snapshot.hpp"
+#include "nn/datafile.hpp"
+#include "nn/precision.hpp"
+#include "nn/quantized.hpp"
+
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring> // memcpy(...)
+
+#include <cmath> // ::exp(...), ::fabs(...), ::tanh(...)
+
+#include <unistd.h> // ftruncate(...)
+
+#define COL_OK    "\033[1;92m"
+#define COL_ERR   "\033[1;91m"
+#define COL_NONE  "\033[m"
+
+
+
+namespace {
+
+	constexpr double EPSILON = 1e-12;
+
+	unsigned failures = 0;
+
+
+	template<typename num>
+	constexpr num range(
+			num value,
+			num from_lo, num from_hi,
+			num to_lo,   num to_hi
+	) {
+		value *= (to_hi - to_lo);
+		value /= (from_hi - from_lo);
+		value += to_lo - from_lo;
+		return value;
+	}
+
+
+	void check(bool condition, const std::string& what) {
+		if(condition) {
+			std::cout << COL_OK "[ OK ] " COL_NONE << what << '\n';
+		} else {
+			std::cout << COL_ERR "[FAIL] " COL_NONE << what << '\n';
+			++failures;
+		}
+	}
+
+	bool near(double expected, double got, double epsilon = EPSILON) {
+		double scale = std::fabs(expected);
+		if(scale < 1.0)  scale = 1.0;
+		return std::fabs(expected - got) <= epsilon * scale;
+	}
+
+	std::vector<double> random_vector(size_t size) {
+		std::vector<double> r;  r.reserve(size);
+		for(size_t i=0; i < size; ++i)
+			r.push_back(nn::random());
+		return r;
+	}
+
+
+	/* Every kernel is compared against the scalar implementation,
+	 * which is bit-for-bit equivalent to the original loops */
+	void test_kernels() {
+		using kernel::InstructionSet;
+		constexpr size_t sizes[] = { 0, 1, 2, 3, 7, 8, 15, 16, 17, 33, 100 };
+		constexpr size_t ROWS = 5;
+		constexpr InstructionSet sets[] = {
+			InstructionSet::SSE2, InstructionSet::AVX2, InstructionSet::AVX512 };
+
+		InstructionSet original = kernel::instruction_set();
+
+		for(size_t n : sizes) {
+			std::vector<double> a = random_vector(n);
+			std::vector<double> b = random_vector(n);
+			std::vector<double> w = random_vector(ROWS * n);
+			std::vector<double> bias = random_vector(ROWS);
+
+			kernel::set_instruction_set(InstructionSet::SCALAR);
+			double dot_ref = kernel::dot(a.data(), b.data(), n);
+			std::vector<double> axpy_ref = b;
+			kernel::axpy(0.75, a.data(), axpy_ref.data(), n);
+			double matvec_ref[ROWS];
+			kernel::matvec(w.data(), a.data(), bias.data(), matvec_ref, ROWS, n);
+			std::vector<double> x = random_vector(ROWS * 3);
+			std::vector<double> gemm_bias = random_vector(n);
+			std::vector<double> gemm_ref = std::vector<double>(ROWS * n);
+			kernel::gemm(x.data(), w.data(), gemm_bias.data(), gemm_ref.data(), ROWS, 3, n);
+
+			double dot_loop = 0.0;
+			for(size_t i=0; i < n; ++i)  dot_loop += a[i] * b[i];
+			check(dot_ref == dot_loop,
+					"scalar dot is exact (n = " + std::to_string(n) + ")");
+
+			for(InstructionSet set : sets) {
+				if(! kernel::set_instruction_set(set))  continue;
+				std::string suffix = std::string(" (") + kernel::name(set) + ", n = " + std::to_string(n) + ")";
+
+				check(near(dot_ref, kernel::dot(a.data(), b.data(), n)), "dot" + suffix);
+
+				std::vector<double> y = b;
+				bool ok = true;
+				kernel::axpy(0.75, a.data(), y.data(), n);
+				for(size_t i=0; i < n; ++i)  ok = ok && near(axpy_ref[i], y[i]);
+				check(ok, "axpy" + suffix);
+
+				double out[ROWS];
+				ok = true;
+				kernel::matvec(w.data(), a.data(), bias.data(), out, ROWS, n);
+				for(size_t i=0; i < ROWS; ++i)  ok = ok && near(matvec_ref[i], out[i]);
+				check(ok, "matvec" + suffix);
+
+				std::vector<double> gemm_out = std::vector<double>(ROWS * n);
+				ok = true;
+				kernel::gemm(x.data(), w.data(), gemm_bias.data(), gemm_out.data(), ROWS, 3, n);
+				for(size_t i=0; i < ROWS * n; ++i)  ok = ok && near(gemm_ref[i], gemm_out[i]);
+				check(ok, "gemm" + suffix);
+			}
+		}
+
+		kernel::set_instruction_set(original);
+	}
+
+	/* Both weight layouts must produce the same network */
+	void test_layouts() {
+		auto act = [] (double x) { return ::tanh(x); };
+		std::srand(1);
+		Stripe row = Stripe(2, { 32, 16 }, 1, WeightLayout::ROW_MAJOR);
+		std::srand(1);
+		Stripe col = Stripe(2, { 32, 16 }, 1, WeightLayout::COLUMN_MAJOR);
+		double in[2] = { 0.25, -0.5 };
+		double out_row, out_col;
+		row.guess(act, in, &out_row);
+		col.guess(act, in, &out_col);
+		check(near(out_row, out_col), "row-major and column-major layouts agree");
+
+		/* A const Neurode's perceptrons are read-only views over the same weights */
+		bool same = true;
+		for(Stripe* s : { &row, &col }) {
+			Neurode& writable = (*s)[1];
+			const Neurode& readable = writable;
+			for(unsigned i=0; i < writable.outputSize(); ++i) {
+				double in_hidden[32] = { 0.5 };
+				same = same &&
+					(readable[i].getWeights() == writable[i].getWeights()) &&
+					(readable[i].getBias() == writable[i].getBias()) &&
+					(readable[i].guess(act, in_hidden) == writable[i].guess(act, in_hidden));
+			}
+		}
+		check(same, "const perceptron views match the writable ones");
+
+		/* Assigning into a view writes the Neurode's weights,
+		 * while a copy of a view still aliases them */
+		Neurode& hidden = row[1];
+		Perceptron owned = Perceptron(32);
+		hidden[3] = owned;
+		Perceptron alias = hidden[4];
+		alias = hidden[3];
+		Perceptron snapshot = owned;
+		snapshot.setBias(owned.getBias() + 1.0);
+		bool rejected = false;
+		try {
+			hidden[0] = Perceptron(5);
+		} catch(NeuralException&) {
+			rejected = true;
+		}
+		check(
+				(hidden[3].getWeights() == owned.getWeights()) && (hidden[3].getBias() == owned.getBias()) &&
+				(hidden[4].getWeights() == owned.getWeights()) && (hidden[4].getBias() == owned.getBias()) &&
+				(snapshot.getBias() != owned.getBias()) && rejected,
+				"assigning a perceptron into a view copies its weights");
+	}
+
+	/* A batch must match row-by-row evaluation, including
+	 * partial tiles */
+	void test_batch() {
+		auto act = [] (double x) { return ::tanh(x); };
+		constexpr size_t ROWS = 150;
+		for(WeightLayout layout : { WeightLayout::ROW_MAJOR, WeightLayout::COLUMN_MAJOR }) {
+			Stripe n = Stripe(2, { 32, 16 }, 3, layout);
+			std::vector<double> in = random_vector(ROWS * 2);
+			std::vector<double> out = std::vector<double>(ROWS * 3);
+			n.guessBatch(act, in.data(), ROWS, out.data());
+			bool ok = true;
+			for(size_t i=0; i < ROWS; ++i) {
+				double expect[3];
+				n.guess(act, in.data() + (i * 2), expect);
+				for(size_t j=0; j < 3; ++j)
+					ok = ok && near(expect[j], out[(i * 3) + j]);
+			}
+			check(ok, std::string("guessBatch matches guess (") +
+					((layout == WeightLayout::ROW_MAJOR)? "row" : "column") + "-major)");
+		}
+	}
+
+	/* Several threads evaluate the same Stripe at once, with their
+	 * own Workspace or with the thread-local one */
+	void test_workspace() {
+		constexpr size_t ROWS = 200;
+		constexpr size_t THREADS = 4;
+		activation::Tanh act;
+		Stripe n = Stripe(2, { 24, 12 }, 2);
+		std::vector<double> in = random_vector(ROWS * 2);
+		std::vector<double> expect = std::vector<double>(ROWS * 2);
+		for(size_t i=0; i < ROWS; ++i)
+			n.guess(act, in.data() + (i * 2), expect.data() + (i * 2));
+
+		std::vector<std::vector<double>> results = std::vector<std::vector<double>>(
+				2 * THREADS, std::vector<double>(ROWS * 2));
+		std::vector<std::thread> threads;
+		for(size_t t=0; t < THREADS; ++t) {
+			threads.emplace_back([&, t] () {
+				Workspace ws = Workspace(n);
+				for(unsigned repeat=0; repeat < 50; ++repeat) {
+					for(size_t i=0; i < ROWS; ++i) {
+						const double* row = in.data() + (i * 2);
+						if(t % 2 == 0) {
+							n.guess(act, row, results[t].data() + (i * 2), ws);
+						} else {
+							n.guess(act, row, results[t].data() + (i * 2));
+						}
+					}
+					n.guessBatch(act, in.data(), ROWS, results[THREADS + t].data(), ws);
+				}
+			});
+		}
+		for(std::thread& t : threads)
+			t.join();
+
+		bool ok = true;
+		for(const std::vector<double>& r : results)
+			for(size_t i=0; i < ROWS * 2; ++i)
+				ok = ok && near(expect[i], r[i]);
+		check(ok, "concurrent guesses on one stripe do not interfere");
+
+		Stripe single = Stripe(3, { }, 2);
+		double out[2];
+		double direct[2];
+		single.guess(act, in.data(), out);
+		single[0].guess(act, in.data(), direct);
+		check((out[0] == direct[0]) && (out[1] == direct[1]), "single-layer stripes guess correctly");
+	}
+
+
+	DataSet random_data(size_t rows) {
+		DataSet ds;  ds.reserve(rows);
+		for(size_t i=0; i < rows; ++i) {
+			double x = nn::random();
+			double y = nn::random();
+			ds.push_back(DataRow { { x, y }, { (x * y > 0.0)? 1.0 : -1.0 } });
+		}
+		return ds;
+	}
+
+	bool same_weights(const Stripe& a, const Stripe& b) {
+		for(size_t i=0; i < a.neurodeCount(); ++i) {
+			const Neurode& na = a[i];
+			const Neurode& nb = b[i];
+			size_t count = (na.inputSize() + 1) * na.outputSize();
+			for(size_t j=0; j < count; ++j)
+				if(! near(na.weightData()[j], nb.weightData()[j]))  return false;
+		}
+		return true;
+	}
+
+	/* The approximations are compared against libm, over a range
+	 * that covers their saturation, for every instruction set;
+	 * 1001 values exercise the padded tails */
+	void test_approximations() {
+		using kernel::InstructionSet;
+		using activation::Accuracy;
+		constexpr InstructionSet sets[] = {
+			InstructionSet::SCALAR, InstructionSet::AVX2, InstructionSet::AVX512 };
+		constexpr Accuracy tiers[] = { Accuracy::PRECISE, Accuracy::FAST, Accuracy::FASTEST };
+		constexpr double bounds[] = { 1e-15, 1e-8, 1e-4 };
+		constexpr const char* tier_names[] = { "precise", "fast", "fastest" };
+		constexpr size_t COUNT = 1001;
+
+		std::vector<double> x;  x.reserve(COUNT);
+		for(size_t i=0; i < COUNT; ++i)
+			x.push_back(-25.0 + (50.0 * i / (COUNT-1)));
+		std::vector<double> y  = std::vector<double>(COUNT);
+		std::vector<double> dy = std::vector<double>(COUNT);
+		InstructionSet original = kernel::instruction_set();
+
+		for(InstructionSet set : sets) {
+			if(! kernel::set_instruction_set(set))  continue;
+			for(size_t t=0; t < 3; ++t) {
+				std::string suffix = std::string(" (") + kernel::name(set) + ", " + tier_names[t] + ")";
+				double bound = bounds[t];
+
+				bool ok = true;
+				activation::tanh(x.data(), y.data(), dy.data(), COUNT, tiers[t]);
+				for(size_t i=0; i < COUNT; ++i) {
+					double expected = ::tanh(x[i]);
+					ok = ok &&
+							(std::fabs(y[i] - expected) <= bound) &&
+							(std::fabs(dy[i] - (1.0 - (expected * expected))) <= 2.0 * bound);
+				}
+				check(ok, "tanh and its derivative" + suffix);
+
+				ok = true;
+				activation::logistic(x.data(), y.data(), dy.data(), COUNT, tiers[t]);
+				for(size_t i=0; i < COUNT; ++i) {
+					double expected = 1.0 / (1.0 + ::exp(-x[i]));
+					ok = ok &&
+							(std::fabs(y[i] - expected) <= bound) &&
+							(std::fabs(dy[i] - (expected * (1.0 - expected))) <= 2.0 * bound);
+				}
+				check(ok, "logistic and its derivative" + suffix);
+
+				ok = true;
+				y = x;
+				activation::exp(y.data(), y.data(), COUNT, tiers[t]);
+				for(size_t i=0; i < COUNT; ++i) {
+					double expected = ::exp(x[i]);
+					ok = ok && (std::fabs(y[i] - expected) <= bound * expected);
+				}
+				check(ok, "in-place exp" + suffix);
+
+				/* Single precision, on both sides of the clamp */
+				double float_bound = (t == 2)? 1e-4 : 2e-6;
+				std::vector<float> xf = std::vector<float>(x.begin(), x.end());
+				std::vector<float> yf = std::vector<float>(COUNT);
+				ok = true;
+				activation::tanh(xf.data(), yf.data(), COUNT, tiers[t]);
+				for(size_t i=0; i < COUNT; ++i)
+					ok = ok && (std::fabs(yf[i] - ::tanh(xf[i])) <= float_bound);
+				activation::logistic(xf.data(), yf.data(), COUNT, tiers[t]);
+				for(size_t i=0; i < COUNT; ++i)
+					ok = ok && (std::fabs(yf[i] - (1.0 / (1.0 + ::exp(-xf[i])))) <= float_bound);
+				for(size_t i=0; i < COUNT; ++i)
+					xf[i] *= 3.5f;
+				activation::exp(xf.data(), yf.data(), COUNT, tiers[t]);
+				for(size_t i=0; i < COUNT; ++i) {
+					double expected = ::exp(std::min(std::max(double(xf[i]), -87.0), 88.0));
+					ok = ok && (std::fabs(yf[i] - expected) <= 2.0 * float_bound * expected);
+				}
+				check(ok, "single-precision tanh, logistic and exp" + suffix);
+			}
+		}
+		kernel::set_instruction_set(original);
+
+		/* A layer evaluated at once matches its neurons one by one */
+		activation::FastTanh fast = activation::FastTanh(Accuracy::FASTEST);
+		std::vector<double> layer = x;
+		activation::apply(fast, layer.data(), COUNT);
+		bool ok = true;
+		for(size_t i=0; i < COUNT; ++i)
+			ok = ok && (layer[i] == fast(x[i]));
+		check(ok, "fast activations are consistent across a layer");
+
+		Stripe n = Stripe(2, { 9, 5 }, 1);
+		DataMatrix matrix = DataMatrix(2, 1, random_data(COUNT));
+		std::vector<double> expected = std::vector<double>(COUNT);
+		std::vector<double> got = std::vector<double>(COUNT);
+		n.guessBatch(activation::Tanh(), matrix.view().inputs, COUNT, expected.data());
+		n.guessBatch(activation::FastTanh(Accuracy::PRECISE), matrix.view().inputs, COUNT, got.data());
+		ok = true;
+		for(size_t i=0; i < COUNT; ++i)
+			ok = ok && (std::fabs(expected[i] - got[i]) <= 1e-14);
+		check(ok, "precise FastTanh matches Tanh");
 
+		/* Both take the derivative from the cached outputs, the
+		 * approximation from its fused overload: they train alike */
+		Stripe exact_trained = n;
+		Stripe fast_trained = n;
+		exact_trained.train(activation::Tanh(), matrix, -1, 0.05);
+		fast_trained.train(activation::FastTanh(Accuracy::PRECISE), matrix, -1, 0.05);
+		check(same_weights(exact_trained, fast_trained), "precise FastTanh trains as Tanh");
+	}
 
+	/* Every fp16 value survives a round trip through float,
+	 * and reduced precision stays close to the double baseline */
+	void test_precision() {
+		using precision::bf16;
+		using precision::fp16;
+
+		bool ok = true;
+		std::vector<fp16> halves;  halves.reserve(0x10000);
+		for(uint32_t bits=0; bits < 0x10000; ++bits) {
+			fp16 h;  h.bits = bits;
+			halves.push_back(h);
+			bool nan = ((bits & 0x7C00u) == 0x7C00u) && ((bits & 0x03FFu) != 0);
+			ok = ok && (nan || (fp16(static_cast<float>(h)).bits == bits));
+		}
+		std::vector<float> converted = std::vector<float>(halves.size());
+		precision::convert(halves.data(), converted.data(), halves.size());
+		for(size_t i=0; i < halves.size(); ++i) {
+			float single = halves[i];
+			ok = ok && ((converted[i] == single) || (converted[i] != converted[i]));
+		}
+		check(ok, "fp16 conversions round-trip");
+		check(
+				(fp16(1.0f).bits == 0x3C00u) && (fp16(65504.0f).bits == 0x7BFFu) &&
+				(fp16(1e6f).bits == 0x7C00u) && (fp16(-0.0f).bits == 0x8000u) &&
+				(bf16(1.0f).bits == 0x3F80u) && (static_cast<float>(bf16(-2.5f)) == -2.5f) &&
+				(bf16(1.0f + 1.0f/256.0f).bits == 0x3F80u), // Ties round to even
+				"fp16 and bf16 encode known values");
+
+		constexpr size_t ROWS = 200;
+		auto act = activation::Tanh();
+		Stripe baseline = Stripe(2, { 9, 5 }, 1, WeightLayout::COLUMN_MAJOR);
+		DataMatrix matrix = DataMatrix(2, 1, random_data(ROWS));
+		std::vector<double> expected = std::vector<double>(ROWS);
+		baseline.guessBatch(act, matrix.view().inputs, ROWS, expected.data());
+
+		auto deviation = [&] (auto typed) {
+			using Scalar = typename decltype(typed)::Scalar;
+			std::vector<Scalar> inputs = std::vector<Scalar>(matrix.view().inputs, matrix.view().inputs + (ROWS * 2));
+			std::vector<Scalar> batch = std::vector<Scalar>(ROWS);
+			typed.guessBatch(act, inputs.data(), ROWS, batch.data());
+			double worst = 0.0;
+			for(size_t i=0; i < ROWS; ++i) {
+				Scalar single;
+				typed.guess(act, inputs.data() + (i * 2), &single);
+				worst = std::max(worst, std::fabs(expected[i] - batch[i]));
+				worst = std::max(worst, std::fabs(expected[i] - single));
+			}
+			return worst;
+		};
+		check(deviation(TypedStripe<double>(baseline)) <= 1e-12, "double TypedStripe matches Stripe");
+		check(deviation(TypedStripe<float>(baseline)) <= 1e-5, "float TypedStripe is close to Stripe");
+		check(deviation(TypedStripe<fp16>(baseline)) <= 1e-2, "fp16 TypedStripe is close to Stripe");
+		check(deviation(TypedStripe<bf16>(baseline)) <= 5e-2, "bf16 TypedStripe is close to Stripe");
+
+		/* Training in double follows Stripe::train;
+		 * in float, it stays close */
+		Stripe trained = baseline;
+		TypedStripe<double> typed_double = TypedStripe<double>(baseline);
+		TypedStripe<float> typed_float = TypedStripe<float>(baseline);
+		for(size_t i=0; i < ROWS; ++i) {
+			const double* in = matrix.inputRow(i);
+			const double* out = matrix.outputRow(i);
+			float in_f[2] = { static_cast<float>(in[0]), static_cast<float>(in[1]) };
+			float out_f = out[0];
+			trained.train(act, in, out, 0.05);
+			typed_double.train(act, in, out, 0.05);
+			typed_float.train(act, in_f, &out_f, 0.05f);
+		}
+		Stripe exported = baseline;
+		typed_double.exportWeights(exported);
+		ok = same_weights(trained, exported);
+		typed_float.exportWeights(exported);
+		for(size_t i=0; i < trained.neurodeCount(); ++i) {
+			size_t count = (trained[i].inputSize() + 1) * trained[i].outputSize();
+			for(size_t j=0; j < count; ++j)
+				ok = ok && near(trained[i].weightData()[j], exported[i].weightData()[j], 1e-4);
+		}
+		check(ok, "TypedStripe training matches Stripe::train");
+
+		/* Like Stripe, one TypedStripe can be evaluated
+		 * by many threads at once */
+		std::vector<float> inputs_f = std::vector<float>(matrix.view().inputs, matrix.view().inputs + (ROWS * 2));
+		std::vector<float> expected_f = std::vector<float>(ROWS);
+		typed_float.guessBatch(act, inputs_f.data(), ROWS, expected_f.data());
+		std::vector<std::vector<float>> results = std::vector<std::vector<float>>(
+				8, std::vector<float>(ROWS));
+		std::vector<std::thread> threads;
+		for(size_t t=0; t < 4; ++t) {
+			threads.emplace_back([&, t] () {
+				Workspace ws;
+				for(unsigned repeat=0; repeat < 50; ++repeat) {
+					for(size_t i=0; i < ROWS; ++i)
+						typed_float.guess(act, inputs_f.data() + (i * 2), results[t].data() + i);
+					typed_float.guessBatch(act, inputs_f.data(), ROWS, results[4 + t].data(), ws);
+				}
+			});
+		}
+		for(std::thread& t : threads)
+			t.join();
+		ok = true;
+		for(const std::vector<float>& r : results)
+			for(size_t i=0; i < ROWS; ++i)
+				ok = ok && near(expected_f[i], r[i], 1e-5);
+		check(ok, "concurrent guesses on one TypedStripe do not interfere");
+
+		bool rejected = false;
+		try {
+			typed_float.copyWeights(Stripe(2, { 9 }, 1));
+		} catch(NeuralException&) {
+			rejected = true;
+		}
+		check(rejected, "TypedStripe rejects differently shaped stripes");
+	}
+
+	void test_quantized() {
+		using kernel::InstructionSet;
+		constexpr InstructionSet sets[] = {
+			InstructionSet::SCALAR, InstructionSet::SSE2, InstructionSet::AVX2, InstructionSet::AVX512 };
+		constexpr size_t ROWS = 200;
+		auto act = activation::Tanh();
+
+		/* 70 inputs span two 64-byte strides, and 9 outputs
+		 * leave a remainder after the blocks of four rows */
+		Stripe baseline = Stripe(2, { 70, 9 }, 1, WeightLayout::COLUMN_MAJOR);
+		DataMatrix matrix = DataMatrix(2, 1, random_data(ROWS));
+		std::vector<double> expected = std::vector<double>(ROWS);
+		baseline.guessBatch(act, matrix.view().inputs, ROWS, expected.data());
+		std::vector<float> inputs = std::vector<float>(matrix.view().inputs, matrix.view().inputs + (ROWS * 2));
+
+		QuantizedStripe quantized = QuantizedStripe(baseline);
+		InstructionSet original = kernel::instruction_set();
+		std::vector<float> reference;
+		for(InstructionSet set : sets) {
+			if(! kernel::set_instruction_set(set))  continue;
+			std::vector<float> batch = std::vector<float>(ROWS);
+			quantized.guessBatch(act, inputs.data(), ROWS, batch.data());
+			if(reference.empty()) {
+				reference = batch;
+				double worst = 0.0;
+				for(size_t i=0; i < ROWS; ++i)
+					worst = std::max(worst, std::fabs(expected[i] - batch[i]));
+				check(worst <= 5e-2, "quantized stripe is close to Stripe");
+			} else {
+				check(batch == reference, std::string("quantized stripe is exact with ") + kernel::name(set));
+			}
+		}
+		kernel::set_instruction_set(original);
+
+		QuantizedStripe copy = quantized;
+		bool ok = true;
+		for(size_t i=0; i < ROWS; ++i) {
+			float single;
+			copy.guess(act, inputs.data() + (i * 2), &single);
+			ok = ok && (single == reference[i]);
+		}
+		check(ok, "quantized guess matches guessBatch");
+
+		std::vector<std::vector<float>> results = std::vector<std::vector<float>>(
+				4, std::vector<float>(ROWS));
+		std::vector<std::thread> threads;
+		for(size_t t=0; t < 4; ++t) {
+			threads.emplace_back([&, t] () {
+				Workspace ws;
+				for(unsigned repeat=0; repeat < 50; ++repeat) {
+					if(t % 2 == 0) {
+						quantized.guessBatch(act, inputs.data(), ROWS, results[t].data(), ws);
+					} else {
+						quantized.guessBatch(act, inputs.data(), ROWS, results[t].data());
+					}
+				}
+			});
+		}
+		for(std::thread& t : threads)
+			t.join();
+		ok = true;
+		for(const std::vector<float>& r : results)
+			ok = ok && (r == reference);
+		check(ok, "concurrent quantized guesses do not interfere");
+
+		/* The documented limit of 8 bits, on the decision
+		 * surface of a wide network like nnbench's */
+		double worst = 0.0;
+		for(unsigned trial=0; trial < 4; ++trial) {
+			Stripe wide = Stripe(2, { 128, 128 }, 1);
+			QuantizedStripe wide_quantized = QuantizedStripe(wide);
+			std::vector<double> wide_expected = std::vector<double>(ROWS);
+			std::vector<float> wide_outputs = std::vector<float>(ROWS);
+			wide.guessBatch(act, matrix.view().inputs, ROWS, wide_expected.data());
+			wide_quantized.guessBatch(act, inputs.data(), ROWS, wide_outputs.data());
+			for(size_t i=0; i < ROWS; ++i)
+				worst = std::max(worst, std::fabs(wide_expected[i] - wide_outputs[i]));
+		}
+		check(worst <= 0.25, "quantized error stays within its documented limit");
+	}
+
+	void test_minibatch() {
+		auto act   = [] (double x) { return ::tanh(x); };
+		auto deriv = [] (double x) { x = ::tanh(x);  return 1.0 - (x*x); };
+		DataSet ds = random_data(20);
+
+		/* Batches of one sample are plain SGD */
+		Stripe sgd = Stripe(2, { 8, 4 }, 1);
+		Stripe batched = sgd;
+		for(DataRow& row : ds)
+			sgd.train(act, deriv, row.inputs.data(), row.outputs.data(), 0.05);
+		batched.train(act, deriv, ds, -1, 0.05, 1);
+		check(same_weights(sgd, batched), "mini-batch of size 1 matches SGD");
+
+		/* A whole batch is a single update, regardless of the row order */
+		Stripe forward = Stripe(2, { 8, 4 }, 1);
+		Stripe backward = forward;
+		DataSet reversed = DataSet(ds.rbegin(), ds.rend());
+		forward.train(act, deriv, ds, 0, 0.05, ds.size());
+		backward.train(act, deriv, reversed, 0, 0.05, ds.size());
+		check(same_weights(forward, backward), "mini-batch update does not depend on row order");
+
+		/* Same depth, different shapes */
+		Stripe wide = Stripe(2, { 32, 16 }, 1);
+		Stripe narrow = Stripe(2, { 8, 8 }, 1);
+		Gradient wide_gradient = Gradient(wide);
+		Gradient narrow_gradient = Gradient(narrow);
+		unsigned rejected = 0;
+		try {  wide.apply(narrow_gradient, 0.1);             } catch(NeuralException&) {  ++rejected; }
+		try {  wide_gradient.merge(narrow_gradient);         } catch(NeuralException&) {  ++rejected; }
+		try {  narrow_gradient.merge(wide_gradient);         } catch(NeuralException&) {  ++rejected; }
+		check(rejected == 3, "gradients of differently shaped stripes are rejected");
+	}
+
+	/* The inlined activations must behave exactly
+	 * as the pointer-based API they replace */
+	template<typename Activation>
+	void test_activation(const char* name) {
+		activation_func act   = [] (double x) { return Activation()(x); };
+		activation_func deriv = [] (double x) { return Activation().derive(x); };
+		constexpr size_t ROWS = 70;
+		DataSet ds = random_data(ROWS);
+		DataMatrix matrix = DataMatrix(2, 1, ds);
+
+		Stripe pointer = Stripe(2, { 9, 5 }, 1);
+		Stripe inlined = pointer;
+		std::vector<double> expected = std::vector<double>(ROWS);
+		std::vector<double> got = std::vector<double>(ROWS);
+		pointer.guessBatch(act, matrix.view().inputs, ROWS, expected.data());
+		inlined.guessBatch(Activation(), matrix.view().inputs, ROWS, got.data());
+		bool same_output = true;
+		for(size_t i=0; i < ROWS; ++i) {
+			double single;
+			inlined.guess(Activation(), matrix.inputRow(i), &single);
+			same_output = same_output && near(expected[i], got[i]) && near(expected[i], single);
+		}
+
+		pointer.train(act, deriv, matrix, -1, 0.05);
+		inlined.train(Activation(), matrix, -1, 0.05);
+		pointer.train(act, deriv, matrix, -1, 0.05, 16);
+		Gradient buffer = Gradient(inlined);
+		inlined.train(Activation(), matrix, -1, 0.05, 16, buffer);
+		check(
+				same_output && same_weights(pointer, inlined),
+				std::string("inlined ") + name + " matches the function pointer"
+		);
+	}
+
+	void test_activations() {
+		test_activation<activation::Tanh>("tanh");
+		test_activation<activation::Logistic>("logistic");
+		test_activation<activation::Relu>("relu");
+		test_activation<activation::Sign>("sign");
+	}
+
+	/* Synchronous data-parallel training is mini-batch training,
+	 * whatever the number of threads */
+	void test_parallel() {
+		auto act   = [] (double x) { return ::tanh(x); };
+		auto deriv = [] (double x) { x = ::tanh(x);  return 1.0 - (x*x); };
+		DataSet ds = random_data(100);
+		Stripe reference = Stripe(2, { 8, 4 }, 1);
+		Stripe parallel = reference;
+		for(unsigned i=0; i < 3; ++i)
+			reference.train(act, deriv, ds, -1, 0.05, 16);
+
+		for(size_t threads : { 1, 3 }) {
+			Stripe n = parallel;
+			ParallelTrainer trainer = ParallelTrainer(n, act, deriv, threads);
+			for(unsigned i=0; i < 3; ++i)
+				trainer.epoch(ds, 0.05, 16);
+			check(same_weights(reference, n),
+					"synchronous training with " + std::to_string(threads) + " thread(s) matches mini-batch");
+		}
+
+		Stripe hogwild = parallel;
+		ParallelTrainer trainer = ParallelTrainer(
+				hogwild, act, deriv, 1, ParallelTrainer::Mode::HOGWILD);
+		for(unsigned i=0; i < 3; ++i)
+			trainer.epoch(ds, 0.05, 16);
+		check(same_weights(reference, hogwild), "single-threaded Hogwild training matches mini-batch");
+	}
+
+
+	/* Every value must arrive exactly once, in order, while
+	 * the producer keeps running into a full queue */
+	void test_queue() {
+		constexpr size_t COUNT = 100000;
+		SpscQueue<size_t> queue = SpscQueue<size_t>(60);
+		check(queue.capacity() == 64, "queue capacity is rounded to a power of two");
+
+		std::thread producer = std::thread([&queue] () {
+			for(size_t i=0; i < COUNT; ++i) {
+				while(! queue.push(i))
+					std::this_thread::yield();
+			}
+		});
+		bool ordered = true;
+		size_t value;
+		for(size_t expected = 0; expected < COUNT; ) {
+			if(queue.pop(value)) {
+				ordered = ordered && (value == expected);
+				++expected;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+		producer.join();
+		check(ordered && queue.empty(), "queue delivers every value in order");
+	}
+
+
+	/* The writer fills every weight of its stripe with the epoch
+	 * it is about to publish: a torn snapshot would mix values */
+	void test_snapshot() {
+		constexpr size_t COUNT = 20000;
+		Stripe stripe = Stripe(2, { 9, 5 }, 1);
+		StripeSnapshot snapshot = StripeSnapshot(stripe);
+		check(
+				(snapshot.epoch() == 0) && (! snapshot.pending()) &&
+				same_weights(stripe, snapshot.acquire()),
+				"snapshot starts with the stripe's weights"
+		);
+
+		std::thread writer = std::thread([&stripe, &snapshot] () {
+			for(size_t e = 1; e <= COUNT; ++e) {
+				for(size_t i=0; i < stripe.neurodeCount(); ++i) {
+					Neurode& layer = stripe[i];
+					size_t count = (layer.inputSize() + 1) * layer.outputSize();
+					for(size_t j=0; j < count; ++j)
+						layer.weightData()[j] = e;
+				}
+				snapshot.publish(stripe);
+			}
+		});
+		bool consistent = true;
+		bool ordered = true;
+		size_t last = 0;
+		while(last < COUNT) {
+			const Stripe& s = snapshot.acquire();
+			size_t e = snapshot.epoch();
+			ordered = ordered && (e >= last);
+			last = e;
+			for(size_t i=0; (e > 0) && (i < s.neurodeCount()); ++i) {
+				const Neurode& layer = s[i];
+				size_t count = (layer.inputSize() + 1) * layer.outputSize();
+				for(size_t j=0; j < count; ++j)
+					consistent = consistent && (layer.weightData()[j] == e);
+			}
+		}
+		writer.join();
+		check(consistent && ordered, "snapshots are never torn, and arrive in order");
+		check(! snapshot.pending(), "acquire takes the latest snapshot");
+	}
+
+
+	void test_matrix() {
+		auto act   = [] (double x) { return ::tanh(x); };
+		auto deriv = [] (double x) { x = ::tanh(x);  return 1.0 - (x*x); };
+		DataSet ds = random_data(50);
+		DataMatrix matrix = DataMatrix(2, 1);
+		for(DataRow& row : ds)
+			matrix.append(row);
+		matrix.append(ds[0]);
+		matrix.pop();
+
+		bool ok = (matrix.size() == ds.size());
+		for(size_t i=0; ok && (i < ds.size()); ++i) {
+			ok =
+					(matrix.inputRow(i)[0] == ds[i].inputs[0]) &&
+					(matrix.inputRow(i)[1] == ds[i].inputs[1]) &&
+					(matrix.outputRow(i)[0] == ds[i].outputs[0]);
+		}
+		DataMatrix copy = matrix;
+		ok = ok && (copy.size() == matrix.size()) && (copy.inputRow(7)[1] == matrix.inputRow(7)[1]);
+		check(ok, "data matrix stores the appended rows");
+
+		Stripe a = Stripe(2, { 8, 4 }, 1);
+		Stripe b = a;
+		Stripe c = a;
+		a.train(act, deriv, ds, -1, 0.05, 8);
+		b.train(act, deriv, matrix, -1, 0.05, 8);
+		ParallelTrainer trainer = ParallelTrainer(c, act, deriv, 2);
+		trainer.epoch(matrix, 0.05, 8);
+		check(same_weights(a, b) && same_weights(a, c), "training on a data matrix matches a data set");
+	}
+
+
+	void test_datafile() {
+		const std::string path = "/tmp/nntest_data.bin";
+		DataSet ds = random_data(300);
+		DataMatrix matrix = DataMatrix(2, 1, ds);
+		write_data_file(path, matrix);
+
+		MappedDataSet mapped = MappedDataSet(path, MappedDataSet::Access::SEQUENTIAL);
+		bool ok =
+				(mapped.size() == matrix.size()) &&
+				(mapped.inputSize() == 2) && (mapped.outputSize() == 1);
+		DataView view = mapped.view();
+		for(size_t i=0; ok && (i < view.size()); ++i) {
+			ok =
+					(view.inputRow(i)[0] == matrix.inputRow(i)[0]) &&
+					(view.inputRow(i)[1] == matrix.inputRow(i)[1]) &&
+					(view.outputRow(i)[0] == matrix.outputRow(i)[0]);
+		}
+		check(ok, "mapped data file exposes the written rows");
+
+		const std::string garbage_path = "/tmp/nntest_garbage.bin";
+		bool rejected = false;
+		FILE* garbage = fopen(garbage_path.c_str(), "wb");
+		fputs("definitely not a data file, but long enough to hold a header ......", garbage);
+		fclose(garbage);
+		try {
+			MappedDataSet invalid = MappedDataSet(garbage_path);
+		} catch(NeuralException&) {
+			rejected = true;
+		}
+		check(rejected, "invalid data files are rejected");
+		std::remove(garbage_path.c_str());
+
+		/* Sizes whose row size wraps around to 0 */
+		std::vector<char> bytes;
+		FILE* valid = fopen(path.c_str(), "rb");
+		for(int c; (c = fgetc(valid)) != EOF; )  bytes.push_back(c);
+		fclose(valid);
+		datafile::Header crafted;
+		memcpy(&crafted, bytes.data(), sizeof(crafted));
+		crafted.input_size = uint64_t(1) << 61;
+		crafted.output_size = uint64_t(1) << 61;
+		memcpy(bytes.data(), &crafted, sizeof(crafted));
+		FILE* wrapped = fopen(garbage_path.c_str(), "wb");
+		fwrite(bytes.data(), 1, bytes.size(), wrapped);
+		fclose(wrapped);
+		rejected = false;
+		try {
+			MappedDataSet invalid = MappedDataSet(garbage_path);
+		} catch(NeuralException&) {
+			rejected = true;
+		}
+		check(rejected, "data files with overflowing row sizes are rejected");
+		std::remove(garbage_path.c_str());
+		std::remove(path.c_str());
+	}
+
+	void test_checkpoint() {
+		auto act   = [] (double x) { return ::tanh(x); };
+		auto deriv = [] (double x) { x = ::tanh(x);  return 1.0 - (x*x); };
+		const std::string path = "/tmp/nntest_checkpoint.bin";
+		DataSet ds = random_data(20);
+
+		Stripe original = Stripe(2, { 9, 5 }, 1);
+		Gradient state = Gradient(original);
+		original.train(act, deriv, ds, 0, 0.05, ds.size(), state);
+		original.save(path, 7, &state);
+
+		uint32_t activation = 0;
+		Gradient loaded_state = Gradient(original);
+		Stripe loaded = Stripe::load(path, &activation, &loaded_state);
+		bool same_state = (loaded_state.sampleCount() == state.sampleCount());
+		for(size_t i=0; same_state && (i < state.layerCount()); ++i) {
+			size_t count = (state[i].inputSize() + 1) * state[i].outputSize();
+			for(size_t j=0; j < count; ++j)
+				same_state = same_state && (state[i].weightData()[j] == loaded_state[i].weightData()[j]);
+		}
+		bool same_output = true;
+		for(DataRow& row : ds) {
+			double expected, got;
+			original.guess(act, row.inputs.data(), &expected);
+			loaded.guess(act, row.inputs.data(), &got);
+			same_output = same_output && (expected == got);
+		}
+		check(
+				(activation == 7) && same_weights(original, loaded) && same_output,
+				"checkpoint round-trips the weights and the activation"
+		);
+		check(same_state, "checkpoint round-trips the optimizer state");
+
+		/* The mapping is private: training the loaded stripe,
+		 * or a copy of it, leaves the file untouched */
+		Stripe copy = loaded;
+		loaded.train(act, deriv, ds, -1, 0.05);
+		copy.train(act, deriv, ds, -1, 0.05);
+		original.train(act, deriv, ds, -1, 0.05);
+		Stripe reloaded = Stripe::load(path);
+		check(
+				same_weights(original, loaded) && same_weights(original, copy) &&
+				(! same_weights(original, reloaded)),
+				"loaded checkpoints can be trained without altering the file"
+		);
+
+		/* The header is not trusted: sizes that would wrap, and
+		 * weights overlapping the layer widths, are rejected */
+		original.save(path, 7, &state);
+		std::vector<char> file_bytes;
+		{
+			FILE* file = fopen(path.c_str(), "rb");
+			char buffer[4096];
+			size_t n;
+			while((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+				file_bytes.insert(file_bytes.end(), buffer, buffer + n);
+			fclose(file);
+		}
+		const std::string patched_path = path + ".patched";
+		auto patched_rejected = [&] (size_t offset, uint64_t value) {
+			std::vector<char> patched = file_bytes;
+			memcpy(patched.data() + offset, &value, sizeof(value));
+			FILE* file = fopen(patched_path.c_str(), "wb");
+			fwrite(patched.data(), 1, patched.size(), file);
+			fclose(file);
+			try {
+				Stripe invalid = Stripe::load(patched_path);
+			} catch(NeuralException&) {
+				return true;
+			}
+			return false;
+		};
+		check(
+				patched_rejected(24, uint64_t(1) << 61) &&        // Neurode count
+				patched_rejected(40, 64) &&                       // Data offset, over the widths
+				patched_rejected(64, (uint64_t(1) << 61) - 1),    // First width
+				"checkpoints with overflowing or overlapping sizes are rejected"
+		);
+		std::remove(patched_path.c_str());
+
+		Gradient other_state = Gradient(Stripe(2, { 9, 4 }, 1));
+		int shape_rejections = 0;
+		try {
+			Stripe invalid = Stripe::load(path, nullptr, &other_state);
+		} catch(NeuralException&) {
+			++shape_rejections;
+		}
+		try {
+			original.save(patched_path, 7, &other_state);
+		} catch(NeuralException&) {
+			++shape_rejections;
+		}
+		check(shape_rejections == 2, "differently shaped optimizer states are rejected");
+
+		bool rejected = false;
+		FILE* truncated = fopen(path.c_str(), "r+b");
+		ftruncate(fileno(truncated), 100);
+		fclose(truncated);
+		try {
+			Stripe invalid = Stripe::load(path);
+		} catch(NeuralException&) {
+			rejected = true;
+		}
+		check(rejected, "truncated checkpoints are rejected");
+		std::remove(path.c_str());
+	}
 
-template<typename num>
-constexpr num range(
-		num value,
-		num from_lo, num from_hi,
-		num to_lo,   num to_hi
-) {
-	value *= (to_hi - to_lo);
-	value /= (from_hi - from_lo);
-	value += to_lo - from_lo;
-	return value;
 }
 
 
+
 int main(int argn, char** args) {
 	std::cout << "\033[1;93m";
 	for(double i=0; i<=1; i+=0.125)
 		std::cout << range<double>(i, 0.0, 1.0, -4.0, 4.0) << '\n';
 	std::cout << "\033[m";
 
-	return EXIT_FAILURE;
+	std::cout << "Kernels: " << kernel::name(kernel::instruction_set()) << '\n';
+	test_kernels();
+	test_approximations();
+	test_precision();
+	test_quantized();
+	test_layouts();
+	test_batch();
+	test_workspace();
+	test_minibatch();
+	test_activations();
+	test_parallel();
+	test_queue();
+	test_snapshot();
+	test_matrix();
+	test_datafile();
+	test_checkpoint();
+
+	if(failures > 0) {
+		std::cout << COL_ERR << failures << " check(s) failed" COL_NONE "\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
 }
@@ -0,0 +1,126 @@
+#include "pix/canvas.hpp"
+#include "pix/threadpool.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cstdlib>
+
+#include <cmath> // ::sin(...), ::cos(...), ::tanh(...)
+
+
+
+namespace {
+
+	constexpr unsigned CANVAS_SIZE = 512;
+	constexpr unsigned TILE_SIZE = 64;
+	constexpr double MIN_BENCH_S = 0.5;
+
+
+	/* Repeats the function until at least MIN_BENCH_S seconds
+	 * have passed, and returns the average time of a call */
+	template<typename Func>
+	double measure(Func f) {
+		using clock = std::chrono::steady_clock;
+		size_t runs = 0;
+		auto begin = clock::now();
+		std::chrono::duration<double> elapsed;
+		do {
+			f();
+			++runs;
+			elapsed = clock::now() - begin;
+		} while(elapsed.count() < MIN_BENCH_S);
+		return elapsed.count() / runs;
+	}
+
+
+	/* A decision surface as costly as a small network's:
+	 * a few transcendental functions per pixel */
+	inline float field(unsigned x, unsigned y) {
+		double fx = (static_cast<double>(x) - (CANVAS_SIZE/2)) / (CANVAS_SIZE/2);
+		double fy = (static_cast<double>(y) - (CANVAS_SIZE/2)) / (CANVAS_SIZE/2);
+		double sum = 0.0;
+		for(unsigned i=1; i <= 8; ++i)
+			sum += ::tanh((::sin(fx * i) * 3.0) + (::cos(fy * i) * 2.0));
+		return static_cast<float>(sum / 8.0);
+	}
+
+	glm::vec4 color_pixel(void*, unsigned x, unsigned y) {
+		float value = field(x, y);
+		return glm::vec4(value, 0.5f, -value, 1.0f);
+	}
+
+	void color_tile(void*, const Tile& tile) {
+		for(unsigned y=0; y < tile.height; ++y) {
+			float* row = tile.pixels + (y * tile.stride);
+			for(unsigned x=0; x < tile.width; ++x) {
+				float value = field(tile.x + x, tile.y + y);
+				row[(4 * x) + 0] = value;
+				row[(4 * x) + 1] = 0.5f;
+				row[(4 * x) + 2] = -value;
+				row[(4 * x) + 3] = 1.0f;
+			}
+		}
+	}
+
+
+	/* Reports the throughput of the pool for increasing thread
+	 * counts, against the serial overload; the efficiency is the
+	 * speedup over the serial path, divided by the number of threads
+	 * that can run at once. Beyond the number of cores, the threads
+	 * only share them: the efficiency then shows the pool's overhead */
+	template<typename Serial, typename Pooled>
+	void bench_scaling(
+			const char* name, size_t cores, size_t max_threads,
+			Serial serial, Pooled pooled
+	) {
+		constexpr double PIXELS = static_cast<double>(CANVAS_SIZE) * CANVAS_SIZE;
+		std::cout << '\n' << name << ", " << CANVAS_SIZE << 'x' << CANVAS_SIZE << " pixels\n";
+		double single = measure(serial);
+		std::cout
+				<< std::setw(15) << std::left << "   serial"
+				<< std::setw(14) << std::right << std::fixed << std::setprecision(0)
+				<< (PIXELS / single) << " px/s\n";
+
+		std::vector<size_t> thread_counts;
+		for(size_t threads = 1; threads < max_threads; threads *= 2)
+			thread_counts.push_back(threads);
+		thread_counts.push_back(max_threads);
+
+		for(size_t threads : thread_counts) {
+			ThreadPool pool = ThreadPool(threads);
+			double frame = measure([&] () { pooled(pool); });
+			std::cout
+					<< std::setw(4) << std::right << threads << " thread(s)"
+					<< std::setw(15) << std::fixed << std::setprecision(0)
+					<< (PIXELS / frame) << " px/s"
+					<< std::setw(10) << std::setprecision(2) << (single / frame) << "x"
+					<< std::setw(10) << std::setprecision(1)
+					<< (100.0 * single / (frame * std::min(threads, cores))) << "% efficiency\n";
+		}
+	}
+
+}
+
+
+
+/* bin/pixbench [max. threads]: by default, up to one thread per core */
+int main(int argn, char** args) {
+	size_t cores = std::thread::hardware_concurrency();
+	if(cores < 1)  cores = 1;
+	size_t max_threads = (argn > 1)? std::strtoul(args[1], nullptr, 10) : cores;
+	if(max_threads < 1)  max_threads = 1;
+	std::cout << cores << " core(s), up to " << max_threads << " thread(s)\n";
+
+	Canvas canvas = Canvas(CANVAS_SIZE);
+	bench_scaling("computePixels", cores, max_threads,
+			[&] () { canvas.computePixels(nullptr, color_pixel); },
+			[&] (ThreadPool& pool) { canvas.computePixels(nullptr, color_pixel, pool); });
+	bench_scaling("computeTiles", cores, max_threads,
+			[&] () { canvas.computeTiles(nullptr, color_tile, TILE_SIZE); },
+			[&] (ThreadPool& pool) { canvas.computeTiles(nullptr, color_tile, pool, TILE_SIZE); });
+	return EXIT_SUCCESS;
+}
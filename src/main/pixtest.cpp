@@ -0,0 +1,613 @@
+#include "pix/region.hpp"
+#include "pix/ring.hpp"
+#include "pix/pixels.hpp"
+#include "pix/canvas.hpp"
+#include "pix/frame.hpp"
+#include "pix/refine.hpp"
+#include "pix/adaptive.hpp"
+#include "pix/scheduler.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <cstdio>
+
+#define COL_OK    "\033[1;92m"
+#define COL_ERR   "\033[1;91m"
+#define COL_NONE  "\033[m"
+
+
+
+namespace {
+
+	unsigned failures = 0;
+
+
+	void check(bool condition, const std::string& what) {
+		if(condition) {
+			std::cout << COL_OK "[ OK ] " COL_NONE << what << '\n';
+		} else {
+			std::cout << COL_ERR "[FAIL] " COL_NONE << what << '\n';
+			++failures;
+		}
+	}
+
+	bool same(const Rect& r, unsigned x, unsigned y, unsigned w, unsigned h) {
+		return (r.x == x) && (r.y == y) && (r.width == w) && (r.height == h);
+	}
+
+	// Whether every dirty pixel is covered exactly once
+	bool covers(const DirtyRegion& region, const std::vector<bool>& expected) {
+		unsigned w = region.getWidth();
+		std::vector<unsigned> count = std::vector<unsigned>(expected.size(), 0);
+		for(const Rect& r : region.rects()) {
+			if((r.x + r.width > w) || (r.y + r.height > region.getHeight()))  return false;
+			for(unsigned y = r.y; y < r.y + r.height; ++y)
+				for(unsigned x = r.x; x < r.x + r.width; ++x)
+					++count[x + (y * w)];
+		}
+		for(size_t i=0; i < expected.size(); ++i)
+			if(count[i] > 1 || (expected[i] && count[i] == 0))  return false;
+		return true;
+	}
+
+
+	void test_region() {
+		DirtyRegion region = DirtyRegion(70, 45, 16);
+		check(region.empty() && region.rects().empty(), "new regions are clean");
+
+		region.add(3, 4);
+		std::vector<Rect> rects = region.rects();
+		check((rects.size() == 1) && same(rects[0], 0, 0, 16, 16), "a pixel dirties its tile");
+
+		region.add(69, 44);
+		region.add(1000, 5);
+		rects = region.rects();
+		check(
+				(rects.size() == 2) && same(rects[1], 64, 32, 6, 13),
+				"the rectangles are clipped, and pixels outside are ignored"
+		);
+
+		region.clear();
+		region.add(Rect { 20, 10, 30, 30 });
+		rects = region.rects();
+		check(
+				(rects.size() == 1) && same(rects[0], 16, 0, 48, 45),
+				"adjacent rows of tiles are merged"
+		);
+
+		region.addAll();
+		rects = region.rects();
+		check(region.full() && (rects.size() == 1) && same(rects[0], 0, 0, 70, 45), "full regions are one rectangle");
+		region.clear();
+		check(region.empty(), "clear resets the region");
+
+		/* Scattered pixels, as drawn by nncli's training points */
+		std::vector<bool> expected = std::vector<bool>(70 * 45, false);
+		unsigned seed = 12345;
+		for(unsigned i=0; i < 40; ++i) {
+			seed = (seed * 1103515245) + 12345;
+			unsigned x = (seed >> 8) % 70;
+			unsigned y = (seed >> 20) % 45;
+			region.add(x, y);
+			expected[x + (y * 70)] = true;
+		}
+		check(covers(region, expected), "the rectangles cover every dirty pixel once");
+	}
+
+
+
+	/* Stands for the GPU: buffers are plain memory, and fences are
+	 * signaled when the test says the GPU is done with them */
+	struct MockBackend {
+		using buffer_t = unsigned;
+		using fence_t = unsigned;
+
+		std::vector<std::vector<char>> memory;
+		std::vector<bool> signaled;
+		unsigned live_buffers = 0;
+		unsigned live_fences = 0;
+		unsigned waits = 0;
+
+		buffer_t createBuffer(size_t bytes, void** mapping) {
+			memory.push_back(std::vector<char>(bytes));
+			*mapping = memory.back().data();
+			++live_buffers;
+			return memory.size() - 1;
+		}
+
+		void destroyBuffer(buffer_t) { --live_buffers; }
+
+		fence_t insertFence() {
+			signaled.push_back(false);
+			++live_fences;
+			return signaled.size() - 1;
+		}
+
+		// A real backend would block until the fence is signaled
+		bool waitFence(fence_t f) {
+			++waits;
+			bool blocked = ! signaled[f];
+			signaled[f] = true;
+			return blocked;
+		}
+
+		void deleteFence(fence_t) { --live_fences; }
+
+		void signalAll() {
+			for(size_t i=0; i < signaled.size(); ++i)  signaled[i] = true;
+		}
+	};
+
+	void test_ring() {
+		MockBackend backend;
+		{
+			BufferRing<MockBackend> ring = BufferRing<MockBackend>(backend, 3, 256);
+			check((backend.live_buffers == 3) && (ring.slotCount() == 3), "the ring creates its buffers once");
+
+			bool rotates = true;
+			for(unsigned i=0; i < 3; ++i) {
+				void* mapping = ring.acquire();
+				rotates = rotates && (ring.buffer() == i) && (mapping == backend.memory[i].data());
+				ring.submit();
+			}
+			check(
+					rotates && (backend.waits == 0) && (backend.live_fences == 3),
+					"fresh slots are used in turn, without waiting"
+			);
+
+			/* The GPU has not read the first slot yet */
+			ring.acquire();
+			check((ring.stallCount() == 1) && (backend.live_fences == 2), "reusing a busy slot waits for its fence");
+			ring.submit();
+
+			backend.signalAll();
+			ring.acquire();
+			ring.submit();
+			check(
+					(ring.stallCount() == 1) && (backend.waits == 2) && (ring.buffer() == 2),
+					"reusing a released slot does not stall"
+			);
+		}
+		check(
+				(backend.live_buffers == 0) && (backend.live_fences == 0),
+				"the ring releases its buffers and pending fences"
+		);
+	}
+
+
+
+	/* The vectorized loops only handle whole vectors: converting
+	 * values one at a time goes through the scalar code, which
+	 * must give exactly the same results */
+	void test_pack() {
+		std::vector<float> values;
+		for(int i = -300; i <= 1300; ++i)
+			values.push_back(i / 1000.0f);
+		for(float special : {
+				0.0f, -0.0f, 1e-30f, 6e-8f, 3e-5f, 65504.0f, 65519.0f, 65520.0f, 1e10f,
+				std::numeric_limits<float>::infinity(),
+				-std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::quiet_NaN() })
+			values.push_back(special);
+		size_t n = values.size();
+
+		std::vector<uint8_t> bytes = std::vector<uint8_t>(n);
+		std::vector<uint16_t> halves = std::vector<uint16_t>(n);
+		pack_rgba8(values.data(), bytes.data(), n);
+		pack_rgba16f(values.data(), halves.data(), n);
+		bool same8 = true;
+		bool same16 = true;
+		for(size_t i=0; i < n; ++i) {
+			uint8_t b;
+			uint16_t h;
+			pack_rgba8(&values[i], &b, 1);
+			pack_rgba16f(&values[i], &h, 1);
+			same8 = same8 && (b == bytes[i]);
+			same16 = same16 && (h == halves[i]);
+		}
+		check(same8 && same16, "packing gives the same results with and without vectors");
+
+		bool exact8 = (bytes[300] == 0) && (bytes[1300] == 255) && (bytes[0] == 0) && (bytes[n-1] == 0);
+		for(size_t i=0; i < n; ++i) {
+			float v = values[i];
+			if((v >= 0.0f) && (v <= 1.0f))
+				exact8 = exact8 && (bytes[i] == static_cast<uint8_t>(std::lround(v * 255.0f)));
+		}
+		check(exact8, "bytes are rounded and clamped");
+
+		std::vector<uint16_t> every_half;
+		for(uint32_t h=0; h < 0x10000; ++h)
+			every_half.push_back(h);
+		std::vector<float> unpacked = std::vector<float>(every_half.size());
+		unpack_rgba16f(every_half.data(), unpacked.data(), every_half.size());
+		bool same_unpack = true;
+		bool round_trip = true;
+		for(size_t i=0; i < every_half.size(); ++i) {
+			float f;
+			unpack_rgba16f(&every_half[i], &f, 1);
+			same_unpack = same_unpack && (std::memcmp(&f, &unpacked[i], sizeof(f)) == 0);
+			uint16_t back;
+			pack_rgba16f(&unpacked[i], &back, 1);
+			round_trip = round_trip && (std::isnan(f) || (back == every_half[i]));
+		}
+		check(same_unpack, "every half unpacks the same with and without vectors");
+		check(round_trip, "every half survives a round trip");
+
+		bool accurate = true;
+		for(size_t i=0; i < 1601; ++i) {
+			float back;
+			unpack_rgba16f(&halves[i], &back, 1);
+			accurate = accurate && (std::fabs(back - values[i]) <= std::fabs(values[i]) / 2048.0f);
+		}
+		check(accurate, "halves are rounded to nearest");
+	}
+
+
+	glm::vec4 gradient(unsigned x, unsigned y) {
+		return glm::vec4(x / 64.0f, y / 64.0f, 0.5f, 1.0f);
+	}
+
+	// Only computes the even columns: the others keep their color
+	void even_columns(void*, const Tile& tile) {
+		for(unsigned y=0; y < tile.height; ++y)
+			for(unsigned x = (tile.x % 2); x < tile.width; x += 2) {
+				float* ptr = tile.pixels + (y * tile.stride) + (4 * x);
+				glm::vec4 c = gradient(tile.x + x, tile.y + y);
+				ptr[0] = c[0];  ptr[1] = c[1];  ptr[2] = c[2];  ptr[3] = c[3];
+			}
+	}
+
+	void test_canvas() {
+		ThreadPool pool = ThreadPool(3);
+		for(PixelFormat format : { PixelFormat::RGBA8, PixelFormat::RGBA16F, PixelFormat::RGBA32F }) {
+			const char* name =
+				(format == PixelFormat::RGBA8)? "RGBA8" :
+				(format == PixelFormat::RGBA16F)? "RGBA16F" : "RGBA32F";
+			float epsilon =
+				(format == PixelFormat::RGBA8)? 0.501f / 255.0f :
+				(format == PixelFormat::RGBA16F)? 1.0f / 2048.0f : 0.0f;
+			auto near = [epsilon] (glm::vec4 a, glm::vec4 b) {
+				for(unsigned i=0; i < 4; ++i)
+					if(std::fabs(a[i] - b[i]) > epsilon)  return false;
+				return true;
+			};
+
+			Canvas canvas = Canvas(37, 21, format);
+			glm::vec4 background = glm::vec4(0.25f, 0.5f, 0.75f, 1.0f);
+			canvas.fill(background);
+			glm::vec4 color = glm::vec4(0.1f, 0.2f, 0.3f, 0.4f);
+			canvas.setPixel(3, 4, color);
+			check(
+					near(canvas.getPixel(3, 4), color) && near(canvas.getPixel(36, 20), background),
+					std::string("setPixel and getPixel keep their values (") + name + ")"
+			);
+
+			canvas.fill(background);
+			canvas.computeTiles(nullptr, even_columns, 8);
+			bool tiles = true;
+			for(unsigned y=0; y < 21; ++y)
+				for(unsigned x=0; x < 37; ++x)
+					tiles = tiles && near(canvas.getPixel(x, y), (x % 2 == 0)? gradient(x, y) : background);
+			check(tiles, std::string("tiles see the pixels they do not compute (") + name + ")");
+
+			Canvas serial = Canvas(37, 21, format);
+			serial.computePixels(gradient);
+			canvas.computePixels(gradient, pool);
+			bool same = true;
+			for(unsigned y=0; y < 21; ++y)
+				for(unsigned x=0; x < 37; ++x) {
+					glm::vec4 a = canvas.getPixel(x, y);
+					glm::vec4 b = serial.getPixel(x, y);
+					for(unsigned i=0; i < 4; ++i)
+						same = same && (a[i] == b[i]);
+				}
+			check(same, std::string("parallel computePixels matches the serial one (") + name + ")");
+		}
+	}
+
+
+	// Computes the pixels of the frame as their own coordinates
+	void refine_tile(void* data, const Tile& tile) {
+		const Refinement& refinement = *static_cast<const Refinement*>(data);
+		for(unsigned y=0; y < tile.height; ++y)
+			for(unsigned x=0; x < tile.width; ++x) {
+				if(! refinement.computes(tile.x + x, tile.y + y))  continue;
+				float* ptr = tile.pixels + (y * tile.stride) + (4 * x);
+				ptr[0] = tile.x + x;  ptr[1] = tile.y + y;  ptr[2] = 0.0f;  ptr[3] = 1.0f;
+			}
+		refinement.fillTile(tile);
+	}
+
+	void test_refine() {
+		Refinement refinement = Refinement(10);
+		unsigned side = refinement.blockSide();
+		check((refinement.passCount() == 16) && (side == 4), "pass counts are rounded up to powers of 4");
+
+		std::vector<bool> seen = std::vector<bool>(16, false);
+		bool permutation = true, grid = true;
+		for(unsigned y=0; y < side; ++y)
+			for(unsigned x=0; x < side; ++x) {
+				unsigned r = refinement.rank(x, y);
+				permutation = permutation && (r < 16) && ! seen[r];
+				if(r < 16)  seen[r] = true;
+				grid = grid && ((r == 0) == ((x % 4 == 0) && (y % 4 == 0)));
+				grid = grid && ((r < 4) == ((x % 2 == 0) && (y % 2 == 0)));
+			}
+		check(permutation && grid, "passes go from coarse grids to finer ones");
+
+		/* Every pixel is computed exactly once per cycle, and the
+		 * first cycle shows the closest computed pixel elsewhere */
+		Canvas canvas = Canvas(37, 21, PixelFormat::RGBA32F);
+		canvas.fill(glm::vec4(-1.0f));
+		std::vector<unsigned> computed = std::vector<unsigned>(37 * 21, 0);
+		bool filled = true;
+		for(unsigned frame=0; frame < 16; ++frame) {
+			refinement.beginFrame();
+			for(unsigned y=0; y < 21; ++y)
+				for(unsigned x=0; x < 37; ++x)
+					if(refinement.computes(x, y))  ++computed[(y * 37) + x];
+			canvas.computeTiles(&refinement, refine_tile, 8);
+			refinement.endFrame(0.001);
+			for(unsigned y=0; y < 21; ++y)
+				for(unsigned x=0; x < 37; ++x) {
+					glm::vec4 c = canvas.getPixel(x, y);
+					unsigned sx = c[0], sy = c[1];
+					/* The source is in the same block, and
+					 * was computed by one of the passes so far */
+					filled = filled && (c[3] == 1.0f) &&
+						(sx / 4 == x / 4) && (sy / 4 == y / 4) &&
+						(refinement.rank(sx, sy) <= frame) &&
+						((refinement.rank(x, y) > frame) || ((sx == x) && (sy == y)));
+				}
+		}
+		bool once = true;
+		for(unsigned c : computed)  once = once && (c == 1);
+		check(once, "a cycle computes every pixel exactly once");
+		check(filled, "the first cycle fills pixels from computed ones");
+		check(! refinement.coarse(), "the refinement is complete after a cycle");
+
+		refinement.beginFrame(0.0045);
+		check(refinement.framePasses() == 4, "the time budget decides the passes of a frame");
+		refinement.endFrame(0.004);
+		refinement.beginFrame(1.0);
+		check(refinement.framePasses() == 16, "a frame computes at most a cycle");
+		refinement.endFrame(0.016);
+
+		Refinement full = Refinement(1);
+		full.beginFrame();
+		check(full.computes(5, 7) && (full.passCount() == 1), "a single pass computes every pixel");
+
+		bool up_to_date = refinement.upToDate();
+		refinement.invalidate();
+		unsigned frames = 0;
+		while(! refinement.upToDate() && (frames < 100)) {
+			refinement.beginFrame(0.0045);
+			refinement.endFrame(0.004);
+			++frames;
+		}
+		check(up_to_date && (frames == 4), "an invalidated refinement is up to date after a cycle");
+	}
+
+
+	// A steep zero crossing along a circle, flat elsewhere
+	void circle_field(void* data, const unsigned* coords, size_t count, double* values) {
+		for(size_t i=0; i < count; ++i) {
+			double dx = coords[2*i] - 200.3;
+			double dy = coords[(2*i)+1] - 180.7;
+			values[i] = std::tanh((std::sqrt((dx*dx) + (dy*dy)) - 120.0) / 4.0);
+		}
+		if(data != nullptr)  *static_cast<size_t*>(data) += count;
+	}
+
+	void plane_field(void*, const unsigned* coords, size_t count, double* values) {
+		for(size_t i=0; i < count; ++i)
+			values[i] = ((0.3 * coords[2*i]) - (0.7 * coords[(2*i)+1]) + 20.0) / 1000.0;
+	}
+
+	void test_adaptive() {
+		AdaptiveSampler sampler = AdaptiveSampler(8, 0.05);
+		const unsigned size = 256;
+		std::vector<double> values = std::vector<double>(size * size);
+		size_t calls = 0;
+		size_t evaluated = sampler.sample(Rect { 0, 0, size, size }, &calls, circle_field, values.data());
+		size_t wrong_sign = 0;
+		double max_error = 0.0;
+		for(unsigned y=0; y < size; ++y)
+			for(unsigned x=0; x < size; ++x) {
+				unsigned c[2] = { x, y };
+				double exact;
+				circle_field(nullptr, c, 1, &exact);
+				double v = values[(y * size) + x];
+				wrong_sign += ((exact > 0.0) != (v > 0.0));
+				max_error = std::fmax(max_error, std::fabs(exact - v));
+			}
+		check(evaluated == calls, "the sampler counts the evaluated pixels");
+		check(evaluated * 8 < size * size, "smooth cells are interpolated instead of evaluated");
+		check(wrong_sign == 0, "the sign of the field is exact at every pixel");
+		check(max_error < 0.05, "interpolated values are close to the field");
+
+		std::vector<double> plane = std::vector<double>(37 * 21);
+		evaluated = sampler.sample(Rect { 5, 3, 37, 21 }, nullptr, plane_field, plane.data());
+		bool exact = true;
+		for(unsigned y=0; y < 21; ++y)
+			for(unsigned x=0; x < 37; ++x) {
+				double expected = ((0.3 * (x + 5)) - (0.7 * (y + 3)) + 20.0) / 1000.0;
+				exact = exact && (std::fabs(plane[(y * 37) + x] - expected) < 1e-12);
+			}
+		check(exact && (evaluated == 6 * 4), "planes are interpolated exactly from the grid's corners");
+
+		std::vector<double> line = std::vector<double>(19);
+		sampler.sample(Rect { 190, 60, 1, 19 }, nullptr, circle_field, line.data());
+		bool column = true;
+		for(unsigned y=0; y < 19; ++y) {
+			unsigned c[2] = { 190, 60 + y };
+			double e;
+			circle_field(nullptr, c, 1, &e);
+			column = column && ((e > 0.0) == (line[y] > 0.0));
+		}
+		check(column, "areas one pixel wide are sampled");
+	}
+
+
+	void test_scheduler() {
+		FrameScheduler scheduler = FrameScheduler(0.01, 100.0);
+		check(scheduler.due(100.0) && (scheduler.waitTime(99.996) > 0.0039), "the first frame is due at once");
+
+		/* Phases of 1, 4 and 2 ms */
+		scheduler.beginFrame(100.0);
+		scheduler.beginPhase(0, 100.0);
+		scheduler.beginPhase(1, 100.001);
+		scheduler.beginPhase(2, 100.005);
+		scheduler.endFrame(100.007);
+		check(
+				std::fabs(scheduler.phaseTime(1) - 0.004) < 1e-9 &&
+				std::fabs(scheduler.phaseTime(2) - 0.002) < 1e-9 &&
+				(scheduler.phaseTime(3) == 0.0),
+				"phases are measured");
+		check(
+				! scheduler.due(100.009) && scheduler.due(100.010) &&
+				(std::fabs(scheduler.waitTime(100.007) - 0.003) < 1e-9),
+				"frames are due one interval apart");
+
+		scheduler.beginFrame(100.010);
+		scheduler.beginPhase(0, 100.010);
+		scheduler.beginPhase(1, 100.011);
+		check(
+				std::fabs(scheduler.timeLeft(1, 100.011) - (0.009 - 0.002)) < 1e-9,
+				"the time left excludes the estimates of the next phases");
+		scheduler.endFrame(100.025);
+		check(scheduler.lateFrames() == 1, "frames that end after their deadline are late");
+
+		/* Far behind: the missed frames are skipped */
+		scheduler.beginFrame(100.100);
+		check(std::fabs(scheduler.waitTime(100.100) - 0.01) < 1e-9, "late frames do not try to catch up");
+		scheduler.endFrame(100.101);
+		check(scheduler.frameCount() == 3, "frames are counted");
+	}
+
+
+	std::vector<uint8_t> read_file(const std::string& path) {
+		std::vector<uint8_t> r;
+		FILE* file = fopen(path.c_str(), "rb");
+		if(file == nullptr)  return r;
+		int c;
+		while((c = fgetc(file)) != EOF)  r.push_back(c);
+		fclose(file);
+		return r;
+	}
+
+	uint32_t get_u32(const std::vector<uint8_t>& v, size_t at) {
+		return (v[at] << 24) | (v[at+1] << 16) | (v[at+2] << 8) | v[at+3];
+	}
+
+	void test_frame() {
+		const std::string dir = "/tmp/pixtest_frame";
+		Canvas canvas = Canvas(4, 3, PixelFormat::RGBA16F);
+		canvas.fill(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+		canvas.setPixel(0, 2, glm::vec4(0.0f, 0.0f, 1.0f, 0.0f)); // Top left, transparent
+		canvas.setPixel(3, 0, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Bottom right
+
+		{
+			FrameWriter writer = FrameWriter(dir + ".ppm", FrameFormat::PPM);
+			writer.write(canvas);
+			std::vector<uint8_t> ppm = read_file(dir + ".ppm");
+			const char* header = "P6\n4 3\n255\n";
+			size_t h = std::strlen(header);
+			check(
+					(ppm.size() == h + 36) && (std::memcmp(ppm.data(), header, h) == 0),
+					"PPM frames have a P6 header and 3 bytes per pixel");
+			check(
+					(ppm.size() == h + 36) &&
+					(ppm[h] == 255) && (ppm[h+1] == 255) && (ppm[h+2] == 255) &&
+					(ppm[h+33] == 0) && (ppm[h+34] == 255) && (ppm[h+35] == 0),
+					"PPM frames start from the top row, over the background");
+			std::remove((dir + ".ppm").c_str());
+		}
+
+		{
+			FrameWriter writer = FrameWriter(dir + "_%u.png", FrameFormat::PNG);
+			writer.write(canvas);
+			writer.write(canvas);
+			std::vector<uint8_t> png = read_file(dir + "_1.png");
+			const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+			size_t raw = 3 * (1 + 16);
+			check(
+					(png.size() == 8 + 25 + (12 + 2 + 5 + raw + 4) + 12) &&
+					(std::memcmp(png.data(), signature, 8) == 0) &&
+					(get_u32(png, 16) == 4) && (get_u32(png, 20) == 3) &&
+					(png[24] == 8) && (png[25] == 6),
+					"PNG frames are numbered, with an RGBA8 header");
+			bool pixels = (png.size() > 8 + 25 + 8 + 2 + 5 + raw);
+			for(unsigned y=0; pixels && (y < 3); ++y) {
+				const uint8_t* row = png.data() + 8 + 25 + 8 + 2 + 5 + (y * 17);
+				pixels = pixels && (row[0] == 0);
+				pixels = pixels && (row[1 + (4 * 3) + 1] == ((y == 2)? 255 : 0));
+				pixels = pixels && (row[1 + 3] == ((y == 0)? 0 : 255));
+			}
+			check(pixels, "PNG frames hold the canvas' rows, from the top");
+			check(read_file(dir + "_0.png").size() == png.size(), "PNG frames do not overwrite each other");
+			std::remove((dir + "_0.png").c_str());
+			std::remove((dir + "_1.png").c_str());
+		}
+
+		{
+			{
+				FrameWriter writer = FrameWriter(dir + ".raw", FrameFormat::RAW);
+				writer.write(canvas);
+				writer.write(canvas);
+			}
+			check(read_file(dir + ".raw").size() == 2 * 48, "raw frames are appended to a single stream");
+			std::remove((dir + ".raw").c_str());
+		}
+
+		bool threw = false;
+		try {
+			FrameWriter writer = FrameWriter("/nonexistent/frame.png", FrameFormat::PNG);
+			writer.write(canvas);
+		} catch(FrameException&) {
+			threw = true;
+		}
+		check(threw, "unwritable frames throw a FrameException");
+
+		{
+			FrameWriter writer = FrameWriter(dir + "_100%%_%03d.ppm", FrameFormat::PPM);
+			writer.write(canvas);
+			check(read_file(dir + "_100%_000.ppm").size() > 0, "frame paths keep literal '%' and pad the index");
+			std::remove((dir + "_100%_000.ppm").c_str());
+		}
+
+		unsigned rejected = 0;
+		for(const char* pattern : { "_%s.png", "_%n.png", "_%u_%u.png", "_100%.png", "_%" }) {
+			try {
+				FrameWriter writer = FrameWriter(dir + pattern, FrameFormat::PNG);
+			} catch(FrameException&) {
+				++rejected;
+			}
+		}
+		check(rejected == 5, "frame paths with other conversions are rejected");
+	}
+
+}
+
+
+
+int main(int argn, char** args) {
+	test_region();
+	test_ring();
+	test_pack();
+	test_canvas();
+	test_refine();
+	test_adaptive();
+	test_scheduler();
+	test_frame();
+
+	if(failures > 0) {
+		std::cout << COL_ERR << failures << " check(s) failed" COL_NONE "\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
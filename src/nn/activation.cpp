@@ -0,0 +1,410 @@
+#include "nn/activation.hpp"
+#include "nn/kernels.hpp"
+
+#include <cstdint>
+#include <cstring> // memcpy(...)
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define NN_ACTIVATION_X86
+	#include <immintrin.h>
+#endif
+
+
+
+/* exp(x) = 2^k * exp(r), with k = round(x / ln2) and |r| <= ln2/2;
+ * exp(r) is a truncated Taylor series, whose degree depends on the
+ * accuracy, and 2^k is built directly from its exponent bits.
+ * tanh and the logistic function are derived from exp(-2|x|) and exp(-x),
+ * so that the intermediate values never overflow.
+ * The vectorized implementations pad the tail of the arrays,
+ * so that every element goes through the same code. */
+
+namespace {
+
+	using nn::activation::Accuracy;
+
+	constexpr double EXP_COEFFS[] = {
+		1.0, 1.0, 1.0 / 2.0, 1.0 / 6.0, 1.0 / 24.0, 1.0 / 120.0, 1.0 / 720.0,
+		1.0 / 5040.0, 1.0 / 40320.0, 1.0 / 362880.0, 1.0 / 3628800.0,
+		1.0 / 39916800.0, 1.0 / 479001600.0
+	};
+
+	template<typename T> struct Constants;
+
+	template<> struct Constants<double> {
+		using Bits = uint64_t;
+		static constexpr double LOG2E   = 1.4426950408889634;
+		static constexpr double LN2_HI  = 6.93147180369123816490e-01; // Exact for |k| < 2^11
+		static constexpr double LN2_LO  = 1.90821492927058770002e-10;
+		static constexpr double SHIFTER = 6755399441055744.0; // 1.5 * 2^52, rounds to integers
+		static constexpr double EXP_MIN = -708.0;
+		static constexpr double EXP_MAX =  709.0;
+		static constexpr Bits BIAS = 1023;
+		static constexpr int MANTISSA = 52;
+		static constexpr int DEGREE_PRECISE = 12;
+		static constexpr int DEGREE_FAST    = 7;
+		static constexpr int DEGREE_FASTEST = 4;
+	};
+
+	/* Single precision runs out of bits sooner:
+	 * PRECISE and FAST are both as accurate as a float allows */
+	template<> struct Constants<float> {
+		using Bits = uint32_t;
+		static constexpr float LOG2E   = 1.44269504f;
+		static constexpr float LN2_HI  = 0.693359375f; // Exact for |k| < 2^8
+		static constexpr float LN2_LO  = -2.12194440e-4f;
+		static constexpr float SHIFTER = 12582912.0f; // 1.5 * 2^23
+		static constexpr float EXP_MIN = -87.0f;
+		static constexpr float EXP_MAX =  88.0f;
+		static constexpr Bits BIAS = 127;
+		static constexpr int MANTISSA = 23;
+		static constexpr int DEGREE_PRECISE = 7;
+		static constexpr int DEGREE_FAST    = 6;
+		static constexpr int DEGREE_FASTEST = 4;
+	};
+
+	using D = Constants<double>;
+	using S = Constants<float>;
+
+	enum class Curve { EXP, TANH, LOGISTIC };
+
+	template<typename T>
+	using evaluate_func = void (*)(const T* x, T* y, T* dy, size_t n);
+
+
+	template<typename T, int DEGREE>
+	T exp_scalar(T x) {
+		using C = Constants<T>;
+		x = (x < C::EXP_MIN)? C::EXP_MIN : ((x > C::EXP_MAX)? C::EXP_MAX : x);
+		T t = (x * C::LOG2E) + C::SHIFTER;
+		T k = t - C::SHIFTER;
+		T r = (x - (k * C::LN2_HI)) - (k * C::LN2_LO);
+		T p = static_cast<T>(EXP_COEFFS[DEGREE]);
+		for(int i = DEGREE-1; i >= 0; --i)
+			p = (p * r) + static_cast<T>(EXP_COEFFS[i]);
+		typename C::Bits bits;
+		memcpy(&bits, &t, sizeof(bits));
+		bits = (bits + C::BIAS) << C::MANTISSA;
+		T scale;
+		memcpy(&scale, &bits, sizeof(scale));
+		return p * scale;
+	}
+
+	template<typename T, Curve F, int DEGREE>
+	void function_scalar(T x, T& y, T& dy) {
+		if constexpr(F == Curve::EXP) {
+			y = exp_scalar<T, DEGREE>(x);
+			dy = y;
+		} else if constexpr(F == Curve::TANH) {
+			T e = exp_scalar<T, DEGREE>(T(-2) * ((x < 0)? -x : x));
+			y = (T(1) - e) / (T(1) + e);
+			if(x < 0)  y = -y;
+			dy = T(1) - (y*y);
+		} else {
+			y = T(1) / (T(1) + exp_scalar<T, DEGREE>(-x));
+			dy = y * (T(1) - y);
+		}
+	}
+
+	template<typename T, Curve F, int DEGREE>
+	void evaluate_scalar(const T* x, T* y, T* dy, size_t n) {
+		for(size_t i=0; i < n; ++i) {
+			T value, deriv;
+			function_scalar<T, F, DEGREE>(x[i], value, deriv);
+			y[i] = value;
+			if(dy != nullptr)  dy[i] = deriv;
+		}
+	}
+
+
+	#ifdef NN_ACTIVATION_X86
+
+		template<int DEGREE>
+		__attribute__((target("avx2,fma")))
+		inline __m256d exp_avx2(__m256d x) {
+			x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(D::EXP_MIN)), _mm256_set1_pd(D::EXP_MAX));
+			__m256d t = _mm256_fmadd_pd(x, _mm256_set1_pd(D::LOG2E), _mm256_set1_pd(D::SHIFTER));
+			__m256d k = _mm256_sub_pd(t, _mm256_set1_pd(D::SHIFTER));
+			__m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(D::LN2_HI), x);
+			r = _mm256_fnmadd_pd(k, _mm256_set1_pd(D::LN2_LO), r);
+			__m256d p = _mm256_set1_pd(EXP_COEFFS[DEGREE]);
+			for(int i = DEGREE-1; i >= 0; --i)
+				p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_COEFFS[i]));
+			__m256i bits = _mm256_add_epi64(_mm256_castpd_si256(t), _mm256_set1_epi64x(D::BIAS));
+			return _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(bits, D::MANTISSA)));
+		}
+
+		template<int DEGREE>
+		__attribute__((target("avx2,fma")))
+		inline __m256 exp_avx2(__m256 x) {
+			x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(S::EXP_MIN)), _mm256_set1_ps(S::EXP_MAX));
+			__m256 t = _mm256_fmadd_ps(x, _mm256_set1_ps(S::LOG2E), _mm256_set1_ps(S::SHIFTER));
+			__m256 k = _mm256_sub_ps(t, _mm256_set1_ps(S::SHIFTER));
+			__m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(S::LN2_HI), x);
+			r = _mm256_fnmadd_ps(k, _mm256_set1_ps(S::LN2_LO), r);
+			__m256 p = _mm256_set1_ps(EXP_COEFFS[DEGREE]);
+			for(int i = DEGREE-1; i >= 0; --i)
+				p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_COEFFS[i]));
+			__m256i bits = _mm256_add_epi32(_mm256_castps_si256(t), _mm256_set1_epi32(S::BIAS));
+			return _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(bits, S::MANTISSA)));
+		}
+
+		template<Curve F, int DEGREE>
+		__attribute__((target("avx2,fma")))
+		inline void function_avx2(__m256d x, __m256d& y, __m256d& dy) {
+			const __m256d one = _mm256_set1_pd(1.0);
+			if constexpr(F == Curve::EXP) {
+				y = exp_avx2<DEGREE>(x);
+				dy = y;
+			} else if constexpr(F == Curve::TANH) {
+				const __m256d sign = _mm256_set1_pd(-0.0);
+				__m256d abs = _mm256_andnot_pd(sign, x);
+				__m256d e = exp_avx2<DEGREE>(_mm256_mul_pd(_mm256_set1_pd(-2.0), abs));
+				y = _mm256_div_pd(_mm256_sub_pd(one, e), _mm256_add_pd(one, e));
+				y = _mm256_or_pd(y, _mm256_and_pd(sign, x));
+				dy = _mm256_fnmadd_pd(y, y, one);
+			} else {
+				__m256d e = exp_avx2<DEGREE>(_mm256_sub_pd(_mm256_setzero_pd(), x));
+				y = _mm256_div_pd(one, _mm256_add_pd(one, e));
+				dy = _mm256_mul_pd(y, _mm256_sub_pd(one, y));
+			}
+		}
+
+		template<Curve F, int DEGREE>
+		__attribute__((target("avx2,fma")))
+		inline void function_avx2(__m256 x, __m256& y, __m256& dy) {
+			const __m256 one = _mm256_set1_ps(1.0f);
+			if constexpr(F == Curve::EXP) {
+				y = exp_avx2<DEGREE>(x);
+				dy = y;
+			} else if constexpr(F == Curve::TANH) {
+				const __m256 sign = _mm256_set1_ps(-0.0f);
+				__m256 abs = _mm256_andnot_ps(sign, x);
+				__m256 e = exp_avx2<DEGREE>(_mm256_mul_ps(_mm256_set1_ps(-2.0f), abs));
+				y = _mm256_div_ps(_mm256_sub_ps(one, e), _mm256_add_ps(one, e));
+				y = _mm256_or_ps(y, _mm256_and_ps(sign, x));
+				dy = _mm256_fnmadd_ps(y, y, one);
+			} else {
+				__m256 e = exp_avx2<DEGREE>(_mm256_sub_ps(_mm256_setzero_ps(), x));
+				y = _mm256_div_ps(one, _mm256_add_ps(one, e));
+				dy = _mm256_mul_ps(y, _mm256_sub_ps(one, y));
+			}
+		}
+
+		__attribute__((target("avx2,fma")))
+		inline __m256d load_avx2(const double* p) { return _mm256_loadu_pd(p); }
+
+		__attribute__((target("avx2,fma")))
+		inline __m256 load_avx2(const float* p) { return _mm256_loadu_ps(p); }
+
+		__attribute__((target("avx2,fma")))
+		inline void store_avx2(double* p, __m256d v) { _mm256_storeu_pd(p, v); }
+
+		__attribute__((target("avx2,fma")))
+		inline void store_avx2(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+
+		template<typename T, Curve F, int DEGREE>
+		__attribute__((target("avx2,fma")))
+		void evaluate_avx2(const T* x, T* y, T* dy, size_t n) {
+			constexpr size_t LANES = 32 / sizeof(T);
+			decltype(load_avx2(x)) value, deriv;
+			size_t i = 0;
+			for(; i+LANES <= n; i += LANES) {
+				function_avx2<F, DEGREE>(load_avx2(x+i), value, deriv);
+				store_avx2(y+i, value);
+				if(dy != nullptr)  store_avx2(dy+i, deriv);
+			}
+			if(i < n) {
+				alignas(32) T tail[3][LANES] = { };
+				size_t rest = n - i;
+				memcpy(tail[0], x+i, rest * sizeof(T));
+				function_avx2<F, DEGREE>(load_avx2(tail[0]), value, deriv);
+				store_avx2(tail[1], value);
+				store_avx2(tail[2], deriv);
+				memcpy(y+i, tail[1], rest * sizeof(T));
+				if(dy != nullptr)  memcpy(dy+i, tail[2], rest * sizeof(T));
+			}
+		}
+
+
+		/* GCC's unmasked AVX-512 intrinsics start from deliberately
+		 * undefined registers, which -Wmaybe-uninitialized reports */
+		#pragma GCC diagnostic push
+		#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+		template<int DEGREE>
+		__attribute__((target("avx512f")))
+		inline __m512d exp_avx512(__m512d x) {
+			x = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(D::EXP_MIN)), _mm512_set1_pd(D::EXP_MAX));
+			__m512d t = _mm512_fmadd_pd(x, _mm512_set1_pd(D::LOG2E), _mm512_set1_pd(D::SHIFTER));
+			__m512d k = _mm512_sub_pd(t, _mm512_set1_pd(D::SHIFTER));
+			__m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(D::LN2_HI), x);
+			r = _mm512_fnmadd_pd(k, _mm512_set1_pd(D::LN2_LO), r);
+			__m512d p = _mm512_set1_pd(EXP_COEFFS[DEGREE]);
+			for(int i = DEGREE-1; i >= 0; --i)
+				p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_COEFFS[i]));
+			__m512i bits = _mm512_add_epi64(_mm512_castpd_si512(t), _mm512_set1_epi64(D::BIAS));
+			return _mm512_mul_pd(p, _mm512_castsi512_pd(_mm512_slli_epi64(bits, D::MANTISSA)));
+		}
+
+		template<int DEGREE>
+		__attribute__((target("avx512f")))
+		inline __m512 exp_avx512(__m512 x) {
+			x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(S::EXP_MIN)), _mm512_set1_ps(S::EXP_MAX));
+			__m512 t = _mm512_fmadd_ps(x, _mm512_set1_ps(S::LOG2E), _mm512_set1_ps(S::SHIFTER));
+			__m512 k = _mm512_sub_ps(t, _mm512_set1_ps(S::SHIFTER));
+			__m512 r = _mm512_fnmadd_ps(k, _mm512_set1_ps(S::LN2_HI), x);
+			r = _mm512_fnmadd_ps(k, _mm512_set1_ps(S::LN2_LO), r);
+			__m512 p = _mm512_set1_ps(EXP_COEFFS[DEGREE]);
+			for(int i = DEGREE-1; i >= 0; --i)
+				p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_COEFFS[i]));
+			__m512i bits = _mm512_add_epi32(_mm512_castps_si512(t), _mm512_set1_epi32(S::BIAS));
+			return _mm512_mul_ps(p, _mm512_castsi512_ps(_mm512_slli_epi32(bits, S::MANTISSA)));
+		}
+
+		template<Curve F, int DEGREE>
+		__attribute__((target("avx512f")))
+		inline void function_avx512(__m512d x, __m512d& y, __m512d& dy) {
+			const __m512d one = _mm512_set1_pd(1.0);
+			if constexpr(F == Curve::EXP) {
+				y = exp_avx512<DEGREE>(x);
+				dy = y;
+			} else if constexpr(F == Curve::TANH) {
+				const __m512d zero = _mm512_setzero_pd();
+				__m512d e = exp_avx512<DEGREE>(_mm512_mul_pd(_mm512_set1_pd(-2.0), _mm512_abs_pd(x)));
+				y = _mm512_div_pd(_mm512_sub_pd(one, e), _mm512_add_pd(one, e));
+				y = _mm512_mask_sub_pd(y, _mm512_cmp_pd_mask(x, zero, _CMP_LT_OQ), zero, y);
+				dy = _mm512_fnmadd_pd(y, y, one);
+			} else {
+				__m512d e = exp_avx512<DEGREE>(_mm512_sub_pd(_mm512_setzero_pd(), x));
+				y = _mm512_div_pd(one, _mm512_add_pd(one, e));
+				dy = _mm512_mul_pd(y, _mm512_sub_pd(one, y));
+			}
+		}
+
+		template<Curve F, int DEGREE>
+		__attribute__((target("avx512f")))
+		inline void function_avx512(__m512 x, __m512& y, __m512& dy) {
+			const __m512 one = _mm512_set1_ps(1.0f);
+			if constexpr(F == Curve::EXP) {
+				y = exp_avx512<DEGREE>(x);
+				dy = y;
+			} else if constexpr(F == Curve::TANH) {
+				const __m512 zero = _mm512_setzero_ps();
+				__m512 e = exp_avx512<DEGREE>(_mm512_mul_ps(_mm512_set1_ps(-2.0f), _mm512_abs_ps(x)));
+				y = _mm512_div_ps(_mm512_sub_ps(one, e), _mm512_add_ps(one, e));
+				y = _mm512_mask_sub_ps(y, _mm512_cmp_ps_mask(x, zero, _CMP_LT_OQ), zero, y);
+				dy = _mm512_fnmadd_ps(y, y, one);
+			} else {
+				__m512 e = exp_avx512<DEGREE>(_mm512_sub_ps(_mm512_setzero_ps(), x));
+				y = _mm512_div_ps(one, _mm512_add_ps(one, e));
+				dy = _mm512_mul_ps(y, _mm512_sub_ps(one, y));
+			}
+		}
+
+		__attribute__((target("avx512f")))
+		inline __m512d load_avx512(const double* p) { return _mm512_loadu_pd(p); }
+
+		__attribute__((target("avx512f")))
+		inline __m512 load_avx512(const float* p) { return _mm512_loadu_ps(p); }
+
+		__attribute__((target("avx512f")))
+		inline void store_avx512(double* p, __m512d v) { _mm512_storeu_pd(p, v); }
+
+		__attribute__((target("avx512f")))
+		inline void store_avx512(float* p, __m512 v) { _mm512_storeu_ps(p, v); }
+
+		template<typename T, Curve F, int DEGREE>
+		__attribute__((target("avx512f")))
+		void evaluate_avx512(const T* x, T* y, T* dy, size_t n) {
+			constexpr size_t LANES = 64 / sizeof(T);
+			decltype(load_avx512(x)) value, deriv;
+			size_t i = 0;
+			for(; i+LANES <= n; i += LANES) {
+				function_avx512<F, DEGREE>(load_avx512(x+i), value, deriv);
+				store_avx512(y+i, value);
+				if(dy != nullptr)  store_avx512(dy+i, deriv);
+			}
+			if(i < n) {
+				alignas(64) T tail[3][LANES] = { };
+				size_t rest = n - i;
+				memcpy(tail[0], x+i, rest * sizeof(T));
+				function_avx512<F, DEGREE>(load_avx512(tail[0]), value, deriv);
+				store_avx512(tail[1], value);
+				store_avx512(tail[2], deriv);
+				memcpy(y+i, tail[1], rest * sizeof(T));
+				if(dy != nullptr)  memcpy(dy+i, tail[2], rest * sizeof(T));
+			}
+		}
+
+		#pragma GCC diagnostic pop
+
+	#endif
+
+
+	template<typename T, Curve F, int DEGREE>
+	evaluate_func<T> select_set() {
+		using nn::kernel::InstructionSet;
+		switch(nn::kernel::instruction_set()) {
+			#ifdef NN_ACTIVATION_X86
+				case InstructionSet::AVX512:  return evaluate_avx512<T, F, DEGREE>;
+				case InstructionSet::AVX2:    return evaluate_avx2<T, F, DEGREE>;
+			#endif
+			default:  return evaluate_scalar<T, F, DEGREE>;
+		}
+	}
+
+	/* Follows the instruction set selected by nn::kernel;
+	 * SSE2 uses the scalar implementation */
+	template<typename T, Curve F>
+	void evaluate(const T* x, T* y, T* dy, size_t n, Accuracy accuracy) {
+		using C = Constants<T>;
+		evaluate_func<T> f;
+		switch(accuracy) {
+			case Accuracy::PRECISE:  f = select_set<T, F, C::DEGREE_PRECISE>();  break;
+			case Accuracy::FASTEST:  f = select_set<T, F, C::DEGREE_FASTEST>();  break;
+			default:                 f = select_set<T, F, C::DEGREE_FAST>();     break;
+		}
+		f(x, y, dy, n);
+	}
+
+}
+
+
+
+namespace nn::activation {
+
+	void exp(const double* x, double* y, size_t n, Accuracy accuracy) {
+		evaluate<double, Curve::EXP>(x, y, nullptr, n, accuracy);
+	}
+
+	void tanh(const double* x, double* y, size_t n, Accuracy accuracy) {
+		evaluate<double, Curve::TANH>(x, y, nullptr, n, accuracy);
+	}
+
+	void tanh(const double* x, double* y, double* dy, size_t n, Accuracy accuracy) {
+		evaluate<double, Curve::TANH>(x, y, dy, n, accuracy);
+	}
+
+	void logistic(const double* x, double* y, size_t n, Accuracy accuracy) {
+		evaluate<double, Curve::LOGISTIC>(x, y, nullptr, n, accuracy);
+	}
+
+	void logistic(const double* x, double* y, double* dy, size_t n, Accuracy accuracy) {
+		evaluate<double, Curve::LOGISTIC>(x, y, dy, n, accuracy);
+	}
+
+
+	void exp(const float* x, float* y, size_t n, Accuracy accuracy) {
+		evaluate<float, Curve::EXP>(x, y, nullptr, n, accuracy);
+	}
+
+	void tanh(const float* x, float* y, size_t n, Accuracy accuracy) {
+		evaluate<float, Curve::TANH>(x, y, nullptr, n, accuracy);
+	}
+
+	void logistic(const float* x, float* y, size_t n, Accuracy accuracy) {
+		evaluate<float, Curve::LOGISTIC>(x, y, nullptr, n, accuracy);
+	}
+
+}
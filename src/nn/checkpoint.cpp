@@ -0,0 +1,237 @@
+#include "nn/nn.hpp"
+
+#include <cstdio>
+#include <cstring> // memcmp(...), memcpy(...)
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+
+/* Checkpoint layout (native endianness):
+ *
+ *   offset  size  field
+ *        0     8  magic, the characters "PIXNNCKP"
+ *        8     4  version (uint32), currently 1
+ *       12     4  activation (uint32), chosen by the caller
+ *       16     4  weight layout (uint32): 0 = row-major, 1 = column-major
+ *       20     4  flags (uint32): bit 0 = optimizer state present
+ *       24     8  neurode count N (uint64)
+ *       32     8  optimizer state sample count (uint64)
+ *       40     8  data offset (uint64)
+ *       48    16  reserved, zero
+ *       64  8N+8  layer widths (uint64): inputs, hidden layers..., outputs
+ *
+ * From the data offset, each neurode's weights and biases (as stored by
+ * Neurode, (inputs+1) * outputs doubles) start on a 64-byte boundary;
+ * the optimizer state, if present, follows with the same layout.
+ * Since mappings are page-aligned, the mapped weights are as
+ * aligned as the ones allocated by alloc_buffer. */
+
+namespace {
+
+	constexpr char MAGIC[8] = { 'P', 'I', 'X', 'N', 'N', 'C', 'K', 'P' };
+	constexpr uint32_t VERSION = 1;
+	constexpr uint32_t FLAG_OPTIMIZER_STATE = 1;
+	constexpr uint64_t ALIGNMENT = 64;
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t activation;
+		uint32_t layout;
+		uint32_t flags;
+		uint64_t neurodes;
+		uint64_t state_samples;
+		uint64_t data_offset;
+		uint64_t reserved[2];
+	};
+
+	static_assert(sizeof(Header) == 64, "checkpoint header must be 64 bytes");
+
+
+	constexpr uint64_t align(uint64_t offset) {
+		return ((offset + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT;
+	}
+
+	constexpr uint64_t block_size(uint64_t inputs, uint64_t outputs) {
+		return align((inputs + 1) * outputs * sizeof(double));
+	}
+
+	/* Like block_size, for widths read from a file: they are bounded
+	 * by the (available) bytes before being multiplied, and false is
+	 * returned if the block does not fit in them */
+	bool block_size_within(uint64_t inputs, uint64_t outputs, uint64_t available, uint64_t* size) {
+		uint64_t max_values = available / sizeof(double);
+		if((inputs >= max_values) || ((outputs > 0) && (inputs + 1 > max_values / outputs)))
+			return false;
+		*size = block_size(inputs, outputs);
+		return *size <= available;
+	}
+
+
+	void write_block(FILE* file, const void* data, size_t size, bool& ok) {
+		static const char padding[ALIGNMENT] = { };
+		ok = ok && (size == fwrite(data, 1, size, file));
+		size_t pad = align(size) - size;
+		ok = ok && (pad == fwrite(padding, 1, pad, file));
+	}
+
+}
+
+
+
+namespace nn {
+
+	void Stripe::save(
+			const std::string& path,
+			uint32_t activation,
+			const Gradient* state
+	) const {
+		if(state != nullptr) {
+			bool same_shape = (state->layerCount() == neurodes_count);
+			for(size_t i=0; same_shape && (i < neurodes_count); ++i)
+				same_shape = (*state)[i].sameShape(neurodes[i]);
+			if(! same_shape)
+				throw NeuralException("Optimizer state does not match the stripe's layers");
+		}
+
+		Header header = { };
+		memcpy(header.magic, MAGIC, sizeof(header.magic));
+		header.version = VERSION;
+		header.activation = activation;
+		header.layout = (neurodes[0].weightLayout() == WeightLayout::ROW_MAJOR)? 0 : 1;
+		header.flags = (state != nullptr)? FLAG_OPTIMIZER_STATE : 0;
+		header.neurodes = neurodes_count;
+		header.state_samples = (state != nullptr)? state->sampleCount() : 0;
+		header.data_offset = align(sizeof(Header) + ((neurodes_count + 1) * sizeof(uint64_t)));
+
+		std::vector<uint64_t> widths;  widths.reserve(neurodes_count + 1);
+		for(const Neurode& n : neurodes)
+			widths.push_back(n.inputSize());
+		widths.push_back(output_size);
+
+		/* Written next to the destination, then renamed over it,
+		 * so that readers never see a partial checkpoint */
+		std::string tmp_path = path + ".tmp";
+		FILE* file = fopen(tmp_path.c_str(), "wb");
+		if(file == nullptr)
+			throw NeuralException("Could not open \"" + tmp_path + "\" for writing");
+
+		bool ok = (1 == fwrite(&header, sizeof(header), 1, file));
+		write_block(file, widths.data(), widths.size() * sizeof(uint64_t), ok);
+		for(const Neurode& n : neurodes) {
+			size_t count = (n.inputSize() + 1) * n.outputSize();
+			write_block(file, n.weightData(), count * sizeof(double), ok);
+		}
+		if(state != nullptr) {
+			for(size_t i=0; i < neurodes_count; ++i) {
+				const Neurode& n = (*state)[i];
+				size_t count = (n.inputSize() + 1) * n.outputSize();
+				write_block(file, n.weightData(), count * sizeof(double), ok);
+			}
+		}
+		ok = (0 == fclose(file)) && ok;
+		ok = ok && (0 == rename(tmp_path.c_str(), path.c_str()));
+		if(! ok) {
+			remove(tmp_path.c_str());
+			throw NeuralException("Could not write the checkpoint \"" + path + "\"");
+		}
+	}
+
+
+	Stripe Stripe::load(
+			const std::string& path,
+			uint32_t* activation,
+			Gradient* state
+	) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw NeuralException("Could not open \"" + path + "\"");
+		struct stat st;
+		if((0 != fstat(fd, &st)) || (static_cast<uint64_t>(st.st_size) < sizeof(Header))) {
+			close(fd);
+			throw NeuralException("\"" + path + "\" is not a checkpoint");
+		}
+		size_t size = st.st_size;
+
+		/* A private mapping: training the loaded stripe copies
+		 * the modified pages, and never alters the file */
+		void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(mapping == MAP_FAILED)
+			throw NeuralException("Could not map \"" + path + "\"");
+		char* bytes = reinterpret_cast<char*>(mapping);
+
+		auto fail = [&] (const char* why) {
+			munmap(mapping, size);
+			throw NeuralException("\"" + path + "\"" + why);
+		};
+
+		Header header;
+		memcpy(&header, bytes, sizeof(header));
+		if(0 != memcmp(header.magic, MAGIC, sizeof(header.magic)))
+			fail(" is not a checkpoint");
+		if(header.version != VERSION)
+			fail(" has an unsupported version");
+		if((header.neurodes < 1) || (header.layout > 1))
+			fail(" is corrupted");
+
+		/* The header's fields come from the file: they are bounded by the
+		 * mapping before being added or multiplied, so that none can wrap */
+		if(header.neurodes >= (size - sizeof(Header)) / sizeof(uint64_t))
+			fail(" is truncated");
+		uint64_t widths_end = sizeof(Header) + ((header.neurodes + 1) * sizeof(uint64_t));
+		if(
+				(header.data_offset % ALIGNMENT != 0) ||
+				(header.data_offset < widths_end) ||
+				(header.data_offset > size)
+		) {
+			fail(" is truncated");
+		}
+
+		const uint64_t* widths = reinterpret_cast<const uint64_t*>(bytes + sizeof(Header));
+		bool has_state = (0 != (header.flags & FLAG_OPTIMIZER_STATE));
+		uint64_t available = (size - header.data_offset) / (has_state? 2 : 1);
+		uint64_t layers_size = 0;
+		for(uint64_t i=0; i < header.neurodes; ++i) {
+			uint64_t block;
+			if(! block_size_within(widths[i], widths[i+1], available - layers_size, &block))
+				fail(" is truncated");
+			layers_size += block;
+		}
+
+		WeightLayout layout = (header.layout == 0)?
+				WeightLayout::ROW_MAJOR : WeightLayout::COLUMN_MAJOR;
+		std::vector<Neurode> neurodes;  neurodes.reserve(header.neurodes);
+		uint64_t offset = header.data_offset;
+		for(uint64_t i=0; i < header.neurodes; ++i) {
+			double* weights = reinterpret_cast<double*>(bytes + offset);
+			neurodes.push_back(Neurode(widths[i], widths[i+1], layout, weights));
+			offset += block_size(widths[i], widths[i+1]);
+		}
+
+		if(state != nullptr) {
+			bool same_shape = (state->layerCount() == header.neurodes);
+			for(uint64_t i=0; same_shape && (i < header.neurodes); ++i)
+				same_shape = (*state)[i].sameShape(neurodes[i]);
+			if(! same_shape)
+				fail(" does not match the optimizer state's layers");
+			state->clear();
+			if(has_state) {
+				for(uint64_t i=0; i < header.neurodes; ++i) {
+					double* weights = reinterpret_cast<double*>(bytes + offset);
+					(*state)[i].copyWeights(Neurode(widths[i], widths[i+1], layout, weights));
+					offset += block_size(widths[i], widths[i+1]);
+				}
+				state->setSampleCount(header.state_samples);
+			}
+		}
+
+		if(activation != nullptr)  *activation = header.activation;
+		return Stripe(std::move(neurodes), mapping, size);
+	}
+
+}
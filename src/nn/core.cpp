@@ -1,6 +1,13 @@
 #include "nn/nn.hpp"
 
-#include <cstdlib> // rand()
+#include <cstdlib> // rand(), aligned_alloc(...)
+#include <new> // std::bad_alloc
+
+
+
+namespace {
+	constexpr size_t CACHE_LINE = 64;
+}
 
 
 
@@ -14,4 +21,27 @@ namespace nn {
 		return got - exp;
 	}
 
+
+	void* alloc_aligned(size_t bytes) {
+		/* aligned_alloc requires the size to be
+		 * a multiple of the alignment */
+		bytes = ((bytes + CACHE_LINE - 1) / CACHE_LINE) * CACHE_LINE;
+		if(bytes == 0)  bytes = CACHE_LINE;
+		void* r = std::aligned_alloc(CACHE_LINE, bytes);
+		if(r == nullptr)  throw std::bad_alloc();
+		return r;
+	}
+
+	void free_aligned(void* buffer) {
+		std::free(buffer);
+	}
+
+	double* alloc_buffer(size_t count) {
+		return reinterpret_cast<double*>(alloc_aligned(count * sizeof(double)));
+	}
+
+	void free_buffer(double* buffer) {
+		std::free(buffer);
+	}
+
 }
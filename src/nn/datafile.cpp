@@ -0,0 +1,208 @@
+#include "nn/datafile.hpp"
+
+#include <cstring> // memcmp(...), memcpy(...)
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+
+namespace {
+
+	int advice_for(nn::MappedDataSet::Access access) {
+		switch(access) {
+			case nn::MappedDataSet::Access::SEQUENTIAL:  return MADV_SEQUENTIAL;
+			case nn::MappedDataSet::Access::RANDOM:      return MADV_RANDOM;
+			default:                                     return MADV_NORMAL;
+		}
+	}
+
+}
+
+
+
+namespace nn {
+
+	DataFileWriter::DataFileWriter(const std::string& path, size_t in, size_t out):
+			file (fopen(path.c_str(), "wb")),
+			header ()
+	{
+		if(file == nullptr)
+			throw NeuralException("Could not open \"" + path + "\" for writing");
+		memcpy(header.magic, datafile::MAGIC, sizeof(header.magic));
+		header.version = datafile::VERSION;
+		header.dtype = datafile::DTYPE_F64;
+		header.input_size = in;
+		header.output_size = out;
+		header.rows = 0;
+		header.data_offset = datafile::HEADER_SIZE;
+		if(1 != fwrite(&header, sizeof(header), 1, file)) {
+			fclose(file);  file = nullptr;
+			throw NeuralException("Could not write the data file header");
+		}
+	}
+
+	DataFileWriter::~DataFileWriter() {
+		if(file != nullptr) {
+			try {
+				close();
+			} catch(NeuralException&) {
+				// Nothing left to report to
+			}
+		}
+	}
+
+
+	void DataFileWriter::append(const double* in, const double* out) {
+		if(file == nullptr)
+			throw NeuralException("Data file is closed");
+		if(
+				(header.input_size != fwrite(in, sizeof(double), header.input_size, file)) ||
+				(header.output_size != fwrite(out, sizeof(double), header.output_size, file))
+		) {
+			throw NeuralException("Could not write a data file row");
+		}
+		++header.rows;
+	}
+
+	void DataFileWriter::append(const DataView& data) {
+		if(
+				(data.input_size != header.input_size) ||
+				(data.output_size != header.output_size)
+		) {
+			throw NeuralException("Data does not match the data file's width");
+		}
+		for(size_t i=0; i < data.size(); ++i)
+			append(data.inputRow(i), data.outputRow(i));
+	}
+
+	void DataFileWriter::close() {
+		if(file == nullptr)  return;
+		bool ok =
+				(0 == fseek(file, 0, SEEK_SET)) &&
+				(1 == fwrite(&header, sizeof(header), 1, file));
+		ok = (0 == fclose(file)) && ok;
+		file = nullptr;
+		if(! ok)
+			throw NeuralException("Could not finalize the data file");
+	}
+
+
+	void write_data_file(const std::string& path, const DataView& data) {
+		DataFileWriter writer = DataFileWriter(path, data.input_size, data.output_size);
+		writer.append(data);
+		writer.close();
+	}
+
+}
+
+namespace nn {
+
+	MappedDataSet::MappedDataSet(const std::string& path, Access access):
+			mapping (nullptr),
+			mapping_size (0),
+			header ()
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw NeuralException("Could not open \"" + path + "\"");
+
+		struct stat st;
+		if((0 != fstat(fd, &st)) || (static_cast<uint64_t>(st.st_size) < datafile::HEADER_SIZE)) {
+			::close(fd);
+			throw NeuralException("\"" + path + "\" is not a data file");
+		}
+		mapping_size = st.st_size;
+		mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd); // The mapping keeps its own reference to the file
+		if(mapping == MAP_FAILED) {
+			mapping = nullptr;
+			throw NeuralException("Could not map \"" + path + "\"");
+		}
+
+		memcpy(&header, mapping, sizeof(header));
+		const char* error = nullptr;
+		/* The sizes are bounded by the mapping before being added and
+		 * multiplied, so that a corrupted header cannot wrap row_size */
+		uint64_t available = (header.data_offset <= mapping_size)? (mapping_size - header.data_offset) : 0;
+		uint64_t max_values = available / sizeof(double);
+		bool sizes_fit =
+			(header.input_size <= max_values) &&
+			(header.output_size <= max_values - header.input_size);
+		uint64_t row_size = sizes_fit? (header.input_size + header.output_size) * sizeof(double) : 0;
+		if(0 != memcmp(header.magic, datafile::MAGIC, sizeof(header.magic))) {
+			error = " is not a data file";
+		} else if(header.version != datafile::VERSION) {
+			error = " has an unsupported version";
+		} else if(header.dtype != datafile::DTYPE_F64) {
+			error = " has an unsupported data type";
+		} else if(
+				(header.data_offset < datafile::HEADER_SIZE) ||
+				(header.data_offset % alignof(double) != 0) ||
+				(header.data_offset > mapping_size) ||
+				! sizes_fit ||
+				((row_size > 0) && (header.rows > (mapping_size - header.data_offset) / row_size))
+		) {
+			error = " is truncated or corrupted";
+		}
+		if(error != nullptr) {
+			munmap(mapping, mapping_size);
+			mapping = nullptr;
+			throw NeuralException("\"" + path + "\"" + error);
+		}
+
+		advise(access);
+	}
+
+	MappedDataSet::MappedDataSet(MappedDataSet&& mov):
+			mapping (std::move(mov.mapping)),
+			mapping_size (std::move(mov.mapping_size)),
+			header (std::move(mov.header))
+	{
+		mov.mapping = nullptr;
+	}
+
+	MappedDataSet::~MappedDataSet() {
+		if(mapping != nullptr) {
+			munmap(mapping, mapping_size);  mapping = nullptr;
+		}
+	}
+
+	MappedDataSet& MappedDataSet::operator = (MappedDataSet&& mov) {
+		this->~MappedDataSet();
+		new (this) MappedDataSet(std::move(mov));
+		return *this;
+	}
+
+
+	void MappedDataSet::advise(Access access) {
+		madvise(mapping, mapping_size, advice_for(access));
+	}
+
+	void MappedDataSet::prefetch(size_t first, size_t rows) {
+		if(first >= header.rows)  return;
+		if(rows > header.rows - first)  rows = header.rows - first;
+
+		/* madvise(2) requires a page-aligned address */
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t row_size = (header.input_size + header.output_size) * sizeof(double);
+		size_t begin = header.data_offset + (first * row_size);
+		size_t end = begin + (rows * row_size);
+		begin -= begin % page;
+		madvise(reinterpret_cast<char*>(mapping) + begin, end - begin, MADV_WILLNEED);
+	}
+
+	DataView MappedDataSet::view() const {
+		const double* rows = reinterpret_cast<const double*>(
+				reinterpret_cast<const char*>(mapping) + header.data_offset);
+		size_t stride = header.input_size + header.output_size;
+		return DataView {
+				rows, rows + header.input_size,
+				header.input_size, header.output_size,
+				stride, stride,
+				header.rows };
+	}
+
+}
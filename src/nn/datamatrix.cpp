@@ -0,0 +1,116 @@
+#include "nn/nn.hpp"
+
+
+
+namespace nn {
+
+	DataMatrix::DataMatrix(size_t in, size_t out, size_t cap):
+			input_size (in),
+			output_size (out),
+			rows (0),
+			capacity (cap),
+			inputs (alloc_buffer(in * cap)),
+			outputs (alloc_buffer(out * cap))
+	{ }
+
+	DataMatrix::DataMatrix(size_t in, size_t out, const DataSet& ds):
+			DataMatrix::DataMatrix(in, out, ds.size())
+	{
+		for(const DataRow& row : ds)
+			append(row);
+	}
+
+	DataMatrix::DataMatrix(const DataMatrix& cpy):
+			input_size (cpy.input_size),
+			output_size (cpy.output_size),
+			rows (cpy.rows),
+			capacity (cpy.rows),
+			inputs (alloc_buffer(input_size * rows)),
+			outputs (alloc_buffer(output_size * rows))
+	{
+		for(size_t i=0; i < input_size * rows; ++i)
+			inputs[i] = cpy.inputs[i];
+		for(size_t i=0; i < output_size * rows; ++i)
+			outputs[i] = cpy.outputs[i];
+	}
+
+	DataMatrix::DataMatrix(DataMatrix&& mov):
+			input_size (std::move(mov.input_size)),
+			output_size (std::move(mov.output_size)),
+			rows (std::move(mov.rows)),
+			capacity (std::move(mov.capacity)),
+			inputs (std::move(mov.inputs)),
+			outputs (std::move(mov.outputs))
+	{
+		mov.inputs = nullptr;
+		mov.outputs = nullptr;
+		mov.rows = 0;
+		mov.capacity = 0;
+	}
+
+	DataMatrix::~DataMatrix() {
+		if(inputs != nullptr) {
+			free_buffer(inputs);  inputs = nullptr;
+			free_buffer(outputs);  outputs = nullptr;
+		}
+	}
+
+	DataMatrix& DataMatrix::operator = (const DataMatrix& cpy) {
+		this->~DataMatrix();
+		new (this) DataMatrix(cpy);
+		return *this;
+	}
+
+	DataMatrix& DataMatrix::operator = (DataMatrix&& mov) {
+		this->~DataMatrix();
+		new (this) DataMatrix(std::move(mov));
+		return *this;
+	}
+
+
+	void DataMatrix::reserve(size_t new_capacity) {
+		if(new_capacity <= capacity)  return;
+		double* new_inputs  = alloc_buffer(input_size * new_capacity);
+		double* new_outputs = alloc_buffer(output_size * new_capacity);
+		for(size_t i=0; i < input_size * rows; ++i)
+			new_inputs[i] = inputs[i];
+		for(size_t i=0; i < output_size * rows; ++i)
+			new_outputs[i] = outputs[i];
+		free_buffer(inputs);
+		free_buffer(outputs);
+		inputs = new_inputs;
+		outputs = new_outputs;
+		capacity = new_capacity;
+	}
+
+	void DataMatrix::append(const double* in, const double* out) {
+		if(rows == capacity)
+			reserve((capacity < 16)? 16 : capacity * 2);
+		double* in_row  = inputRow(rows);
+		double* out_row = outputRow(rows);
+		for(size_t i=0; i < input_size; ++i)
+			in_row[i] = in[i];
+		for(size_t i=0; i < output_size; ++i)
+			out_row[i] = out[i];
+		++rows;
+	}
+
+	void DataMatrix::append(const DataRow& row) {
+		if(
+				(row.inputs.size() != input_size) ||
+				(row.outputs.size() != output_size)
+		) {
+			throw NeuralException("Data row does not match the data matrix's width");
+		}
+		append(row.inputs.data(), row.outputs.data());
+	}
+
+	void DataMatrix::pop() {
+		if(rows > 0)  --rows;
+	}
+
+	void DataMatrix::clear() {
+		rows = 0;
+	}
+
+}
@@ -0,0 +1,39 @@
+#include "nn/nn.hpp"
+
+
+
+namespace nn {
+
+	Gradient::Gradient(const Stripe& stripe):
+			layers (),
+			samples (0)
+	{
+		layers.reserve(stripe.neurodeCount());
+		for(size_t i=0; i < stripe.neurodeCount(); ++i) {
+			layers.push_back(stripe[i]);
+			layers.back().zero();
+		}
+	}
+
+
+	void Gradient::clear() {
+		for(Neurode& layer : layers)
+			layer.zero();
+		samples = 0;
+	}
+
+	void Gradient::merge(const Gradient& other) {
+		/* Checked before anything is added, so that a mismatch
+		 * leaves this gradient as it was */
+		if(other.layers.size() != layers.size())
+			throw NeuralException("Cannot merge gradients of different stripes");
+		for(size_t i=0; i < layers.size(); ++i)
+			if(! layers[i].sameShape(other.layers[i]))
+				throw NeuralException("Cannot merge gradients of different stripes");
+		// Descending by a negative rate adds the other gradient
+		for(size_t i=0; i < layers.size(); ++i)
+			layers[i].descend(other.layers[i], -1.0);
+		samples += other.samples;
+	}
+
+}
@@ -0,0 +1,677 @@
+#include "nn/kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define NN_KERNELS_X86
+	#include <immintrin.h>
+#endif
+
+
+
+namespace {
+
+	using dot_func    = double (*)(const double*, const double*, size_t);
+	using axpy_func   = void (*)(double, const double*, double*, size_t);
+	using matvec_func = void (*)(
+			const double*, const double*, const double*,
+			double*, size_t, size_t);
+	using gemm_func = void (*)(
+			const double*, const double*, const double*,
+			double*, size_t, size_t, size_t);
+
+	struct Kernels {
+		nn::kernel::InstructionSet set;
+		dot_func dot;
+		axpy_func axpy;
+		matvec_func matvec;
+		gemm_func gemm;
+	};
+
+	using dot_f32_func    = float (*)(const float*, const float*, size_t);
+	using axpy_f32_func   = void (*)(float, const float*, float*, size_t);
+	using matvec_f32_func = void (*)(
+			const float*, const float*, const float*,
+			float*, size_t, size_t);
+	using gemm_f32_func = void (*)(
+			const float*, const float*, const float*,
+			float*, size_t, size_t, size_t);
+
+	struct FloatKernels {
+		dot_f32_func dot;
+		axpy_f32_func axpy;
+		matvec_f32_func matvec;
+		gemm_f32_func gemm;
+	};
+
+
+	/* The scalar kernels keep the exact summation order
+	 * of the original loops */
+
+	double dot_scalar(const double* a, const double* b, size_t n) {
+		double sum = 0.0;
+		for(size_t i=0; i < n; ++i)
+			sum += a[i] * b[i];
+		return sum;
+	}
+
+	void axpy_scalar(double alpha, const double* x, double* y, size_t n) {
+		for(size_t i=0; i < n; ++i)
+			y[i] += alpha * x[i];
+	}
+
+	void matvec_scalar(
+			const double* w, const double* x, const double* bias,
+			double* out, size_t rows, size_t cols
+	) {
+		for(size_t r=0; r < rows; ++r) {
+			out[r] = dot_scalar(w, x, cols) + bias[r];
+			w += cols;
+		}
+	}
+
+	void gemm_scalar(
+			const double* x, const double* w, const double* bias,
+			double* y, size_t rows, size_t inner, size_t cols
+	) {
+		for(size_t r=0; r < rows; ++r) {
+			for(size_t o=0; o < cols; ++o)
+				y[o] = bias[o];
+			for(size_t j=0; j < inner; ++j)
+				axpy_scalar(x[j], w + (j * cols), y, cols);
+			x += inner;
+			y += cols;
+		}
+	}
+
+
+	float dot_scalar(const float* a, const float* b, size_t n) {
+		float sum = 0.0f;
+		for(size_t i=0; i < n; ++i)
+			sum += a[i] * b[i];
+		return sum;
+	}
+
+	void axpy_scalar(float alpha, const float* x, float* y, size_t n) {
+		for(size_t i=0; i < n; ++i)
+			y[i] += alpha * x[i];
+	}
+
+	void matvec_scalar(
+			const float* w, const float* x, const float* bias,
+			float* out, size_t rows, size_t cols
+	) {
+		for(size_t r=0; r < rows; ++r) {
+			out[r] = dot_scalar(w, x, cols) + bias[r];
+			w += cols;
+		}
+	}
+
+	void gemm_scalar(
+			const float* x, const float* w, const float* bias,
+			float* y, size_t rows, size_t inner, size_t cols
+	) {
+		for(size_t r=0; r < rows; ++r) {
+			for(size_t o=0; o < cols; ++o)
+				y[o] = bias[o];
+			for(size_t j=0; j < inner; ++j)
+				axpy_scalar(x[j], w + (j * cols), y, cols);
+			x += inner;
+			y += cols;
+		}
+	}
+
+
+	#ifdef NN_KERNELS_X86
+
+		__attribute__((target("sse2")))
+		double dot_sse2(const double* a, const double* b, size_t n) {
+			__m128d acc0 = _mm_setzero_pd();
+			__m128d acc1 = _mm_setzero_pd();
+			size_t i = 0;
+			for(; i+4 <= n; i += 4) {
+				acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a+i),   _mm_loadu_pd(b+i)));
+				acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a+i+2), _mm_loadu_pd(b+i+2)));
+			}
+			acc0 = _mm_add_pd(acc0, acc1);
+			double sum = _mm_cvtsd_f64(acc0) + _mm_cvtsd_f64(_mm_unpackhi_pd(acc0, acc0));
+			for(; i < n; ++i)
+				sum += a[i] * b[i];
+			return sum;
+		}
+
+		__attribute__((target("sse2")))
+		void axpy_sse2(double alpha, const double* x, double* y, size_t n) {
+			__m128d va = _mm_set1_pd(alpha);
+			size_t i = 0;
+			for(; i+2 <= n; i += 2)
+				_mm_storeu_pd(y+i, _mm_add_pd(_mm_loadu_pd(y+i), _mm_mul_pd(va, _mm_loadu_pd(x+i))));
+			for(; i < n; ++i)
+				y[i] += alpha * x[i];
+		}
+
+		__attribute__((target("sse2")))
+		void matvec_sse2(
+				const double* w, const double* x, const double* bias,
+				double* out, size_t rows, size_t cols
+		) {
+			for(size_t r=0; r < rows; ++r) {
+				out[r] = dot_sse2(w, x, cols) + bias[r];
+				w += cols;
+			}
+		}
+
+		/* The GEMM kernels compute BLOCK rows at a time, so that
+		 * each vector of weights is loaded once per block */
+
+		template<size_t BLOCK>
+		__attribute__((target("sse2")))
+		void gemm_block_sse2(
+				const double* x, const double* w, const double* bias,
+				double* y, size_t inner, size_t cols
+		) {
+			size_t o = 0;
+			for(; o+2 <= cols; o += 2) {
+				__m128d acc[BLOCK];
+				for(size_t b=0; b < BLOCK; ++b)  acc[b] = _mm_loadu_pd(bias+o);
+				for(size_t j=0; j < inner; ++j) {
+					__m128d wv = _mm_loadu_pd(w + (j * cols) + o);
+					for(size_t b=0; b < BLOCK; ++b)
+						acc[b] = _mm_add_pd(acc[b], _mm_mul_pd(_mm_set1_pd(x[(b * inner) + j]), wv));
+				}
+				for(size_t b=0; b < BLOCK; ++b)  _mm_storeu_pd(y + (b * cols) + o, acc[b]);
+			}
+			for(; o < cols; ++o) {
+				for(size_t b=0; b < BLOCK; ++b) {
+					double acc = bias[o];
+					for(size_t j=0; j < inner; ++j)
+						acc += x[(b * inner) + j] * w[(j * cols) + o];
+					y[(b * cols) + o] = acc;
+				}
+			}
+		}
+
+		__attribute__((target("sse2")))
+		void gemm_sse2(
+				const double* x, const double* w, const double* bias,
+				double* y, size_t rows, size_t inner, size_t cols
+		) {
+			size_t r = 0;
+			for(; r+4 <= rows; r += 4)
+				gemm_block_sse2<4>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+			for(; r < rows; ++r)
+				gemm_block_sse2<1>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+		}
+
+
+		__attribute__((target("avx2,fma")))
+		double dot_avx2(const double* a, const double* b, size_t n) {
+			__m256d acc0 = _mm256_setzero_pd();
+			__m256d acc1 = _mm256_setzero_pd();
+			size_t i = 0;
+			for(; i+8 <= n; i += 8) {
+				acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a+i),   _mm256_loadu_pd(b+i),   acc0);
+				acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a+i+4), _mm256_loadu_pd(b+i+4), acc1);
+			}
+			for(; i+4 <= n; i += 4)
+				acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i), acc0);
+			acc0 = _mm256_add_pd(acc0, acc1);
+			__m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+			double sum = _mm_cvtsd_f64(half) + _mm_cvtsd_f64(_mm_unpackhi_pd(half, half));
+			for(; i < n; ++i)
+				sum += a[i] * b[i];
+			return sum;
+		}
+
+		__attribute__((target("avx2,fma")))
+		void axpy_avx2(double alpha, const double* x, double* y, size_t n) {
+			__m256d va = _mm256_set1_pd(alpha);
+			size_t i = 0;
+			for(; i+4 <= n; i += 4)
+				_mm256_storeu_pd(y+i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i)));
+			for(; i < n; ++i)
+				y[i] += alpha * x[i];
+		}
+
+		__attribute__((target("avx2,fma")))
+		void matvec_avx2(
+				const double* w, const double* x, const double* bias,
+				double* out, size_t rows, size_t cols
+		) {
+			for(size_t r=0; r < rows; ++r) {
+				out[r] = dot_avx2(w, x, cols) + bias[r];
+				w += cols;
+			}
+		}
+
+		template<size_t BLOCK>
+		__attribute__((target("avx2,fma")))
+		void gemm_block_avx2(
+				const double* x, const double* w, const double* bias,
+				double* y, size_t inner, size_t cols
+		) {
+			size_t o = 0;
+			for(; o+4 <= cols; o += 4) {
+				__m256d acc[BLOCK];
+				for(size_t b=0; b < BLOCK; ++b)  acc[b] = _mm256_loadu_pd(bias+o);
+				for(size_t j=0; j < inner; ++j) {
+					__m256d wv = _mm256_loadu_pd(w + (j * cols) + o);
+					for(size_t b=0; b < BLOCK; ++b)
+						acc[b] = _mm256_fmadd_pd(_mm256_set1_pd(x[(b * inner) + j]), wv, acc[b]);
+				}
+				for(size_t b=0; b < BLOCK; ++b)  _mm256_storeu_pd(y + (b * cols) + o, acc[b]);
+			}
+			for(; o < cols; ++o) {
+				for(size_t b=0; b < BLOCK; ++b) {
+					double acc = bias[o];
+					for(size_t j=0; j < inner; ++j)
+						acc += x[(b * inner) + j] * w[(j * cols) + o];
+					y[(b * cols) + o] = acc;
+				}
+			}
+		}
+
+		__attribute__((target("avx2,fma")))
+		void gemm_avx2(
+				const double* x, const double* w, const double* bias,
+				double* y, size_t rows, size_t inner, size_t cols
+		) {
+			size_t r = 0;
+			for(; r+4 <= rows; r += 4)
+				gemm_block_avx2<4>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+			for(; r < rows; ++r)
+				gemm_block_avx2<1>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+		}
+
+
+		__attribute__((target("avx512f")))
+		double dot_avx512(const double* a, const double* b, size_t n) {
+			__m512d acc0 = _mm512_setzero_pd();
+			__m512d acc1 = _mm512_setzero_pd();
+			size_t i = 0;
+			for(; i+16 <= n; i += 16) {
+				acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a+i),   _mm512_loadu_pd(b+i),   acc0);
+				acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(a+i+8), _mm512_loadu_pd(b+i+8), acc1);
+			}
+			if(i+8 <= n) {
+				acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a+i), _mm512_loadu_pd(b+i), acc0);
+				i += 8;
+			}
+			if(i < n) {
+				// Masked loads handle the remainder without reading past the end
+				__mmask8 mask = (1u << (n - i)) - 1u;
+				acc1 = _mm512_fmadd_pd(
+						_mm512_maskz_loadu_pd(mask, a+i),
+						_mm512_maskz_loadu_pd(mask, b+i), acc1);
+			}
+			alignas(64) double lanes[8];
+			_mm512_store_pd(lanes, _mm512_add_pd(acc0, acc1));
+			return
+					((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+					((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+		}
+
+		__attribute__((target("avx512f")))
+		void axpy_avx512(double alpha, const double* x, double* y, size_t n) {
+			__m512d va = _mm512_set1_pd(alpha);
+			size_t i = 0;
+			for(; i+8 <= n; i += 8)
+				_mm512_storeu_pd(y+i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i)));
+			if(i < n) {
+				__mmask8 mask = (1u << (n - i)) - 1u;
+				_mm512_mask_storeu_pd(y+i, mask, _mm512_fmadd_pd(
+						va, _mm512_maskz_loadu_pd(mask, x+i),
+						_mm512_maskz_loadu_pd(mask, y+i)));
+			}
+		}
+
+		__attribute__((target("avx512f")))
+		void matvec_avx512(
+				const double* w, const double* x, const double* bias,
+				double* out, size_t rows, size_t cols
+		) {
+			for(size_t r=0; r < rows; ++r) {
+				out[r] = dot_avx512(w, x, cols) + bias[r];
+				w += cols;
+			}
+		}
+
+		template<size_t BLOCK>
+		__attribute__((target("avx512f")))
+		void gemm_block_avx512(
+				const double* x, const double* w, const double* bias,
+				double* y, size_t inner, size_t cols
+		) {
+			for(size_t o=0; o < cols; o += 8) {
+				__mmask8 mask = (cols - o >= 8)? 0xFF : ((1u << (cols - o)) - 1u);
+				__m512d acc[BLOCK];
+				for(size_t b=0; b < BLOCK; ++b)  acc[b] = _mm512_maskz_loadu_pd(mask, bias+o);
+				for(size_t j=0; j < inner; ++j) {
+					__m512d wv = _mm512_maskz_loadu_pd(mask, w + (j * cols) + o);
+					for(size_t b=0; b < BLOCK; ++b)
+						acc[b] = _mm512_fmadd_pd(_mm512_set1_pd(x[(b * inner) + j]), wv, acc[b]);
+				}
+				for(size_t b=0; b < BLOCK; ++b)  _mm512_mask_storeu_pd(y + (b * cols) + o, mask, acc[b]);
+			}
+		}
+
+		__attribute__((target("avx512f")))
+		void gemm_avx512(
+				const double* x, const double* w, const double* bias,
+				double* y, size_t rows, size_t inner, size_t cols
+		) {
+			size_t r = 0;
+			for(; r+8 <= rows; r += 8)
+				gemm_block_avx512<8>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+			for(; r < rows; ++r)
+				gemm_block_avx512<1>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+		}
+
+
+		__attribute__((target("avx2,fma")))
+		float dot_avx2(const float* a, const float* b, size_t n) {
+			__m256 acc0 = _mm256_setzero_ps();
+			__m256 acc1 = _mm256_setzero_ps();
+			size_t i = 0;
+			for(; i+16 <= n; i += 16) {
+				acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i),   _mm256_loadu_ps(b+i),   acc0);
+				acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8), acc1);
+			}
+			for(; i+8 <= n; i += 8)
+				acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), acc0);
+			acc0 = _mm256_add_ps(acc0, acc1);
+			__m128 half = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+			half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+			float sum = _mm_cvtss_f32(_mm_add_ss(half, _mm_shuffle_ps(half, half, 1)));
+			for(; i < n; ++i)
+				sum += a[i] * b[i];
+			return sum;
+		}
+
+		__attribute__((target("avx2,fma")))
+		void axpy_avx2(float alpha, const float* x, float* y, size_t n) {
+			__m256 va = _mm256_set1_ps(alpha);
+			size_t i = 0;
+			for(; i+8 <= n; i += 8)
+				_mm256_storeu_ps(y+i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x+i), _mm256_loadu_ps(y+i)));
+			for(; i < n; ++i)
+				y[i] += alpha * x[i];
+		}
+
+		__attribute__((target("avx2,fma")))
+		void matvec_avx2(
+				const float* w, const float* x, const float* bias,
+				float* out, size_t rows, size_t cols
+		) {
+			for(size_t r=0; r < rows; ++r) {
+				out[r] = dot_avx2(w, x, cols) + bias[r];
+				w += cols;
+			}
+		}
+
+		template<size_t BLOCK>
+		__attribute__((target("avx2,fma")))
+		void gemm_block_avx2(
+				const float* x, const float* w, const float* bias,
+				float* y, size_t inner, size_t cols
+		) {
+			size_t o = 0;
+			for(; o+8 <= cols; o += 8) {
+				__m256 acc[BLOCK];
+				for(size_t b=0; b < BLOCK; ++b)  acc[b] = _mm256_loadu_ps(bias+o);
+				for(size_t j=0; j < inner; ++j) {
+					__m256 wv = _mm256_loadu_ps(w + (j * cols) + o);
+					for(size_t b=0; b < BLOCK; ++b)
+						acc[b] = _mm256_fmadd_ps(_mm256_set1_ps(x[(b * inner) + j]), wv, acc[b]);
+				}
+				for(size_t b=0; b < BLOCK; ++b)  _mm256_storeu_ps(y + (b * cols) + o, acc[b]);
+			}
+			for(; o < cols; ++o) {
+				for(size_t b=0; b < BLOCK; ++b) {
+					float acc = bias[o];
+					for(size_t j=0; j < inner; ++j)
+						acc += x[(b * inner) + j] * w[(j * cols) + o];
+					y[(b * cols) + o] = acc;
+				}
+			}
+		}
+
+		__attribute__((target("avx2,fma")))
+		void gemm_avx2(
+				const float* x, const float* w, const float* bias,
+				float* y, size_t rows, size_t inner, size_t cols
+		) {
+			size_t r = 0;
+			for(; r+4 <= rows; r += 4)
+				gemm_block_avx2<4>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+			for(; r < rows; ++r)
+				gemm_block_avx2<1>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+		}
+
+
+		__attribute__((target("avx512f")))
+		float dot_avx512(const float* a, const float* b, size_t n) {
+			__m512 acc0 = _mm512_setzero_ps();
+			__m512 acc1 = _mm512_setzero_ps();
+			size_t i = 0;
+			for(; i+32 <= n; i += 32) {
+				acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a+i),    _mm512_loadu_ps(b+i),    acc0);
+				acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a+i+16), _mm512_loadu_ps(b+i+16), acc1);
+			}
+			if(i+16 <= n) {
+				acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a+i), _mm512_loadu_ps(b+i), acc0);
+				i += 16;
+			}
+			if(i < n) {
+				__mmask16 mask = (1u << (n - i)) - 1u;
+				acc1 = _mm512_fmadd_ps(
+						_mm512_maskz_loadu_ps(mask, a+i),
+						_mm512_maskz_loadu_ps(mask, b+i), acc1);
+			}
+			alignas(64) float lanes[16];
+			_mm512_store_ps(lanes, _mm512_add_ps(acc0, acc1));
+			float sum = 0.0f;
+			for(size_t l=0; l < 16; l += 2)
+				sum += lanes[l] + lanes[l+1];
+			return sum;
+		}
+
+		__attribute__((target("avx512f")))
+		void axpy_avx512(float alpha, const float* x, float* y, size_t n) {
+			__m512 va = _mm512_set1_ps(alpha);
+			size_t i = 0;
+			for(; i+16 <= n; i += 16)
+				_mm512_storeu_ps(y+i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x+i), _mm512_loadu_ps(y+i)));
+			if(i < n) {
+				__mmask16 mask = (1u << (n - i)) - 1u;
+				_mm512_mask_storeu_ps(y+i, mask, _mm512_fmadd_ps(
+						va, _mm512_maskz_loadu_ps(mask, x+i),
+						_mm512_maskz_loadu_ps(mask, y+i)));
+			}
+		}
+
+		__attribute__((target("avx512f")))
+		void matvec_avx512(
+				const float* w, const float* x, const float* bias,
+				float* out, size_t rows, size_t cols
+		) {
+			for(size_t r=0; r < rows; ++r) {
+				out[r] = dot_avx512(w, x, cols) + bias[r];
+				w += cols;
+			}
+		}
+
+		template<size_t BLOCK>
+		__attribute__((target("avx512f")))
+		void gemm_block_avx512(
+				const float* x, const float* w, const float* bias,
+				float* y, size_t inner, size_t cols
+		) {
+			for(size_t o=0; o < cols; o += 16) {
+				__mmask16 mask = (cols - o >= 16)? 0xFFFF : ((1u << (cols - o)) - 1u);
+				__m512 acc[BLOCK];
+				for(size_t b=0; b < BLOCK; ++b)  acc[b] = _mm512_maskz_loadu_ps(mask, bias+o);
+				for(size_t j=0; j < inner; ++j) {
+					__m512 wv = _mm512_maskz_loadu_ps(mask, w + (j * cols) + o);
+					for(size_t b=0; b < BLOCK; ++b)
+						acc[b] = _mm512_fmadd_ps(_mm512_set1_ps(x[(b * inner) + j]), wv, acc[b]);
+				}
+				for(size_t b=0; b < BLOCK; ++b)  _mm512_mask_storeu_ps(y + (b * cols) + o, mask, acc[b]);
+			}
+		}
+
+		__attribute__((target("avx512f")))
+		void gemm_avx512(
+				const float* x, const float* w, const float* bias,
+				float* y, size_t rows, size_t inner, size_t cols
+		) {
+			size_t r = 0;
+			for(; r+8 <= rows; r += 8)
+				gemm_block_avx512<8>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+			for(; r < rows; ++r)
+				gemm_block_avx512<1>(x + (r * inner), w, bias, y + (r * cols), inner, cols);
+		}
+
+	#endif
+
+
+	Kernels kernels_for(nn::kernel::InstructionSet set) {
+		using nn::kernel::InstructionSet;
+		switch(set) {
+			#ifdef NN_KERNELS_X86
+				case InstructionSet::AVX512:
+					return { set, dot_avx512, axpy_avx512, matvec_avx512, gemm_avx512 };
+				case InstructionSet::AVX2:
+					return { set, dot_avx2, axpy_avx2, matvec_avx2, gemm_avx2 };
+				case InstructionSet::SSE2:
+					return { set, dot_sse2, axpy_sse2, matvec_sse2, gemm_sse2 };
+			#endif
+			default:
+				return { InstructionSet::SCALAR, dot_scalar, axpy_scalar, matvec_scalar, gemm_scalar };
+		}
+	}
+
+	FloatKernels float_kernels_for(nn::kernel::InstructionSet set) {
+		using nn::kernel::InstructionSet;
+		switch(set) {
+			#ifdef NN_KERNELS_X86
+				case InstructionSet::AVX512:
+					return { dot_avx512, axpy_avx512, matvec_avx512, gemm_avx512 };
+				case InstructionSet::AVX2:
+					return { dot_avx2, axpy_avx2, matvec_avx2, gemm_avx2 };
+			#endif
+			default:
+				return { dot_scalar, axpy_scalar, matvec_scalar, gemm_scalar };
+		}
+	}
+
+	nn::kernel::InstructionSet best_instruction_set() {
+		using nn::kernel::InstructionSet;
+		constexpr InstructionSet preference[] = {
+			InstructionSet::AVX512, InstructionSet::AVX2, InstructionSet::SSE2 };
+		for(InstructionSet set : preference)
+			if(nn::kernel::supports(set))  return set;
+		return InstructionSet::SCALAR;
+	}
+
+
+	/* Starts with the scalar kernels, so that they are usable during
+	 * static initialization; the selector below replaces them
+	 * with the best available ones */
+	Kernels active = { nn::kernel::InstructionSet::SCALAR, dot_scalar, axpy_scalar, matvec_scalar, gemm_scalar };
+	FloatKernels active_float = { dot_scalar, axpy_scalar, matvec_scalar, gemm_scalar };
+
+	struct Selector {
+		Selector() {
+			active = kernels_for(best_instruction_set());
+			active_float = float_kernels_for(active.set);
+		}
+	} selector;
+
+}
+
+
+
+namespace nn::kernel {
+
+	bool supports(InstructionSet set) {
+		__builtin_cpu_init(); // May be called before libgcc's own constructors
+		switch(set) {
+			case InstructionSet::SCALAR:  return true;
+			#ifdef NN_KERNELS_X86
+				case InstructionSet::SSE2:    return __builtin_cpu_supports("sse2");
+				case InstructionSet::AVX2:
+					return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+				case InstructionSet::AVX512:  return __builtin_cpu_supports("avx512f");
+			#endif
+			default:  return false;
+		}
+	}
+
+	const char* name(InstructionSet set) {
+		switch(set) {
+			case InstructionSet::SCALAR:  return "scalar";
+			case InstructionSet::SSE2:    return "SSE2";
+			case InstructionSet::AVX2:    return "AVX2";
+			case InstructionSet::AVX512:  return "AVX-512";
+		}
+		return "unknown";
+	}
+
+	InstructionSet instruction_set() {
+		return active.set;
+	}
+
+	bool set_instruction_set(InstructionSet set) {
+		if(! supports(set))  return false;
+		active = kernels_for(set);
+		active_float = float_kernels_for(set);
+		return true;
+	}
+
+
+	double dot(const double* a, const double* b, size_t n) {
+		return active.dot(a, b, n);
+	}
+
+	void axpy(double alpha, const double* x, double* y, size_t n) {
+		active.axpy(alpha, x, y, n);
+	}
+
+	void matvec(
+			const double* w, const double* x, const double* bias,
+			double* out, size_t rows, size_t cols
+	) {
+		active.matvec(w, x, bias, out, rows, cols);
+	}
+
+	void gemm(
+			const double* x, const double* w, const double* bias,
+			double* y, size_t rows, size_t inner, size_t cols
+	) {
+		active.gemm(x, w, bias, y, rows, inner, cols);
+	}
+
+
+
+	float dot(const float* a, const float* b, size_t n) {
+		return active_float.dot(a, b, n);
+	}
+
+	void axpy(float alpha, const float* x, float* y, size_t n) {
+		active_float.axpy(alpha, x, y, n);
+	}
+
+	void matvec(
+			const float* w, const float* x, const float* bias,
+			float* out, size_t rows, size_t cols
+	) {
+		active_float.matvec(w, x, bias, out, rows, cols);
+	}
+
+	void gemm(
+			const float* x, const float* w, const float* bias,
+			float* y, size_t rows, size_t inner, size_t cols
+	) {
+		active_float.gemm(x, w, bias, y, rows, inner, cols);
+	}
+
+}
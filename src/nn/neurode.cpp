@@ -1,35 +1,64 @@
 #include "nn/nn.hpp"
+#include "nn/kernels.hpp"
+
+
+
+namespace {
+	/* Holds the transposed weights of a row-major
+	 * Neurode, for Neurode::guessBatch */
+	thread_local nn::Workspace thread_workspace;
+}
 
 
 
 namespace nn {
 
-	Neurode::Neurode(size_t inputs, size_t outputs):
+	Neurode::Neurode(size_t inputs, size_t outputs, WeightLayout l):
 			input_size (inputs),
-			output_size (outputs)
+			output_size (outputs),
+			layout (l),
+			weights (alloc_buffer((inputs+1) * outputs)),
+			owns_weights (true)
 	{
-		perceptrons.reserve(outputs);
-		for(size_t i=0; i < output_size; ++i) {
-			perceptrons.push_back(Perceptron(inputs));
-		}
+		randomize();
 	}
 
+	Neurode::Neurode(size_t inputs, size_t outputs, WeightLayout l, double* w):
+			input_size (inputs),
+			output_size (outputs),
+			layout (l),
+			weights (w),
+			owns_weights (false)
+	{ }
+
 	Neurode::Neurode(const Neurode& cpy):
 			input_size (cpy.input_size),
 			output_size (cpy.output_size),
-			perceptrons (cpy.perceptrons)
+			layout (cpy.layout),
+			weights (alloc_buffer((input_size+1) * output_size)),
+			owns_weights (true)
 	{
-		for(size_t i=0; i < output_size; ++i)
-			perceptrons[i] = cpy.perceptrons[i];
+		size_t count = (input_size+1) * output_size;
+		for(size_t i=0; i < count; ++i)
+			weights[i] = cpy.weights[i];
 	}
 
 	Neurode::Neurode(Neurode&& mov):
 			input_size (std::move(mov.input_size)),
 			output_size (std::move(mov.output_size)),
-			perceptrons (std::move(mov.perceptrons))
-	{ }
+			layout (std::move(mov.layout)),
+			weights (std::move(mov.weights)),
+			owns_weights (std::move(mov.owns_weights))
+	{
+		mov.weights = nullptr;
+	}
 
-	Neurode::~Neurode() { }
+	Neurode::~Neurode() {
+		if(weights != nullptr) {
+			if(owns_weights)  free_buffer(weights);
+			weights = nullptr;
+		}
+	}
 
 	Neurode& Neurode::operator = (const Neurode& cpy) {
 		this->~Neurode();
@@ -44,39 +73,183 @@ namespace nn {
 	}
 
 
-	void Neurode::guess(activation_func act, double* in, double* out) const {
-		for(size_t i=0; i < output_size; ++i) {
-			out[i] = perceptrons[i].guess(act, in);
-			//out[i] = act(perceptrons[i].guess(act, in));
+	Perceptron Neurode::operator [] (unsigned i) {
+		if(layout == WeightLayout::ROW_MAJOR) {
+			return Perceptron(input_size, weights + (i * input_size), 1, biasData() + i);
+		} else {
+			return Perceptron(input_size, weights + i, output_size, biasData() + i);
 		}
 	}
 
+	PerceptronView Neurode::operator [] (unsigned i) const {
+		if(layout == WeightLayout::ROW_MAJOR) {
+			return PerceptronView(input_size, weights + (i * input_size), 1, biasData() + i);
+		} else {
+			return PerceptronView(input_size, weights + i, output_size, biasData() + i);
+		}
+	}
+
+
+	void Neurode::guess(activation_func act, const double* in, double* out) const {
+		guess(activation::Function(act), in, out);
+	}
+
+	void Neurode::weightedSums(const double* in, double* out) const {
+		const double* bias = biasData();
+		if(layout == WeightLayout::ROW_MAJOR) {
+			kernel::matvec(weights, in, bias, out, output_size, input_size);
+		} else {
+			/* Each input scales a contiguous column of weights,
+			 * which is accumulated into the outputs */
+			const double* col = weights;
+			for(size_t i=0; i < output_size; ++i)
+				out[i] = 0.0;
+			for(size_t j=0; j < input_size; ++j) {
+				kernel::axpy(in[j], col, out, output_size);
+				col += output_size;
+			}
+			for(size_t i=0; i < output_size; ++i)
+				out[i] += bias[i];
+		}
+	}
+
+	template<typename Activation, typename>
+	void Neurode::guess(const Activation& act, const double* in, double* out) const {
+		weightedSums(in, out);
+		activation::apply(act, out, output_size);
+	}
+
+	template<typename Activation, typename>
+	void Neurode::guess(const Activation& act, const double* in, double* out, double* derivatives) const {
+		weightedSums(in, out);
+		activation::apply(act, out, derivatives, output_size);
+	}
+
 	void Neurode::learn(
 			activation_func act,
-			double* in,
-			double* errors, double rate
+			const double* in,
+			const double* errors, double rate
 	) {
-		for(size_t i=0; i < output_size; ++i) {
-			perceptrons[i].learn(act, in, errors[i], rate);
+		if(layout == WeightLayout::ROW_MAJOR) {
+			double* row = weights;
+			for(size_t i=0; i < output_size; ++i) {
+				kernel::axpy(-(rate * errors[i]), in, row, input_size);
+				row += input_size;
+			}
+		} else {
+			double* col = weights;
+			for(size_t j=0; j < input_size; ++j) {
+				kernel::axpy(-(rate * in[j]), errors, col, output_size);
+				col += output_size;
+			}
+		}
+		// Bias fold: the biases take an input of 1
+		kernel::axpy(-rate, errors, biasData(), output_size);
+	}
+
+	void Neurode::guessBatch(
+			activation_func act,
+			const double* in, size_t rows,
+			double* out
+	) const {
+		guessBatch(activation::Function(act), in, rows, out);
+	}
+
+	template<typename Activation, typename>
+	void Neurode::guessBatch(
+			const Activation& act,
+			const double* in, size_t rows,
+			double* out
+	) const {
+		const double* columns = weights;
+		if(layout == WeightLayout::ROW_MAJOR) {
+			double* transposed = thread_workspace.reserve(input_size * output_size);
+			copyColumns(transposed);
+			columns = transposed;
+		}
+		kernel::gemm(in, columns, biasData(), out, rows, input_size, output_size);
+		activation::apply(act, out, rows * output_size);
+	}
+
+	void Neurode::accumulate(const double* in, const double* errors) {
+		if(layout == WeightLayout::ROW_MAJOR) {
+			double* row = weights;
+			for(size_t i=0; i < output_size; ++i) {
+				kernel::axpy(errors[i], in, row, input_size);
+				row += input_size;
+			}
+		} else {
+			double* col = weights;
+			for(size_t j=0; j < input_size; ++j) {
+				kernel::axpy(in[j], errors, col, output_size);
+				col += output_size;
+			}
+		}
+		kernel::axpy(1.0, errors, biasData(), output_size);
+	}
+
+	void Neurode::descend(const Neurode& gradient, double rate) {
+		if(! sameShape(gradient))
+			throw NeuralException("Gradient does not match the neurode's shape");
+		// Weights and biases are contiguous: a single pass covers both
+		kernel::axpy(-rate, gradient.weights, weights, (input_size+1) * output_size);
+	}
+
+	void Neurode::zero() {
+		size_t count = (input_size+1) * output_size;
+		for(size_t i=0; i < count; ++i)
+			weights[i] = 0.0;
+	}
+
+	void Neurode::copyWeights(const Neurode& src) {
+		if(! sameShape(src))
+			throw NeuralException("Cannot copy weights between differently shaped neurodes");
+		size_t count = (input_size+1) * output_size;
+		for(size_t i=0; i < count; ++i)
+			weights[i] = src.weights[i];
+	}
+
+	void Neurode::copyColumns(double* dst) const {
+		if(layout == WeightLayout::COLUMN_MAJOR) {
+			for(size_t i=0; i < input_size * output_size; ++i)
+				dst[i] = weights[i];
+		} else {
+			for(size_t i=0; i < output_size; ++i)
+			for(size_t j=0; j < input_size; ++j)
+				dst[(j * output_size) + i] = weights[(i * input_size) + j];
 		}
 	}
 
 	void Neurode::train(activation_func act, DataSet& data, double rate) {
 		for(DataRow& row : data) {
 			for(size_t i=0; i < output_size; ++i) {
+				Perceptron p = (*this)[i];
 				double error = nn::error(
 						row.outputs[i],
-						perceptrons[i].guess(act, row.inputs.data())
+						p.guess(act, row.inputs.data())
 				);
-				perceptrons[i].learn(act, row.inputs.data(), error, rate);
+				p.learn(act, row.inputs.data(), error, rate);
 			}
 		}
 	}
 
 	void Neurode::randomize() {
-		for(Perceptron& p : perceptrons)
-			p.randomize();
-		// bias = nn::random();
+		/* Perceptron by perceptron, so that the random sequence
+		 * is consumed in the same order for both layouts */
+		for(size_t i=0; i < output_size; ++i)
+			(*this)[i].randomize();
 	}
 
+
+
+	#define NN_INSTANTIATE(Activation) \
+		template void Neurode::guess<Activation>( \
+				const Activation&, const double*, double*) const; \
+		template void Neurode::guess<Activation>( \
+				const Activation&, const double*, double*, double*) const; \
+		template void Neurode::guessBatch<Activation>( \
+				const Activation&, const double*, size_t, double*) const;
+	NN_ACTIVATION_POLICIES(NN_INSTANTIATE)
+	#undef NN_INSTANTIATE
+
 }
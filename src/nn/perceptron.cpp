@@ -1,4 +1,5 @@
 #include "nn/nn.hpp"
+#include "nn/kernels.hpp"
 
 
 
@@ -6,64 +7,121 @@ namespace nn {
 
 	Perceptron::Perceptron(size_t inputs):
 			input_size (inputs),
-			weights (new double[inputs+1])
+			stride (1),
+			weights (alloc_buffer(inputs+1)),
+			bias (weights + inputs),
+			storage (weights)
 	{
 		for(size_t i=0; i <= input_size; ++i) {
 			weights[i] = nn::random();
 		}
 	}
 
+	Perceptron::Perceptron(size_t inputs, double* w, size_t s, double* b):
+			input_size (inputs),
+			stride (s),
+			weights (w),
+			bias (b),
+			storage (nullptr)
+	{ }
+
 	Perceptron::Perceptron(const Perceptron& cpy):
 			input_size (cpy.input_size),
-			weights (new double[input_size+1])
+			stride (cpy.stride),
+			weights (cpy.weights),
+			bias (cpy.bias),
+			storage (nullptr)
 	{
-		for(size_t i=0; i <= input_size; ++i)
-			weights[i] = cpy.weights[i];
+		if(cpy.storage != nullptr) {
+			storage = alloc_buffer(input_size+1);
+			for(size_t i=0; i < input_size; ++i)
+				storage[i] = cpy.weights[i * cpy.stride];
+			storage[input_size] = *cpy.bias;
+			stride = 1;
+			weights = storage;
+			bias = storage + input_size;
+		}
 	}
 
 	Perceptron::Perceptron(Perceptron&& mov):
 			input_size (std::move(mov.input_size)),
-			weights (std::move(mov.weights))
+			stride (std::move(mov.stride)),
+			weights (std::move(mov.weights)),
+			bias (std::move(mov.bias)),
+			storage (std::move(mov.storage))
 	{
-		mov.weights = nullptr;
+		mov.storage = nullptr;
 	}
 
 	Perceptron::~Perceptron() {
-		if(weights != nullptr) {
-			delete[] weights;  weights = nullptr;
+		if(storage != nullptr) {
+			free_buffer(storage);  storage = nullptr;
 		}
 	}
 
 	Perceptron& Perceptron::operator = (const Perceptron& cpy) {
-		this->~Perceptron();
-		new (this) Perceptron(cpy);
+		if(this != &cpy)  copyWeights(cpy);
 		return *this;
 	}
 
 	Perceptron& Perceptron::operator = (Perceptron&& mov) {
-		this->~Perceptron();
-		new (this) Perceptron(std::move(mov));
+		if(this == &mov)  return *this;
+		if((storage != nullptr) && (mov.storage != nullptr)) {
+			// Both own their weights, which can simply be taken
+			this->~Perceptron();
+			new (this) Perceptron(std::move(mov));
+		} else {
+			copyWeights(mov);
+		}
 		return *this;
 	}
 
 
-	double Perceptron::guess(activation_func act, double* in) const {
-		double sum = 0.0;
+	void Perceptron::copyWeights(const Perceptron& src) {
+		if(storage == nullptr) {
+			if(src.input_size != input_size)
+				throw NeuralException("Cannot assign a Perceptron to a view with a different input size");
+		} else if(src.input_size != input_size) {
+			free_buffer(storage);
+			input_size = src.input_size;
+			storage = alloc_buffer(input_size+1);
+			stride = 1;
+			weights = storage;
+			bias = storage + input_size;
+		}
+		/* The source may be a view over the same weights,
+		 * in which case every weight is copied onto itself */
 		for(size_t i=0; i < input_size; ++i)
-			sum += weights[i] * in[i];
-		sum += weights[input_size];
+			weights[i * stride] = src.weights[i * src.stride];
+		*bias = *src.bias;
+	}
+
+
+	double PerceptronView::guess(activation_func act, const double* in) const {
+		double sum;
+		if(stride == 1) {
+			sum = kernel::dot(weights, in, input_size);
+		} else {
+			sum = 0.0;
+			for(size_t i=0; i < input_size; ++i)
+				sum += weights[i * stride] * in[i];
+		}
+		sum += *bias;
 		return act(sum);
 	}
 
 	void Perceptron::learn(
-			activation_func act, double* inputs,
+			activation_func act, const double* inputs,
 			double error, double rate
 	) {
 		error = rate * error;
-		for(size_t i=0; i < input_size; ++i) {
-			weights[i] -= error * inputs[i];
+		if(stride == 1) {
+			kernel::axpy(-error, inputs, weights, input_size);
+		} else {
+			for(size_t i=0; i < input_size; ++i)
+				weights[i * stride] -= error * inputs[i];
 		}
-		weights[input_size] -= error;
+		*bias -= error;
 	}
 
 	void Perceptron::train(activation_func act, DataSet& data, double rate) {
@@ -75,8 +133,9 @@ namespace nn {
 	}
 
 	void Perceptron::randomize() {
-		for(size_t i=0; i <= input_size; ++i)
-			weights[i] = nn::random();
+		for(size_t i=0; i < input_size; ++i)
+			weights[i * stride] = nn::random();
+		*bias = nn::random();
 	}
 
 }
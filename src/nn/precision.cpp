@@ -0,0 +1,522 @@
+#include "nn/precision.hpp"
+#include "nn/kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define NN_PRECISION_X86
+	#include <immintrin.h>
+#endif
+
+
+
+namespace {
+
+	/* The conversions between float and fp16 handle subnormals,
+	 * infinities and NaNs, and round to nearest even */
+
+	uint16_t float_to_half(float value) {
+		constexpr uint32_t F32_INFINITY = 255u << 23;
+		constexpr uint32_t F16_MAX      = (127u + 16u) << 23;
+		constexpr uint32_t DENORM_MAGIC = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+		uint32_t u;  memcpy(&u, &value, sizeof(u));
+		uint32_t sign = u & 0x80000000u;
+		u ^= sign;
+		uint16_t r;
+		if(u >= F16_MAX) {
+			r = (u > F32_INFINITY)? 0x7E00u : 0x7C00u;
+		} else if(u < (113u << 23)) {
+			// Aligns the mantissa at the bottom of a float, rounding as it goes
+			float f, magic;
+			memcpy(&f, &u, sizeof(f));
+			memcpy(&magic, &DENORM_MAGIC, sizeof(magic));
+			f += magic;
+			memcpy(&u, &f, sizeof(u));
+			r = u - DENORM_MAGIC;
+		} else {
+			uint32_t mantissa_odd = (u >> 13) & 1u;
+			u += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFFu;
+			u += mantissa_odd;
+			r = u >> 13;
+		}
+		return r | (sign >> 16);
+	}
+
+	float half_to_float(uint16_t half) {
+		constexpr uint32_t MAGIC = 113u << 23;
+		constexpr uint32_t SHIFTED_EXP = 0x7C00u << 13;
+		uint32_t u = (half & 0x7FFFu) << 13;
+		uint32_t exponent = u & SHIFTED_EXP;
+		u += (127u - 15u) << 23;
+		if(exponent == SHIFTED_EXP) {
+			u += (128u - 16u) << 23; // Infinities and NaNs
+		} else if(exponent == 0) {
+			// Zeroes and subnormals are renormalized
+			u += 1u << 23;
+			float f, magic;
+			memcpy(&f, &u, sizeof(f));
+			memcpy(&magic, &MAGIC, sizeof(magic));
+			f -= magic;
+			memcpy(&u, &f, sizeof(u));
+		}
+		u |= static_cast<uint32_t>(half & 0x8000u) << 16;
+		float r;  memcpy(&r, &u, sizeof(r));
+		return r;
+	}
+
+
+	#ifdef NN_PRECISION_X86
+
+		__attribute__((target("avx,f16c")))
+		void convert_f16c(const nn::precision::fp16* in, float* out, size_t n) {
+			size_t i = 0;
+			for(; i+8 <= n; i += 8) {
+				__m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				_mm256_storeu_ps(out + i, _mm256_cvtph_ps(half));
+			}
+			for(; i < n; ++i)
+				out[i] = half_to_float(in[i].bits);
+		}
+
+		bool has_f16c() {
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("f16c");
+		}
+
+	#endif
+
+
+	template<typename Weight, typename Scalar>
+	inline Weight to_weight(double value) {
+		return Weight(static_cast<Scalar>(value));
+	}
+
+
+	/* Rows evaluated together by TypedStripe::guessBatch, as by Stripe's */
+	constexpr size_t BATCH_TILE_ROWS = 64;
+
+	/* Used by the overloads of TypedStripe::guess and
+	 * TypedStripe::guessBatch that take no Workspace, and by train */
+	thread_local nn::Workspace thread_workspace;
+
+	constexpr size_t doubles_for(size_t bytes) {
+		return (bytes + sizeof(double) - 1) / sizeof(double);
+	}
+
+	// A Workspace holds doubles; any narrower type fits in it as well
+	template<typename Scalar>
+	inline Scalar* reserve_scalars(nn::Workspace& ws, size_t count) {
+		return reinterpret_cast<Scalar*>(ws.reserve(doubles_for(count * sizeof(Scalar))));
+	}
+
+	/* out = (w * in) + biases: a row-major layer takes a dot product
+	 * per output, a column-major one is a single-row product */
+	template<typename Scalar>
+	void layer_forward(
+			nn::WeightLayout layout, size_t inputs, size_t outputs,
+			const Scalar* w, const Scalar* in, Scalar* out
+	) {
+		const Scalar* bias = w + (inputs * outputs);
+		if(layout == nn::WeightLayout::ROW_MAJOR) {
+			nn::kernel::matvec(w, in, bias, out, outputs, inputs);
+		} else {
+			nn::kernel::gemm(in, w, bias, out, 1, inputs, outputs);
+		}
+	}
+
+	/* As Neurode::learn: w -= rate * (errors x inputs),
+	 * one update per row or per column */
+	template<typename Scalar>
+	void layer_learn(
+			nn::WeightLayout layout, size_t inputs, size_t outputs,
+			Scalar* w, const Scalar* in, const Scalar* errors, Scalar rate
+	) {
+		if(layout == nn::WeightLayout::ROW_MAJOR) {
+			for(size_t o=0; o < outputs; ++o)
+				nn::kernel::axpy(-(rate * errors[o]), in, w + (o * inputs), inputs);
+		} else {
+			for(size_t j=0; j < inputs; ++j)
+				nn::kernel::axpy(-(rate * in[j]), errors, w + (j * outputs), outputs);
+		}
+		nn::kernel::axpy(-rate, errors, w + (inputs * outputs), outputs);
+	}
+
+}
+
+
+
+namespace nn::precision {
+
+	fp16::fp16(float value):
+			bits (float_to_half(value))
+	{ }
+
+	fp16::operator float() const {
+		return half_to_float(bits);
+	}
+
+
+	void convert(const bf16* in, float* out, size_t n) {
+		for(size_t i=0; i < n; ++i)
+			out[i] = in[i];
+	}
+
+	void convert(const fp16* in, float* out, size_t n) {
+		#ifdef NN_PRECISION_X86
+			static const bool f16c = has_f16c();
+			if(f16c) {
+				convert_f16c(in, out, n);
+				return;
+			}
+		#endif
+		for(size_t i=0; i < n; ++i)
+			out[i] = half_to_float(in[i].bits);
+	}
+
+}
+
+
+
+namespace nn {
+
+	template<typename Weight>
+	TypedStripe<Weight>::TypedStripe(const Stripe& src):
+			input_size (src.inputSize()),
+			output_size (src.outputSize()),
+			biggest_neurode ((input_size > output_size)? input_size : output_size),
+			biggest_layer (0),
+			layers ()
+	{
+		layers.reserve(src.neurodeCount());
+		for(size_t i=0; i < src.neurodeCount(); ++i) {
+			const Neurode& n = src[i];
+			size_t count = (n.inputSize() + 1) * n.outputSize();
+			WeightLayout layout = (n.outputSize() > n.inputSize())?
+					WeightLayout::COLUMN_MAJOR : WeightLayout::ROW_MAJOR;
+			layers.push_back(Layer {
+					n.inputSize(), n.outputSize(), layout,
+					reinterpret_cast<Weight*>(alloc_aligned(count * sizeof(Weight))) });
+			if(n.outputSize() > biggest_neurode)  biggest_neurode = n.outputSize();
+			if(count > biggest_layer)  biggest_layer = count;
+		}
+		copyWeights(src);
+	}
+
+	template<typename Weight>
+	TypedStripe<Weight>::TypedStripe(const TypedStripe& cpy):
+			input_size (cpy.input_size),
+			output_size (cpy.output_size),
+			biggest_neurode (cpy.biggest_neurode),
+			biggest_layer (cpy.biggest_layer),
+			layers (cpy.layers)
+	{
+		for(Layer& l : layers) {
+			size_t count = (l.input_size + 1) * l.output_size;
+			Weight* weights = reinterpret_cast<Weight*>(alloc_aligned(count * sizeof(Weight)));
+			memcpy(weights, l.weights, count * sizeof(Weight));
+			l.weights = weights;
+		}
+	}
+
+	template<typename Weight>
+	TypedStripe<Weight>::TypedStripe(TypedStripe&& mov):
+			input_size (std::move(mov.input_size)),
+			output_size (std::move(mov.output_size)),
+			biggest_neurode (std::move(mov.biggest_neurode)),
+			biggest_layer (std::move(mov.biggest_layer)),
+			layers (std::move(mov.layers))
+	{
+		mov.layers.clear();
+	}
+
+	template<typename Weight>
+	TypedStripe<Weight>::~TypedStripe() {
+		for(Layer& l : layers)
+			free_aligned(l.weights);
+		layers.clear();
+	}
+
+	template<typename Weight>
+	TypedStripe<Weight>& TypedStripe<Weight>::operator = (const TypedStripe& cpy) {
+		this->~TypedStripe();
+		new (this) TypedStripe(cpy);
+		return *this;
+	}
+
+	template<typename Weight>
+	TypedStripe<Weight>& TypedStripe<Weight>::operator = (TypedStripe&& mov) {
+		this->~TypedStripe();
+		new (this) TypedStripe(std::move(mov));
+		return *this;
+	}
+
+
+	template<typename Weight>
+	void TypedStripe<Weight>::copyWeights(const Stripe& src) {
+		if(src.neurodeCount() != layers.size())
+			throw NeuralException("Cannot copy weights between differently shaped stripes");
+		for(size_t i=0; i < layers.size(); ++i) {
+			const Neurode& n = src[i];
+			Layer& l = layers[i];
+			if((n.inputSize() != l.input_size) || (n.outputSize() != l.output_size))
+				throw NeuralException("Cannot copy weights between differently shaped stripes");
+			const double* w = n.weightData();
+			bool row_major = (n.weightLayout() == WeightLayout::ROW_MAJOR);
+			for(size_t o=0; o < l.output_size; ++o)
+			for(size_t j=0; j < l.input_size; ++j) {
+				double value = row_major?
+						w[(o * l.input_size) + j] : w[(j * l.output_size) + o];
+				l.weights[l.at(o, j)] = to_weight<Weight, Scalar>(value);
+			}
+			Weight* bias = l.weights + (l.input_size * l.output_size);
+			for(size_t o=0; o < l.output_size; ++o)
+				bias[o] = to_weight<Weight, Scalar>(n.biasData()[o]);
+		}
+	}
+
+	template<typename Weight>
+	void TypedStripe<Weight>::exportWeights(Stripe& dst) const {
+		if(dst.neurodeCount() != layers.size())
+			throw NeuralException("Cannot copy weights between differently shaped stripes");
+		for(size_t i=0; i < layers.size(); ++i) {
+			Neurode& n = dst[i];
+			const Layer& l = layers[i];
+			if((n.inputSize() != l.input_size) || (n.outputSize() != l.output_size))
+				throw NeuralException("Cannot copy weights between differently shaped stripes");
+			double* w = n.weightData();
+			bool row_major = (n.weightLayout() == WeightLayout::ROW_MAJOR);
+			for(size_t o=0; o < l.output_size; ++o)
+			for(size_t j=0; j < l.input_size; ++j) {
+				double value = static_cast<Scalar>(l.weights[l.at(o, j)]);
+				if(row_major) {
+					w[(o * l.input_size) + j] = value;
+				} else {
+					w[(j * l.output_size) + o] = value;
+				}
+			}
+			const Weight* bias = l.weights + (l.input_size * l.output_size);
+			for(size_t o=0; o < l.output_size; ++o)
+				n.biasData()[o] = static_cast<Scalar>(bias[o]);
+		}
+	}
+
+	template<typename Weight>
+	const typename TypedStripe<Weight>::Scalar* TypedStripe<Weight>::computeWeights(
+			size_t i, Scalar* scratch
+	) const {
+		const Layer& l = layers[i];
+		if constexpr(std::is_same<Weight, Scalar>::value) {
+			return l.weights;
+		} else {
+			precision::convert(l.weights, scratch, (l.input_size + 1) * l.output_size);
+			return scratch;
+		}
+	}
+
+
+	template<typename Weight>
+	template<typename Activation, typename>
+	void TypedStripe<Weight>::guess(const Activation& act, const Scalar* in, Scalar* out) const {
+		guess(act, in, out, thread_workspace);
+	}
+
+	template<typename Weight>
+	template<typename Activation, typename>
+	void TypedStripe<Weight>::guess(
+			const Activation& act,
+			const Scalar* in, Scalar* out,
+			Workspace& ws
+	) const {
+		Scalar* converted = reserve_scalars<Scalar>(ws, convertedSize() + (2 * biggest_neurode));
+		Scalar* layer_out = converted + convertedSize();
+		Scalar* spare = layer_out + biggest_neurode;
+		for(size_t i=0; i < layers.size(); ++i) {
+			const Layer& l = layers[i];
+			Scalar* dst = (i+1 < layers.size())? layer_out : out;
+			layer_forward(l.layout, l.input_size, l.output_size, computeWeights(i, converted), in, dst);
+			activation::apply(act, dst, l.output_size);
+			in = dst;
+			std::swap(layer_out, spare);
+		}
+	}
+
+	template<typename Weight>
+	template<typename Activation, typename>
+	void TypedStripe<Weight>::guessBatch(
+			const Activation& act,
+			const Scalar* in, size_t rows,
+			Scalar* out
+	) const {
+		guessBatch(act, in, rows, out, thread_workspace);
+	}
+
+	template<typename Weight>
+	template<typename Activation, typename>
+	void TypedStripe<Weight>::guessBatch(
+			const Activation& act,
+			const Scalar* in, size_t rows,
+			Scalar* out,
+			Workspace& ws
+	) const {
+		/* As Stripe::guessBatch: every layer is converted and
+		 * transposed once, followed by its biases */
+		size_t weight_count = 0;
+		for(const Layer& l : layers)
+			weight_count += (l.input_size + 1) * l.output_size;
+		Scalar* columns = reserve_scalars<Scalar>(ws,
+				weight_count + convertedSize() + (2 * BATCH_TILE_ROWS * biggest_neurode));
+		Scalar* converted = columns + weight_count;
+		Scalar* tile_in  = converted + convertedSize();
+		Scalar* tile_out = tile_in + (BATCH_TILE_ROWS * biggest_neurode);
+
+		Scalar* dst = columns;
+		for(size_t i=0; i < layers.size(); ++i) {
+			const Layer& l = layers[i];
+			const Scalar* w = computeWeights(i, converted);
+			for(size_t o=0; o < l.output_size; ++o)
+			for(size_t j=0; j < l.input_size; ++j)
+				dst[(j * l.output_size) + o] = w[l.at(o, j)];
+			for(size_t o=0; o < l.output_size; ++o)
+				dst[(l.input_size * l.output_size) + o] = w[(l.input_size * l.output_size) + o];
+			dst += (l.input_size + 1) * l.output_size;
+		}
+
+		for(size_t row=0; row < rows; row += BATCH_TILE_ROWS) {
+			size_t tile_rows = rows - row;
+			if(tile_rows > BATCH_TILE_ROWS)  tile_rows = BATCH_TILE_ROWS;
+			const Scalar* layer_in = in + (row * input_size);
+			const Scalar* w = columns;
+			for(size_t i=0; i < layers.size(); ++i) {
+				const Layer& l = layers[i];
+				Scalar* layer_out = (i+1 < layers.size())?
+						tile_out : out + (row * output_size);
+				kernel::gemm(
+						layer_in, w, w + (l.input_size * l.output_size),
+						layer_out, tile_rows, l.input_size, l.output_size);
+				activation::apply(act, layer_out, tile_rows * l.output_size);
+				w += (l.input_size + 1) * l.output_size;
+				std::swap(tile_in, tile_out);
+				layer_in = tile_in;
+			}
+		}
+	}
+
+	template<typename Weight>
+	size_t TypedStripe<Weight>::workspaceSize() const {
+		/* guessBatch needs the transposed weights and two tiles of
+		 * activations, train the activations and errors of every layer */
+		size_t weight_count = 0;
+		size_t activations = output_size;
+		for(const Layer& l : layers) {
+			weight_count += (l.input_size + 1) * l.output_size;
+			activations += l.input_size;
+		}
+		size_t batch = weight_count + convertedSize() + (2 * BATCH_TILE_ROWS * biggest_neurode);
+		size_t training = 2 * activations;
+		return doubles_for(((batch > training)? batch : training) * sizeof(Scalar));
+	}
+
+	template<typename Weight>
+	template<typename Activation, typename>
+	typename TypedStripe<Weight>::Scalar TypedStripe<Weight>::train(
+			const Activation& act,
+			const Scalar* in, const Scalar* expect,
+			Scalar rate
+	) {
+		static_assert(TRAINABLE, "Only float and double weights can be trained");
+
+		/* The inputs of every layer, then the outputs, one after the
+		 * other; the errors are laid out the same way */
+		size_t activations = output_size;
+		for(const Layer& l : layers)
+			activations += l.input_size;
+		Scalar* forward = reserve_scalars<Scalar>(thread_workspace, 2 * activations);
+		Scalar* backward = forward + activations;
+
+		for(size_t i=0; i < input_size; ++i)
+			forward[i] = in[i];
+		Scalar* layer_in = forward;
+		for(const Layer& l : layers) {
+			Scalar* layer_out = layer_in + l.input_size;
+			layer_forward(l.layout, l.input_size, l.output_size, l.weights, layer_in, layer_out);
+			activation::apply(act, layer_out, l.output_size);
+			layer_in = layer_out;
+		}
+
+		size_t out_offset = activations - output_size;
+		Scalar avg_error = 0;
+		for(size_t i=0; i < output_size; ++i) {
+			Scalar error = forward[out_offset + i] - expect[i];
+			backward[out_offset + i] = error;
+			if(error < 0)  error = -error;
+			avg_error += error / output_size;
+		}
+
+		/* The same back-propagation as Stripe::train: each layer
+		 * learns from the errors of its outputs */
+		for(size_t layer = layers.size(); layer-- > 0; ) {
+			Layer& l = layers[layer];
+			size_t in_offset = out_offset - l.input_size;
+			const Scalar* errors = backward + out_offset;
+			const Scalar* inputs = forward + in_offset;
+			if(layer > 0) {
+				Scalar accum = 0;
+				for(size_t i=0; i < l.output_size; ++i)
+					accum += errors[i];
+				for(size_t i=0; i < l.input_size; ++i)
+					backward[in_offset + i] = accum * act.derive(inputs[i]);
+			}
+			layer_learn(l.layout, l.input_size, l.output_size, l.weights, inputs, errors, rate);
+			out_offset = in_offset;
+		}
+
+		return avg_error;
+	}
+
+
+	template class TypedStripe<float>;
+	template class TypedStripe<double>;
+	template class TypedStripe<precision::bf16>;
+	template class TypedStripe<precision::fp16>;
+
+	#define NN_INSTANTIATE_INFERENCE(Weight, Activation) \
+		template void TypedStripe<Weight>::guess<Activation>( \
+				const Activation&, \
+				const TypedStripe<Weight>::Scalar*, TypedStripe<Weight>::Scalar*) const; \
+		template void TypedStripe<Weight>::guessBatch<Activation>( \
+				const Activation&, \
+				const TypedStripe<Weight>::Scalar*, size_t, TypedStripe<Weight>::Scalar*) const; \
+		template void TypedStripe<Weight>::guess<Activation>( \
+				const Activation&, \
+				const TypedStripe<Weight>::Scalar*, TypedStripe<Weight>::Scalar*, Workspace&) const; \
+		template void TypedStripe<Weight>::guessBatch<Activation>( \
+				const Activation&, \
+				const TypedStripe<Weight>::Scalar*, size_t, TypedStripe<Weight>::Scalar*, Workspace&) const;
+	#define NN_INSTANTIATE_TRAINING(Weight, Activation) \
+		template TypedStripe<Weight>::Scalar TypedStripe<Weight>::train<Activation>( \
+				const Activation&, \
+				const TypedStripe<Weight>::Scalar*, const TypedStripe<Weight>::Scalar*, \
+				TypedStripe<Weight>::Scalar);
+
+	#define NN_INSTANTIATE_FLOAT(Activation) \
+		NN_INSTANTIATE_INFERENCE(float, Activation) \
+		NN_INSTANTIATE_TRAINING(float, Activation)
+	#define NN_INSTANTIATE_DOUBLE(Activation) \
+		NN_INSTANTIATE_INFERENCE(double, Activation) \
+		NN_INSTANTIATE_TRAINING(double, Activation)
+	#define NN_INSTANTIATE_BF16(Activation) \
+		NN_INSTANTIATE_INFERENCE(precision::bf16, Activation)
+	#define NN_INSTANTIATE_FP16(Activation) \
+		NN_INSTANTIATE_INFERENCE(precision::fp16, Activation)
+
+	NN_ACTIVATION_POLICIES(NN_INSTANTIATE_FLOAT)
+	NN_ACTIVATION_POLICIES(NN_INSTANTIATE_DOUBLE)
+	NN_ACTIVATION_POLICIES(NN_INSTANTIATE_BF16)
+	NN_ACTIVATION_POLICIES(NN_INSTANTIATE_FP16)
+
+	#undef NN_INSTANTIATE_FP16
+	#undef NN_INSTANTIATE_BF16
+	#undef NN_INSTANTIATE_DOUBLE
+	#undef NN_INSTANTIATE_FLOAT
+	#undef NN_INSTANTIATE_TRAINING
+	#undef NN_INSTANTIATE_INFERENCE
+
+}
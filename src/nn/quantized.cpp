@@ -0,0 +1,461 @@
+#include "nn/quantized.hpp"
+#include "nn/kernels.hpp"
+
+#include <cmath>
+#include <cstring> // memcpy(...), memset(...)
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define NN_QUANTIZED_X86
+	#include <immintrin.h>
+#endif
+
+
+
+namespace {
+
+	constexpr size_t CHUNK = 4;
+	constexpr size_t GROUP = 16;
+	constexpr size_t BLOCK = CHUNK * GROUP;
+	constexpr size_t TILE_ROWS = 64;
+	constexpr int RANGE = 127;
+
+	/* out[(r * groups * GROUP) + o] = sum(x[(r * chunks * CHUNK) + j] * w[o][j]),
+	 * for the interleaved weights of QuantizedStripe::Layer;
+	 * sums[o] is the sum of w[o] */
+	using qgemm_func = void (*)(
+			const int8_t* x, const int8_t* w, const int32_t* sums,
+			int32_t* out, size_t rows, size_t groups, size_t chunks);
+
+	/* Quantizes n values to q, returning their scale */
+	using quantize_func = float (*)(const float* x, int8_t* q, size_t n);
+
+	struct Kernels {
+		quantize_func quantize;
+		qgemm_func qgemm;
+	};
+
+
+	/* Used by the overloads of QuantizedStripe::guess and
+	 * QuantizedStripe::guessBatch that take no Workspace */
+	thread_local nn::Workspace thread_workspace;
+
+
+	// The weights, then a block each for the sums, scales and biases
+	size_t layer_bytes(size_t groups, size_t chunks) {
+		return groups * BLOCK * (chunks + 3);
+	}
+
+	constexpr size_t doubles_for(size_t bytes) {
+		return (bytes + sizeof(double) - 1) / sizeof(double);
+	}
+
+	/* Quantizes a row of activations, returning its scale;
+	 * the padding past n is left untouched, as it only
+	 * meets zero weights */
+	__attribute__((always_inline))
+	inline float quantize_row(const float* x, int8_t* q, size_t n) {
+		/* The magnitudes of non-negative floats compare as their
+		 * bits do, which lets the maximum be vectorized */
+		uint32_t max_bits = 0;
+		for(size_t i=0; i < n; ++i) {
+			uint32_t bits;
+			memcpy(&bits, x + i, sizeof(bits));
+			bits &= 0x7FFFFFFFu;
+			max_bits = (bits > max_bits)? bits : max_bits;
+		}
+		float max;
+		memcpy(&max, &max_bits, sizeof(max));
+		if(! (max > 0.0f)) {
+			memset(q, 0, n);
+			return 0.0f;
+		}
+		float inv_scale = RANGE / max;
+		// Rounded on its own, the product is never fused into an FMA
+		for(size_t i=0; i < n; ++i)
+			q[i] = static_cast<int8_t>(std::nearbyint(x[i] * inv_scale));
+		return max / RANGE;
+	}
+
+	float quantize_scalar(const float* x, int8_t* q, size_t n) {
+		return quantize_row(x, q, n);
+	}
+
+
+	void qgemm_scalar(
+			const int8_t* x, const int8_t* w, const int32_t*,
+			int32_t* out, size_t rows, size_t groups, size_t chunks
+	) {
+		for(size_t r=0; r < rows; ++r) {
+			const int8_t* block = w;
+			for(size_t g=0; g < groups; ++g) {
+				int32_t accum[GROUP] = { };
+				for(size_t k=0; k < chunks; ++k) {
+					for(size_t o=0; o < GROUP; ++o)
+					for(size_t b=0; b < CHUNK; ++b)
+						accum[o] += static_cast<int32_t>(x[(k * CHUNK) + b]) * block[(o * CHUNK) + b];
+					block += BLOCK;
+				}
+				for(size_t o=0; o < GROUP; ++o)
+					out[(g * GROUP) + o] = accum[o];
+			}
+			x += chunks * CHUNK;
+			out += groups * GROUP;
+		}
+	}
+
+
+	#ifdef NN_QUANTIZED_X86
+
+		inline int32_t load_chunk(const int8_t* x) {
+			int32_t chunk;
+			memcpy(&chunk, x, sizeof(chunk));
+			return chunk;
+		}
+
+		// The same loops as the scalar version, vectorized by the compiler
+		__attribute__((target("avx2")))
+		float quantize_avx2(const float* x, int8_t* q, size_t n) {
+			return quantize_row(x, q, n);
+		}
+
+		__attribute__((target("avx512f,avx512bw")))
+		float quantize_avx512(const float* x, int8_t* q, size_t n) {
+			return quantize_row(x, q, n);
+		}
+
+
+		/* Every 32-bit lane sums the 4 products of an output, so that
+		 * no horizontal sum is needed; R rows share each load of the
+		 * weights. pmaddubsw takes unsigned bytes on one side:
+		 * the weights lend their sign to the inputs, and the
+		 * pairwise 16-bit sums are widened by pmaddwd */
+		template<size_t R>
+		__attribute__((target("avx2")))
+		inline void qrows_avx2(
+				const int8_t* x, const int8_t* w,
+				int32_t* out, size_t groups, size_t chunks
+		) {
+			const __m256i ones = _mm256_set1_epi16(1);
+			for(size_t g=0; g < groups; ++g) {
+				__m256i accum[R][2];
+				for(size_t r=0; r < R; ++r)
+					accum[r][0] = accum[r][1] = _mm256_setzero_si256();
+				for(size_t k=0; k < chunks; ++k) {
+					__m256i w0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(w));
+					__m256i w1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(w + 32));
+					__m256i abs0 = _mm256_abs_epi8(w0);
+					__m256i abs1 = _mm256_abs_epi8(w1);
+					for(size_t r=0; r < R; ++r) {
+						__m256i xv = _mm256_set1_epi32(load_chunk(x + (r * chunks * CHUNK) + (k * CHUNK)));
+						__m256i p0 = _mm256_maddubs_epi16(abs0, _mm256_sign_epi8(xv, w0));
+						__m256i p1 = _mm256_maddubs_epi16(abs1, _mm256_sign_epi8(xv, w1));
+						accum[r][0] = _mm256_add_epi32(accum[r][0], _mm256_madd_epi16(p0, ones));
+						accum[r][1] = _mm256_add_epi32(accum[r][1], _mm256_madd_epi16(p1, ones));
+					}
+					w += BLOCK;
+				}
+				for(size_t r=0; r < R; ++r) {
+					int32_t* dst = out + (r * groups * GROUP) + (g * GROUP);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), accum[r][0]);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 8), accum[r][1]);
+				}
+			}
+		}
+
+		__attribute__((target("avx2")))
+		void qgemm_avx2(
+				const int8_t* x, const int8_t* w, const int32_t*,
+				int32_t* out, size_t rows, size_t groups, size_t chunks
+		) {
+			size_t r = 0;
+			for(; r+4 <= rows; r += 4)
+				qrows_avx2<4>(x + (r * chunks * CHUNK), w, out + (r * groups * GROUP), groups, chunks);
+			for(; r < rows; ++r)
+				qrows_avx2<1>(x + (r * chunks * CHUNK), w, out + (r * groups * GROUP), groups, chunks);
+		}
+
+
+		/* GCC's unmasked AVX-512 intrinsics start from deliberately
+		 * undefined registers, which -Wmaybe-uninitialized reports */
+		#pragma GCC diagnostic push
+		#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+		/* vpdpbusd does the products and both widenings at once,
+		 * but also takes unsigned inputs: they are offset by 128,
+		 * which the sums of the weights take back out */
+		template<size_t R>
+		__attribute__((target("avx512f,avx512bw,avx512vnni")))
+		inline void qrows_vnni(
+				const int8_t* x, const int8_t* w, const int32_t* sums,
+				int32_t* out, size_t groups, size_t chunks
+		) {
+			const __m512i offset = _mm512_set1_epi8(-128);
+			for(size_t g=0; g < groups; ++g) {
+				__m512i accum[R];
+				for(size_t r=0; r < R; ++r)
+					accum[r] = _mm512_setzero_si512();
+				for(size_t k=0; k < chunks; ++k) {
+					__m512i wv = _mm512_load_si512(w);
+					for(size_t r=0; r < R; ++r) {
+						__m512i xv = _mm512_set1_epi32(load_chunk(x + (r * chunks * CHUNK) + (k * CHUNK)));
+						accum[r] = _mm512_dpbusd_epi32(accum[r], _mm512_xor_si512(xv, offset), wv);
+					}
+					w += BLOCK;
+				}
+				__m512i correction = _mm512_slli_epi32(_mm512_load_si512(sums + (g * GROUP)), 7);
+				for(size_t r=0; r < R; ++r)
+					_mm512_storeu_si512(
+							out + (r * groups * GROUP) + (g * GROUP),
+							_mm512_sub_epi32(accum[r], correction));
+			}
+		}
+
+		__attribute__((target("avx512f,avx512bw,avx512vnni")))
+		void qgemm_vnni(
+				const int8_t* x, const int8_t* w, const int32_t* sums,
+				int32_t* out, size_t rows, size_t groups, size_t chunks
+		) {
+			size_t r = 0;
+			for(; r+8 <= rows; r += 8)
+				qrows_vnni<8>(x + (r * chunks * CHUNK), w, sums, out + (r * groups * GROUP), groups, chunks);
+			for(; r < rows; ++r)
+				qrows_vnni<1>(x + (r * chunks * CHUNK), w, sums, out + (r * groups * GROUP), groups, chunks);
+		}
+
+		#pragma GCC diagnostic pop
+
+		bool has_vnni() {
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+		}
+
+	#endif
+
+
+	/* Follows the instruction set selected by nn::kernel:
+	 * AVX-512 uses VNNI where available, and the AVX2
+	 * implementation otherwise; SSE2 uses the scalar one */
+	Kernels select_set() {
+		using nn::kernel::InstructionSet;
+		switch(nn::kernel::instruction_set()) {
+			#ifdef NN_QUANTIZED_X86
+				case InstructionSet::AVX512: {
+					static const bool vnni = has_vnni();
+					if(vnni)  return { quantize_avx512, qgemm_vnni };
+					return { quantize_avx512, qgemm_avx2 };
+				}
+				case InstructionSet::AVX2:  return { quantize_avx2, qgemm_avx2 };
+			#endif
+			default:  return { quantize_scalar, qgemm_scalar };
+		}
+	}
+
+
+}
+
+
+
+namespace nn {
+
+	QuantizedStripe::QuantizedStripe(const Stripe& src):
+			input_size (src.inputSize()),
+			output_size (src.outputSize()),
+			biggest_neurode ((input_size > output_size)? input_size : output_size),
+			biggest_chunks (0),
+			biggest_groups (0),
+			layers ()
+	{
+		layers.reserve(src.neurodeCount());
+		for(size_t i=0; i < src.neurodeCount(); ++i) {
+			const Neurode& n = src[i];
+			size_t in  = n.inputSize();
+			size_t out = n.outputSize();
+			size_t chunks = (in + CHUNK - 1) / CHUNK;
+			size_t groups = (out + GROUP - 1) / GROUP;
+			size_t weight_bytes = groups * chunks * BLOCK;
+			char* block = reinterpret_cast<char*>(alloc_aligned(layer_bytes(groups, chunks)));
+			memset(block, 0, layer_bytes(groups, chunks));
+			Layer l = {
+				in, out, chunks, groups,
+				reinterpret_cast<int8_t*>(block),
+				reinterpret_cast<int32_t*>(block + weight_bytes),
+				reinterpret_cast<float*>(block + weight_bytes + (groups * BLOCK)),
+				reinterpret_cast<float*>(block + weight_bytes + (2 * groups * BLOCK)) };
+
+			const double* w = n.weightData();
+			bool row_major = (n.weightLayout() == WeightLayout::ROW_MAJOR);
+			for(size_t o=0; o < out; ++o) {
+				double max = 0.0;
+				for(size_t j=0; j < in; ++j)
+					max = std::fmax(max, std::fabs(row_major? w[(o * in) + j] : w[(j * out) + o]));
+				l.scales[o] = (max > 0.0)? max / RANGE : 1.0;
+
+				int8_t* group = l.weights + ((o / GROUP) * chunks * BLOCK) + ((o % GROUP) * CHUNK);
+				for(size_t j=0; j < in; ++j) {
+					double value = row_major? w[(o * in) + j] : w[(j * out) + o];
+					long q = std::lround(value / l.scales[o]);
+					q = (q > RANGE)? RANGE : ((q < -RANGE)? -RANGE : q);
+					group[((j / CHUNK) * BLOCK) + (j % CHUNK)] = q;
+					l.sums[o] += q;
+				}
+				l.biases[o] = n.biasData()[o];
+			}
+
+			layers.push_back(l);
+			if(out > biggest_neurode)  biggest_neurode = out;
+			if(chunks > biggest_chunks)  biggest_chunks = chunks;
+			if(groups > biggest_groups)  biggest_groups = groups;
+		}
+	}
+
+	QuantizedStripe::QuantizedStripe(const QuantizedStripe& cpy):
+			input_size (cpy.input_size),
+			output_size (cpy.output_size),
+			biggest_neurode (cpy.biggest_neurode),
+			biggest_chunks (cpy.biggest_chunks),
+			biggest_groups (cpy.biggest_groups),
+			layers (cpy.layers)
+	{
+		for(Layer& l : layers) {
+			size_t bytes = layer_bytes(l.groups, l.chunks);
+			size_t weight_bytes = l.groups * l.chunks * BLOCK;
+			char* block = reinterpret_cast<char*>(alloc_aligned(bytes));
+			memcpy(block, l.weights, bytes);
+			l.weights = reinterpret_cast<int8_t*>(block);
+			l.sums    = reinterpret_cast<int32_t*>(block + weight_bytes);
+			l.scales  = reinterpret_cast<float*>(block + weight_bytes + (l.groups * BLOCK));
+			l.biases  = reinterpret_cast<float*>(block + weight_bytes + (2 * l.groups * BLOCK));
+		}
+	}
+
+	QuantizedStripe::QuantizedStripe(QuantizedStripe&& mov):
+			input_size (std::move(mov.input_size)),
+			output_size (std::move(mov.output_size)),
+			biggest_neurode (std::move(mov.biggest_neurode)),
+			biggest_chunks (std::move(mov.biggest_chunks)),
+			biggest_groups (std::move(mov.biggest_groups)),
+			layers (std::move(mov.layers))
+	{
+		mov.layers.clear();
+	}
+
+	QuantizedStripe::~QuantizedStripe() {
+		for(Layer& l : layers)
+			free_aligned(l.weights);
+		layers.clear();
+	}
+
+	QuantizedStripe& QuantizedStripe::operator = (const QuantizedStripe& cpy) {
+		this->~QuantizedStripe();
+		new (this) QuantizedStripe(cpy);
+		return *this;
+	}
+
+	QuantizedStripe& QuantizedStripe::operator = (QuantizedStripe&& mov) {
+		this->~QuantizedStripe();
+		new (this) QuantizedStripe(std::move(mov));
+		return *this;
+	}
+
+
+	size_t QuantizedStripe::weightBytes() const {
+		size_t bytes = 0;
+		for(const Layer& l : layers)
+			bytes += layer_bytes(l.groups, l.chunks);
+		return bytes;
+	}
+
+	size_t QuantizedStripe::workspaceSize() const {
+		/* The accumulators and the float activations come first,
+		 * so that the bytes of the quantized rows come last */
+		size_t accumulators = TILE_ROWS * biggest_groups * GROUP;
+		size_t floats = (2 * TILE_ROWS * biggest_neurode) + TILE_ROWS;
+		size_t bytes = TILE_ROWS * biggest_chunks * CHUNK;
+		return doubles_for((accumulators * sizeof(int32_t)) + (floats * sizeof(float)) + bytes);
+	}
+
+
+	template<typename Activation>
+	void QuantizedStripe::forward(
+			const Activation& act,
+			const float* in, size_t rows,
+			float* out,
+			Workspace& ws
+	) const {
+		Kernels kernels = select_set();
+		int32_t* accumulators = reinterpret_cast<int32_t*>(ws.reserve(workspaceSize()));
+		float* activations = reinterpret_cast<float*>(accumulators + (TILE_ROWS * biggest_groups * GROUP));
+		float* scales = activations + (2 * TILE_ROWS * biggest_neurode);
+		int8_t* quantized = reinterpret_cast<int8_t*>(scales + TILE_ROWS);
+		float* buffers[2] = { activations, activations + (TILE_ROWS * biggest_neurode) };
+		for(size_t i=0; i < layers.size(); ++i) {
+			const Layer& l = layers[i];
+			float* layer_out = (i+1 < layers.size())? buffers[i % 2] : out;
+			for(size_t r=0; r < rows; ++r)
+				scales[r] = kernels.quantize(
+						in + (r * l.input_size),
+						quantized + (r * l.chunks * CHUNK), l.input_size);
+			kernels.qgemm(
+					quantized, l.weights, l.sums,
+					accumulators, rows, l.groups, l.chunks);
+			for(size_t r=0; r < rows; ++r) {
+				float scale = scales[r];
+				const int32_t* accum = accumulators + (r * l.groups * GROUP);
+				float* row = layer_out + (r * l.output_size);
+				for(size_t o=0; o < l.output_size; ++o)
+					row[o] = (static_cast<float>(accum[o]) * (scale * l.scales[o])) + l.biases[o];
+			}
+			activation::apply(act, layer_out, rows * l.output_size);
+			in = layer_out;
+		}
+	}
+
+	template<typename Activation, typename>
+	void QuantizedStripe::guess(const Activation& act, const float* in, float* out) const {
+		forward(act, in, 1, out, thread_workspace);
+	}
+
+	template<typename Activation, typename>
+	void QuantizedStripe::guess(const Activation& act, const float* in, float* out, Workspace& ws) const {
+		forward(act, in, 1, out, ws);
+	}
+
+	template<typename Activation, typename>
+	void QuantizedStripe::guessBatch(
+			const Activation& act,
+			const float* in, size_t rows,
+			float* out
+	) const {
+		guessBatch(act, in, rows, out, thread_workspace);
+	}
+
+	template<typename Activation, typename>
+	void QuantizedStripe::guessBatch(
+			const Activation& act,
+			const float* in, size_t rows,
+			float* out,
+			Workspace& ws
+	) const {
+		for(size_t row=0; row < rows; row += TILE_ROWS) {
+			size_t tile_rows = rows - row;
+			if(tile_rows > TILE_ROWS)  tile_rows = TILE_ROWS;
+			forward(act, in + (row * input_size), tile_rows, out + (row * output_size), ws);
+		}
+	}
+
+
+	#define NN_INSTANTIATE(Activation) \
+		template void QuantizedStripe::guess<Activation>( \
+				const Activation&, const float*, float*) const; \
+		template void QuantizedStripe::guessBatch<Activation>( \
+				const Activation&, const float*, size_t, float*) const; \
+		template void QuantizedStripe::guess<Activation>( \
+				const Activation&, const float*, float*, Workspace&) const; \
+		template void QuantizedStripe::guessBatch<Activation>( \
+				const Activation&, const float*, size_t, float*, Workspace&) const;
+
+	NN_ACTIVATION_POLICIES(NN_INSTANTIATE)
+
+	#undef NN_INSTANTIATE
+
+}
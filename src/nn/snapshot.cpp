@@ -0,0 +1,38 @@
+#include "nn/snapshot.hpp"
+
+
+
+namespace nn {
+
+	StripeSnapshot::StripeSnapshot(const Stripe& stripe):
+			slots { nullptr, nullptr, nullptr },
+			epochs { 0, 0, 0 },
+			back (0),
+			front (1),
+			middle (2),
+			published (0)
+	{
+		for(Stripe*& slot : slots)
+			slot = new Stripe(stripe);
+	}
+
+	StripeSnapshot::~StripeSnapshot() {
+		for(Stripe*& slot : slots) {
+			delete slot;  slot = nullptr;
+		}
+	}
+
+
+	void StripeSnapshot::publish(const Stripe& stripe) {
+		slots[back]->copyWeights(stripe);
+		epochs[back] = ++published;
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+	}
+
+	const Stripe& StripeSnapshot::acquire() {
+		if(0 != (middle.load(std::memory_order_relaxed) & FRESH))
+			front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+		return *slots[front];
+	}
+
+}
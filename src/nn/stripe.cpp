@@ -1,4 +1,67 @@
 #include "nn/nn.hpp"
+#include "nn/kernels.hpp"
+
+#include <sys/mman.h> // munmap(...)
+
+
+
+namespace {
+	/* Rows evaluated together by Stripe::guessBatch: small enough
+	 * for a tile of activations to stay in the L1/L2 cache */
+	constexpr size_t BATCH_TILE_ROWS = 64;
+
+	/* Used by the overloads of Stripe::guess and
+	 * Stripe::guessBatch that take no Workspace */
+	thread_local nn::Workspace thread_workspace;
+
+	/* Rounds a number of doubles up to whole cache lines, so that
+	 * no two buffers of a Stripe's arena share one */
+	constexpr size_t cache_lines(size_t doubles) {
+		constexpr size_t PER_LINE = 64 / sizeof(double);
+		return ((doubles + PER_LINE - 1) / PER_LINE) * PER_LINE;
+	}
+
+
+	/* Shared by the mini-batch overloads of Stripe::train;
+	 * (get_row) retrieves the inputs and outputs of a sample */
+	template<typename Activation, typename RowFunc>
+	double train_batches(
+			nn::Stripe& stripe,
+			const Activation& act,
+			size_t size, long long int which,
+			double rate, size_t batch_size,
+			nn::Gradient& buffer,
+			RowFunc get_row
+	) {
+		if(size == 0)  return 0.0;
+		if(batch_size < 1)  batch_size = 1;
+
+		size_t first, count;
+		if(which < 0) {
+			first = 0;
+			count = size;
+		} else {
+			first = which % size;
+			count = (batch_size < size)? batch_size : size;
+		}
+
+		double avg_error = 0.0;
+		for(size_t done = 0; done < count; done += batch_size) {
+			size_t batch_end = done + batch_size;
+			if(batch_end > count)  batch_end = count;
+			buffer.clear();
+			for(size_t i = done; i < batch_end; ++i) {
+				const double* in;
+				const double* out;
+				get_row((first + i) % size, &in, &out);
+				avg_error += stripe.accumulate(act, in, out, buffer);
+			}
+			stripe.apply(buffer, rate);
+		}
+		return avg_error / count;
+	}
+
+}
 
 
 
@@ -7,39 +70,32 @@ namespace nn {
 	Stripe::Stripe(
 			size_t inputs,
 			std::vector<size_t> layer_sizes,
-			size_t outputs
+			size_t outputs,
+			WeightLayout layout
 	):
 			input_size (inputs),
 			output_size (outputs),
 			biggest_neurode ((inputs > outputs)? inputs : outputs),
 			neurodes_count (layer_sizes.size() + 1),
 			neurodes (),
-			_forward (new double*[neurodes_count+1]),
-			_backward (new double*[neurodes_count+1])
+			_forward (nullptr),
+			_backward (nullptr),
+			_arena (nullptr),
+			_mapping (nullptr),
+			_mapping_size (0)
 	{
+		/* The neurodes are only shaped here; their weights
+		 * are placed by allocateArena */
 		neurodes.reserve(neurodes_count);
-		if(neurodes_count > 1) {
-			size_t i;
-			neurodes.push_back(Neurode(inputs, layer_sizes[0]));
-			if(layer_sizes[0] > biggest_neurode)
-				biggest_neurode = layer_sizes[0];
-			for(i=1; i < neurodes_count-1; ++i) {
-				if(layer_sizes[i] > biggest_neurode)
-					biggest_neurode = layer_sizes[i];
-				neurodes.push_back(Neurode(layer_sizes[i-1], layer_sizes[i]));
-				_forward[i] = new double[neurodes[i].inputSize()];
-				_backward[i] = new double[neurodes[i].inputSize()];
-			}
-			neurodes.push_back(Neurode(layer_sizes[i-1], output_size));
-			_forward[i] = new double[neurodes[i].inputSize()];
-			_backward[i] = new double[neurodes[i].inputSize()];
-		} else {
-			neurodes.push_back(Neurode(input_size, output_size));
-		};
-		_forward[0] = new double[neurodes[0].inputSize()];
-		_backward[0] = new double[neurodes[0].inputSize()];
-		_forward[neurodes_count] = new double[output_size];
-		_backward[neurodes_count] = new double[output_size];
+		size_t layer_inputs = inputs;
+		for(size_t size : layer_sizes) {
+			if(size > biggest_neurode)  biggest_neurode = size;
+			neurodes.push_back(Neurode(layer_inputs, size, layout, nullptr));
+			layer_inputs = size;
+		}
+		neurodes.push_back(Neurode(layer_inputs, output_size, layout, nullptr));
+		allocateArena(true);
+		randomize();
 	}
 
 	Stripe::Stripe(const Stripe& cpy):
@@ -47,17 +103,37 @@ namespace nn {
 			output_size (cpy.output_size),
 			biggest_neurode (cpy.biggest_neurode),
 			neurodes_count (cpy.neurodes_count),
-			neurodes (cpy.neurodes),
-			_forward (new double*[neurodes_count+1]),
-			_backward (new double*[neurodes_count+1])
+			neurodes (),
+			_forward (nullptr),
+			_backward (nullptr),
+			_arena (nullptr),
+			_mapping (nullptr),
+			_mapping_size (0)
 	{
-		size_t i;
-		for(i=0; i < neurodes_count; ++i) {
-			_forward[i]  = new double[neurodes[i].inputSize()];
-			_backward[i] = new double[neurodes[i].inputSize()];
+		neurodes.reserve(neurodes_count);
+		for(const Neurode& n : cpy.neurodes)
+			neurodes.push_back(Neurode(n.inputSize(), n.outputSize(), n.weightLayout(), nullptr));
+		allocateArena(true);
+		copyWeights(cpy);
+	}
+
+	Stripe::Stripe(std::vector<Neurode>&& mov_neurodes, void* mapping, size_t mapping_size):
+			input_size (mov_neurodes.front().inputSize()),
+			output_size (mov_neurodes.back().outputSize()),
+			biggest_neurode ((input_size > output_size)? input_size : output_size),
+			neurodes_count (mov_neurodes.size()),
+			neurodes (std::move(mov_neurodes)),
+			_forward (nullptr),
+			_backward (nullptr),
+			_arena (nullptr),
+			_mapping (mapping),
+			_mapping_size (mapping_size)
+	{
+		for(const Neurode& n : neurodes) {
+			if(n.outputSize() > biggest_neurode)
+				biggest_neurode = n.outputSize();
 		}
-		_forward[i]  = new double[output_size];
-		_backward[i] = new double[output_size];
+		allocateArena(false);
 	}
 
 	Stripe::Stripe(Stripe&& mov):
@@ -67,20 +143,28 @@ namespace nn {
 			neurodes_count (std::move(mov.neurodes_count)),
 			neurodes (std::move(mov.neurodes)),
 			_forward (std::move(mov._forward)),
-			_backward (std::move(mov._backward))
+			_backward (std::move(mov._backward)),
+			_arena (std::move(mov._arena)),
+			_mapping (std::move(mov._mapping)),
+			_mapping_size (std::move(mov._mapping_size))
 	{
-		_forward = nullptr;
+		mov._forward = nullptr;
+		mov._backward = nullptr;
+		mov._arena = nullptr;
+		mov._mapping = nullptr;
 	}
 
 	Stripe::~Stripe() {
-		if(_forward != nullptr) {
-			for(size_t i=0; i <= neurodes_count; ++i) {
-				delete[] _forward[i];
-				delete[] _backward[i];
-			}
-			delete[] _forward;
-			delete[] _backward;
-			_forward  = nullptr;
+		/* The neurodes do not own their weights, and do not
+		 * access them when destroyed */
+		if(_arena != nullptr) {
+			free_aligned(_arena);
+			_arena = nullptr;
+			_forward = _backward = nullptr;
+		}
+		if(_mapping != nullptr) {
+			munmap(_mapping, _mapping_size);
+			_mapping = nullptr;
 		}
 	}
 
@@ -97,19 +181,188 @@ namespace nn {
 	}
 
 
-	void Stripe::guess(activation_func act, double* in, double* out) const {
+	void Stripe::allocateArena(bool with_weights) {
+		size_t doubles = 0;
+		if(with_weights) {
+			for(const Neurode& n : neurodes)
+				doubles += cache_lines((n.inputSize() + 1) * n.outputSize());
+		}
+		for(size_t i=0; i <= neurodes_count; ++i)
+			doubles += 2 * cache_lines(scratchSize(i));
+
+		char* arena = static_cast<char*>(alloc_aligned(
+				(doubles * sizeof(double)) + (2 * (neurodes_count+1) * sizeof(double*)) ));
+		_arena = arena;
+		double* next = reinterpret_cast<double*>(arena);
+		if(with_weights) {
+			for(Neurode& n : neurodes) {
+				n = Neurode(n.inputSize(), n.outputSize(), n.weightLayout(), next);
+				next += cache_lines((n.inputSize() + 1) * n.outputSize());
+			}
+		}
+		_forward  = reinterpret_cast<double**>(arena + (doubles * sizeof(double)));
+		_backward = _forward + (neurodes_count+1);
+		for(size_t i=0; i <= neurodes_count; ++i) {
+			_forward[i]  = next;  next += cache_lines(scratchSize(i));
+			_backward[i] = next;  next += cache_lines(scratchSize(i));
+		}
+	}
+
+
+	Workspace::Workspace():
+			buffer (nullptr),
+			capacity (0)
+	{ }
+
+	Workspace::Workspace(const Stripe& stripe):
+			buffer (alloc_buffer(stripe.workspaceSize())),
+			capacity (stripe.workspaceSize())
+	{ }
+
+	Workspace::Workspace(Workspace&& mov):
+			buffer (mov.buffer),
+			capacity (mov.capacity)
+	{
+		mov.buffer = nullptr;
+		mov.capacity = 0;
+	}
+
+	Workspace::~Workspace() {
+		if(buffer != nullptr) {
+			free_buffer(buffer);  buffer = nullptr;
+		}
+	}
+
+	Workspace& Workspace::operator = (Workspace&& mov) {
+		this->~Workspace();
+		new (this) Workspace(std::move(mov));
+		return *this;
+	}
+
+	double* Workspace::reserve(size_t count) {
+		if(count > capacity) {
+			double* grown = alloc_buffer(count);
+			if(buffer != nullptr)  free_buffer(buffer);
+			buffer = grown;
+			capacity = count;
+		}
+		return buffer;
+	}
+
+
+	void Stripe::guess(activation_func act, const double* in, double* out) const {
+		guess(activation::Function(act), in, out);
+	}
+
+	template<typename Activation, typename>
+	void Stripe::guess(const Activation& act, const double* in, double* out) const {
+		guess(act, in, out, thread_workspace);
+	}
+
+	template<typename Activation, typename>
+	void Stripe::guess(const Activation& act, const double* in, double* out, Workspace& ws) const {
+		double* buffer = ws.reserve(2 * biggest_neurode);
+		double* layer_out = buffer;
+		double* spare = buffer + biggest_neurode;
 		size_t last_n = neurodes_count - 1;
 
-		neurodes[0].guess(act, in, _forward[1]);
-		for(size_t i=1; i < last_n; ++i)
-			neurodes[i].guess(act, _forward[i], _forward[i+1]);
-		neurodes[last_n].guess(act, _forward[last_n], out);
+		for(size_t i=0; i < last_n; ++i) {
+			neurodes[i].guess(act, in, layer_out);
+			in = layer_out;
+			std::swap(layer_out, spare);
+		}
+		neurodes[last_n].guess(act, in, out);
+	}
+
+	void Stripe::guessBatch(
+			activation_func act,
+			const double* in, size_t rows,
+			double* out
+	) const {
+		guessBatch(activation::Function(act), in, rows, out);
+	}
+
+	template<typename Activation, typename>
+	void Stripe::guessBatch(
+			const Activation& act,
+			const double* in, size_t rows,
+			double* out
+	) const {
+		guessBatch(act, in, rows, out, thread_workspace);
+	}
+
+	template<typename Activation, typename>
+	void Stripe::guessBatch(
+			const Activation& act,
+			const double* in, size_t rows,
+			double* out,
+			Workspace& ws
+	) const {
+		/* Every row-major layer is transposed once, column-major ones
+		 * are used in place; then each tile of rows goes through the
+		 * whole stripe as a series of matrix-matrix products */
+		double* columns = ws.reserve(workspaceSize());
+		double* tile_in  = columns;
+		for(const Neurode& n : neurodes)
+			if(n.weightLayout() == WeightLayout::ROW_MAJOR)
+				tile_in += n.inputSize() * n.outputSize();
+		double* tile_out = tile_in + (BATCH_TILE_ROWS * biggest_neurode);
+
+		double* layer_columns = columns;
+		for(const Neurode& n : neurodes) {
+			if(n.weightLayout() == WeightLayout::ROW_MAJOR) {
+				n.copyColumns(layer_columns);
+				layer_columns += n.inputSize() * n.outputSize();
+			}
+		}
+
+		for(size_t row=0; row < rows; row += BATCH_TILE_ROWS) {
+			size_t tile_rows = rows - row;
+			if(tile_rows > BATCH_TILE_ROWS)  tile_rows = BATCH_TILE_ROWS;
+			const double* layer_in = in + (row * input_size);
+			layer_columns = columns;
+			for(size_t i=0; i < neurodes_count; ++i) {
+				const Neurode& n = neurodes[i];
+				double* layer_out = (i+1 < neurodes_count)?
+						tile_out : out + (row * output_size);
+				const double* w = n.weightData();
+				if(n.weightLayout() == WeightLayout::ROW_MAJOR) {
+					w = layer_columns;
+					layer_columns += n.inputSize() * n.outputSize();
+				}
+				kernel::gemm(
+						layer_in, w, n.biasData(),
+						layer_out, tile_rows, n.inputSize(), n.outputSize());
+				activation::apply(act, layer_out, tile_rows * n.outputSize());
+				std::swap(tile_in, tile_out);
+				layer_in = tile_in;
+			}
+		}
+	}
+
+	size_t Stripe::workspaceSize() const {
+		/* guessBatch needs the transposed row-major weights and two
+		 * tiles of activations, which is always more than guess needs */
+		size_t weight_count = 0;
+		for(const Neurode& n : neurodes)
+			if(n.weightLayout() == WeightLayout::ROW_MAJOR)
+				weight_count += n.inputSize() * n.outputSize();
+		return weight_count + (2 * BATCH_TILE_ROWS * biggest_neurode);
 	}
 
 	double Stripe::train(
 			activation_func act,
 			activation_func_deriv derive,
-			double* in, double* expect,
+			const double* in, const double* expect,
+			double rate
+	) {
+		return train(activation::Function(act, derive), in, expect, rate);
+	}
+
+	template<typename Activation, typename>
+	double Stripe::train(
+			const Activation& act,
+			const double* in, const double* expect,
 			double rate
 	) {
 		/* _backward: contains values derived from the inputs (derivative * error),
@@ -127,10 +380,11 @@ namespace nn {
 		for(size_t i=0; i < input_size; ++i)
 			_forward[0][i] = in[i];
 
-		// Make all guesses
-		for(size_t i=0; i < neurodes_count; ++i) {
-			neurodes[i].guess(act, _forward[i], _forward[i+1]);
-		}
+		/* Make all guesses; the derivatives at the hidden layers'
+		 * outputs wait in _backward, until scaled by the errors */
+		for(size_t i=0; i < last_n; ++i)
+			neurodes[i].guess(act, _forward[i], _forward[i+1], _backward[i+1]);
+		neurodes[last_n].guess(act, _forward[last_n], _forward[neurodes_count]);
 
 		/* Compute top-layer errors to output[N-1],
 		 * then learn */
@@ -149,8 +403,9 @@ namespace nn {
 			for(size_t i=0; i < neurodes[neurode].outputSize(); ++i)
 				accum += _backward[neurode_next][i];
 			for(size_t i=0; i < neurodes[neurode].inputSize(); ++i)
-				_backward[neurode][i] = accum * derive(_forward[neurode][i]);
-			neurodes[neurode].learn(act, _forward[neurode], _backward[neurode_next], rate);
+				_backward[neurode][i] *= accum;
+			// Neurode::learn does not use the activation
+			neurodes[neurode].learn(nullptr, _forward[neurode], _backward[neurode_next], rate);
 		}
 
 		// Final iteration for the first layer
@@ -158,8 +413,8 @@ namespace nn {
 		for(size_t i=0; i < neurodes[0].outputSize(); ++i)
 			accum += _backward[1][i];
 		/*for(size_t i=0; i < neurodes[0].inputSize(); ++i)
-			_backward[0][i] = accum * derive(_forward[0][i]);*/
-		neurodes[0].learn(act, _forward[0], _backward[1], rate);
+			_backward[0][i] = accum * act.derive(_forward[0][i]);*/
+		neurodes[0].learn(nullptr, _forward[0], _backward[1], rate);
 
 		// Finally: hope
 		return avg_error;
@@ -184,10 +439,184 @@ namespace nn {
 		return avg_error;
 	}
 
+	double Stripe::train(
+		activation_func act, activation_func_deriv derive,
+		DataSet& data, long long int which,
+		double rate, size_t batch_size
+	) {
+		Gradient buffer = Gradient(*this);
+		return train(act, derive, data, which, rate, batch_size, buffer);
+	}
+
+	double Stripe::train(
+		activation_func act, activation_func_deriv derive,
+		DataSet& data, long long int which,
+		double rate, size_t batch_size,
+		Gradient& buffer
+	) {
+		return train_batches(
+				*this, activation::Function(act, derive),
+				data.size(), which, rate, batch_size, buffer,
+				[&data] (size_t i, const double** in, const double** out) {
+					*in  = data[i].inputs.data();
+					*out = data[i].outputs.data();
+				});
+	}
+
+	double Stripe::train(
+		activation_func act, activation_func_deriv derive,
+		const DataView& data, long long int which, double rate
+	) {
+		return train(activation::Function(act, derive), data, which, rate);
+	}
+
+	template<typename Activation, typename>
+	double Stripe::train(
+		const Activation& act,
+		const DataView& data, long long int which, double rate
+	) {
+		if(data.empty())  return 0.0;
+		if(which >= 0) {
+			size_t row = which % data.size();
+			return train(act, data.inputRow(row), data.outputRow(row), rate);
+		}
+		double avg_error = 0.0;
+		for(size_t i=0; i < data.size(); ++i)
+			avg_error += train(act, data.inputRow(i), data.outputRow(i), rate);
+		return avg_error / data.size();
+	}
+
+	double Stripe::train(
+		activation_func act, activation_func_deriv derive,
+		const DataView& data, long long int which,
+		double rate, size_t batch_size
+	) {
+		Gradient buffer = Gradient(*this);
+		return train(act, derive, data, which, rate, batch_size, buffer);
+	}
+
+	double Stripe::train(
+		activation_func act, activation_func_deriv derive,
+		const DataView& data, long long int which,
+		double rate, size_t batch_size,
+		Gradient& buffer
+	) {
+		return train(activation::Function(act, derive), data, which, rate, batch_size, buffer);
+	}
+
+	template<typename Activation, typename>
+	double Stripe::train(
+		const Activation& act,
+		const DataView& data, long long int which,
+		double rate, size_t batch_size,
+		Gradient& buffer
+	) {
+		return train_batches(
+				*this, act, data.size(), which, rate, batch_size, buffer,
+				[&data] (size_t i, const double** in, const double** out) {
+					*in  = data.inputRow(i);
+					*out = data.outputRow(i);
+				});
+	}
+
+	double Stripe::accumulate(
+			activation_func act,
+			activation_func_deriv derive,
+			const double* in, const double* expect,
+			Gradient& buffer
+	) const {
+		return accumulate(activation::Function(act, derive), in, expect, buffer);
+	}
+
+	template<typename Activation, typename>
+	double Stripe::accumulate(
+			const Activation& act,
+			const double* in, const double* expect,
+			Gradient& buffer
+	) const {
+		/* Same as the single-sample Stripe::train, except that
+		 * each layer's update goes to the gradient buffer;
+		 * the errors never depend on the updated weights, so
+		 * a batch of one sample is equivalent to plain SGD */
+		size_t last_n = neurodes_count - 1;
+
+		double avg_error = 0.0;
+
+		for(size_t i=0; i < input_size; ++i)
+			_forward[0][i] = in[i];
+
+		for(size_t i=0; i < last_n; ++i)
+			neurodes[i].guess(act, _forward[i], _forward[i+1], _backward[i+1]);
+		neurodes[last_n].guess(act, _forward[last_n], _forward[neurodes_count]);
+
+		double d_output_size = output_size;
+		for(size_t i=0; i < output_size; ++i) {
+			double error = nn::error(expect[i], _forward[neurodes_count][i]);
+			_backward[neurodes_count][i] = error;
+			if(error < 0.0)  error = -error;
+			avg_error += error / d_output_size;
+		}
+
+		for(size_t neurode = last_n; neurode > 0; --neurode) {
+			size_t neurode_next = neurode + 1;
+			double accum = 0.0;
+			for(size_t i=0; i < neurodes[neurode].outputSize(); ++i)
+				accum += _backward[neurode_next][i];
+			for(size_t i=0; i < neurodes[neurode].inputSize(); ++i)
+				_backward[neurode][i] *= accum;
+			buffer[neurode].accumulate(_forward[neurode], _backward[neurode_next]);
+		}
+
+		buffer[0].accumulate(_forward[0], _backward[1]);
+		buffer.addSample();
+
+		return avg_error;
+	}
+
+	void Stripe::apply(const Gradient& gradient, double rate) {
+		if(gradient.layerCount() != neurodes_count)
+			throw NeuralException("Gradient does not match the stripe's layers");
+		for(size_t i=0; i < neurodes_count; ++i)
+			if(! neurodes[i].sameShape(gradient[i]))
+				throw NeuralException("Gradient does not match the stripe's layers");
+		if(gradient.sampleCount() == 0)  return;
+		rate /= gradient.sampleCount();
+		for(size_t i=0; i < neurodes_count; ++i)
+			neurodes[i].descend(gradient[i], rate);
+	}
+
+	void Stripe::copyWeights(const Stripe& src) {
+		if(src.neurodes_count != neurodes_count)
+			throw NeuralException("Cannot copy weights between differently shaped stripes");
+		for(size_t i=0; i < neurodes_count; ++i)
+			neurodes[i].copyWeights(src.neurodes[i]);
+	}
+
 	void Stripe::randomize() {
 		for(size_t i=0; i < neurodes_count; ++i)
 			neurodes[i].randomize();
 		// bias = nn::random();
 	}
 
+
+	#define NN_INSTANTIATE(Activation) \
+		template void Stripe::guess<Activation>( \
+				const Activation&, const double*, double*) const; \
+		template void Stripe::guessBatch<Activation>( \
+				const Activation&, const double*, size_t, double*) const; \
+		template void Stripe::guess<Activation>( \
+				const Activation&, const double*, double*, Workspace&) const; \
+		template void Stripe::guessBatch<Activation>( \
+				const Activation&, const double*, size_t, double*, Workspace&) const; \
+		template double Stripe::train<Activation>( \
+				const Activation&, const double*, const double*, double); \
+		template double Stripe::train<Activation>( \
+				const Activation&, const DataView&, long long int, double); \
+		template double Stripe::train<Activation>( \
+				const Activation&, const DataView&, long long int, double, size_t, Gradient&); \
+		template double Stripe::accumulate<Activation>( \
+				const Activation&, const double*, const double*, Gradient&) const;
+	NN_ACTIVATION_POLICIES(NN_INSTANTIATE)
+	#undef NN_INSTANTIATE
+
 }
@@ -0,0 +1,226 @@
+#include "nn/trainer.hpp"
+#include "nn/kernels.hpp"
+
+
+
+namespace nn {
+
+	ParallelTrainer::Worker::Worker(const Stripe& stripe):
+			replica (stripe),
+			gradient (stripe),
+			error (0.0),
+			thread ()
+	{ }
+
+
+	ParallelTrainer::Barrier::Barrier(size_t c):
+			count (c),
+			waiting (0),
+			phase (0)
+	{ }
+
+	void ParallelTrainer::Barrier::wait() {
+		size_t current = phase.load(std::memory_order_acquire);
+		if(waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+			waiting.store(0, std::memory_order_relaxed);
+			phase.fetch_add(1, std::memory_order_release);
+		} else {
+			while(phase.load(std::memory_order_acquire) == current)
+				std::this_thread::yield();
+		}
+	}
+
+
+	ParallelTrainer::ParallelTrainer(
+			Stripe& s,
+			activation_func a, activation_func_deriv d,
+			size_t threads, Mode m
+	):
+			stripe (s),
+			act (a),
+			deriv (d),
+			mode (m),
+			workers (),
+			barrier ((threads < 1)? 1 : threads),
+			generation (0),
+			done_count (0),
+			stopping (false),
+			data (nullptr),
+			view { nullptr, nullptr, 0, 0, 0, 0, 0 },
+			rate (0.0),
+			batch_size (1)
+	{
+		if(threads < 1)  threads = 1;
+		workers.reserve(threads);
+		for(size_t i=0; i < threads; ++i)
+			workers.push_back(new Worker(stripe));
+		for(size_t i=0; i < threads; ++i)
+			workers[i]->thread = std::thread(&ParallelTrainer::work, this, i);
+	}
+
+	ParallelTrainer::~ParallelTrainer() {
+		{
+			auto lock = std::unique_lock<std::mutex>(mutex);
+			stopping = true;
+		}
+		job_cond.notify_all();
+		for(Worker* w : workers) {
+			w->thread.join();
+			delete w;
+		}
+	}
+
+
+	double ParallelTrainer::epoch(DataSet& ds, double r, size_t batch) {
+		data = &ds;
+		return run(r, batch);
+	}
+
+	double ParallelTrainer::epoch(const DataView& dv, double r, size_t batch) {
+		data = nullptr;
+		view = dv;
+		return run(r, batch);
+	}
+
+
+	size_t ParallelTrainer::rowCount() const {
+		return (data != nullptr)? data->size() : view.size();
+	}
+
+	void ParallelTrainer::getRow(size_t i, const double** in, const double** out) const {
+		if(data != nullptr) {
+			*in  = (*data)[i].inputs.data();
+			*out = (*data)[i].outputs.data();
+		} else {
+			*in  = view.inputRow(i);
+			*out = view.outputRow(i);
+		}
+	}
+
+
+	double ParallelTrainer::run(double r, size_t batch) {
+		size_t rows = rowCount();
+		if(rows == 0)  return 0.0;
+		{
+			auto lock = std::unique_lock<std::mutex>(mutex);
+			rate = r;
+			batch_size = (batch < 1)? 1 : batch;
+			done_count = 0;
+			++generation;
+		}
+		job_cond.notify_all();
+
+		auto lock = std::unique_lock<std::mutex>(mutex);
+		done_cond.wait(lock, [this] () { return done_count == workers.size(); });
+
+		double error = 0.0;
+		for(Worker* w : workers)
+			error += w->error;
+		return error / rows;
+	}
+
+
+	void ParallelTrainer::work(size_t index) {
+		size_t seen = 0;
+		while(true) {
+			{
+				auto lock = std::unique_lock<std::mutex>(mutex);
+				job_cond.wait(lock, [&] () { return stopping || (generation != seen); });
+				if(stopping)  return;
+				seen = generation;
+			}
+
+			workers[index]->error = 0.0;
+			if(mode == Mode::SYNCHRONOUS) {
+				runSynchronous(index);
+			} else {
+				runHogwild(index);
+			}
+
+			{
+				auto lock = std::unique_lock<std::mutex>(mutex);
+				++done_count;
+			}
+			done_cond.notify_one();
+		}
+	}
+
+	void ParallelTrainer::runSynchronous(size_t index) {
+		Worker& w = *workers[index];
+		size_t rows = rowCount();
+		size_t n_workers = workers.size();
+
+		for(size_t first = 0; first < rows; first += batch_size) {
+			size_t batch_rows = rows - first;
+			if(batch_rows > batch_size)  batch_rows = batch_size;
+			size_t begin = first + ((batch_rows * index) / n_workers);
+			size_t end   = first + ((batch_rows * (index+1)) / n_workers);
+
+			/* The shared stripe is only written between the two
+			 * barriers, so the replicas always read a consistent one */
+			w.replica.copyWeights(stripe);
+			w.gradient.clear();
+			for(size_t i = begin; i < end; ++i) {
+				const double* in;
+				const double* out;
+				getRow(i, &in, &out);
+				w.error += w.replica.accumulate(act, deriv, in, out, w.gradient);
+			}
+
+			barrier.wait();
+			reduce(index, batch_rows);
+			barrier.wait();
+		}
+	}
+
+	void ParallelTrainer::runHogwild(size_t index) {
+		Worker& w = *workers[index];
+		size_t rows = rowCount();
+		size_t n_workers = workers.size();
+		size_t begin = (rows * index) / n_workers;
+		size_t end   = (rows * (index+1)) / n_workers;
+
+		for(size_t first = begin; first < end; first += batch_size) {
+			size_t last = first + batch_size;
+			if(last > end)  last = end;
+
+			// Both the copy and the update race with the other workers
+			w.replica.copyWeights(stripe);
+			w.gradient.clear();
+			for(size_t i = first; i < last; ++i) {
+				const double* in;
+				const double* out;
+				getRow(i, &in, &out);
+				w.error += w.replica.accumulate(act, deriv, in, out, w.gradient);
+			}
+			stripe.apply(w.gradient, rate);
+		}
+	}
+
+	void ParallelTrainer::reduce(size_t index, size_t batch_rows) {
+		/* Every layer's weights and biases are a contiguous block:
+		 * the blocks are laid end to end, and each worker reduces
+		 * its own slice of the whole parameter range */
+		size_t n_workers = workers.size();
+		size_t total = 0;
+		for(size_t i=0; i < stripe.neurodeCount(); ++i)
+			total += (stripe[i].inputSize() + 1) * stripe[i].outputSize();
+		size_t slice_begin = (total * index) / n_workers;
+		size_t slice_end   = (total * (index+1)) / n_workers;
+		double scale = -rate / batch_rows;
+
+		size_t offset = 0;
+		for(size_t i=0; i < stripe.neurodeCount(); ++i) {
+			size_t count = (stripe[i].inputSize() + 1) * stripe[i].outputSize();
+			if((slice_begin < offset + count) && (slice_end > offset)) {
+				size_t begin = (slice_begin > offset)? slice_begin - offset : 0;
+				size_t end   = (slice_end < offset + count)? slice_end - offset : count;
+				double* dst = stripe[i].weightData() + begin;
+				for(Worker* w : workers)
+					kernel::axpy(scale, w->gradient[i].weightData() + begin, dst, end - begin);
+			}
+			offset += count;
+		}
+	}
+
+}
@@ -0,0 +1,138 @@
+#include "pix/adaptive.hpp"
+
+#include <vector>
+#include <utility>
+
+
+
+namespace {
+
+	/* The pixels [x0, x1] * [y0, y1], corners included */
+	struct Cell {
+		unsigned x0, y0, x1, y1;
+	};
+
+	struct Scratch {
+		std::vector<uint8_t> known; // Whether each pixel was evaluated
+		std::vector<unsigned> coords;
+		std::vector<size_t> targets; // The pixel of each evaluated point
+		std::vector<double> results;
+		std::vector<Cell> cells;
+		std::vector<Cell> next;
+	};
+
+	thread_local Scratch scratch;
+
+	void interpolate(const Cell& c, size_t width, const uint8_t* known, double* values) {
+		double v00 = values[(c.y0 * width) + c.x0];
+		double v10 = values[(c.y0 * width) + c.x1];
+		double v01 = values[(c.y1 * width) + c.x0];
+		double v11 = values[(c.y1 * width) + c.x1];
+		double dx = (c.x1 > c.x0)? 1.0 / (c.x1 - c.x0) : 0.0;
+		double dy = (c.y1 > c.y0)? 1.0 / (c.y1 - c.y0) : 0.0;
+		for(unsigned y = c.y0; y <= c.y1; ++y) {
+			double ty = (y - c.y0) * dy;
+			double left = v00 + ((v01 - v00) * ty);
+			double right = v10 + ((v11 - v10) * ty);
+			for(unsigned x = c.x0; x <= c.x1; ++x) {
+				size_t i = (y * width) + x;
+				if(! known[i])  values[i] = left + ((right - left) * ((x - c.x0) * dx));
+			}
+		}
+	}
+
+	unsigned power_of_two(unsigned x) {
+		unsigned r = 1;
+		while(r < x)  r *= 2;
+		return r;
+	}
+
+}
+
+
+
+namespace pix {
+
+	AdaptiveSampler::AdaptiveSampler(unsigned size, double threshold):
+			cell_size (power_of_two(size)),
+			max_delta (threshold)
+	{ }
+
+
+	size_t AdaptiveSampler::sample(const Rect& area, void* data, field_func_t func, double* values) const {
+		if((area.width == 0) || (area.height == 0))  return 0;
+		Scratch& s = scratch;
+		size_t width = area.width;
+		unsigned last_x = area.width - 1;
+		unsigned last_y = area.height - 1;
+		s.known.assign(width * area.height, 0);
+		s.cells.clear();
+		for(unsigned y0 = 0; ; y0 += cell_size) {
+			unsigned y1 = (y0 + cell_size < last_y)? y0 + cell_size : last_y;
+			for(unsigned x0 = 0; ; x0 += cell_size) {
+				unsigned x1 = (x0 + cell_size < last_x)? x0 + cell_size : last_x;
+				s.cells.push_back(Cell { x0, y0, x1, y1 });
+				if(x1 >= last_x)  break;
+			}
+			if(y1 >= last_y)  break;
+		}
+
+		size_t evaluated = 0;
+		while(! s.cells.empty()) {
+			/* The corners that were not evaluated yet, in one batch */
+			s.coords.clear();
+			s.targets.clear();
+			for(const Cell& c : s.cells) {
+				const unsigned corners[8] = { c.x0, c.y0,  c.x1, c.y0,  c.x0, c.y1,  c.x1, c.y1 };
+				for(unsigned i=0; i < 8; i += 2) {
+					size_t pixel = (corners[i+1] * width) + corners[i];
+					if(s.known[pixel])  continue;
+					s.known[pixel] = 1;
+					s.coords.push_back(area.x + corners[i]);
+					s.coords.push_back(area.y + corners[i+1]);
+					s.targets.push_back(pixel);
+				}
+			}
+			if(! s.targets.empty()) {
+				s.results.resize(s.targets.size());
+				func(data, s.coords.data(), s.targets.size(), s.results.data());
+				for(size_t i=0; i < s.targets.size(); ++i)
+					values[s.targets[i]] = s.results[i];
+				evaluated += s.targets.size();
+			}
+
+			s.next.clear();
+			for(const Cell& c : s.cells) {
+				double v[4] = {
+					values[(c.y0 * width) + c.x0], values[(c.y0 * width) + c.x1],
+					values[(c.y1 * width) + c.x0], values[(c.y1 * width) + c.x1] };
+				double lo = v[0], hi = v[0];
+				bool positive = (v[0] > 0.0), crosses = false;
+				for(unsigned i=1; i < 4; ++i) {
+					lo = (v[i] < lo)? v[i] : lo;
+					hi = (v[i] > hi)? v[i] : hi;
+					crosses = crosses || ((v[i] > 0.0) != positive);
+				}
+				if(! crosses && (hi - lo <= max_delta)) {
+					interpolate(c, width, s.known.data(), values);
+				} else if((c.x1 - c.x0 > 1) || (c.y1 - c.y0 > 1)) {
+					/* Cells that are one pixel wide are only split
+					 * along their other side */
+					unsigned xs[3] = { c.x0, (c.x0 + c.x1) / 2, c.x1 };
+					unsigned ys[3] = { c.y0, (c.y0 + c.y1) / 2, c.y1 };
+					unsigned nx = (c.x1 - c.x0 > 1)? 2 : 1;
+					unsigned ny = (c.y1 - c.y0 > 1)? 2 : 1;
+					if(nx == 1)  xs[1] = c.x1;
+					if(ny == 1)  ys[1] = c.y1;
+					for(unsigned j=0; j < ny; ++j)
+						for(unsigned i=0; i < nx; ++i)
+							s.next.push_back(Cell { xs[i], ys[j], xs[i+1], ys[j+1] });
+				}
+				// Otherwise, every pixel of the cell is a corner
+			}
+			std::swap(s.cells, s.next);
+		}
+		return evaluated;
+	}
+
+}
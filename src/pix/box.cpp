@@ -1,6 +1,19 @@
 #include "pix/box_async.hpp"
 
 #include <mutex>
+#include <cstring> // std::memcpy(...)
+
+
+
+namespace {
+
+	constexpr GLenum gl_type(PixelFormat f) {
+		return
+			(f == PixelFormat::RGBA8)?   GL_UNSIGNED_BYTE :
+			(f == PixelFormat::RGBA16F)? GL_HALF_FLOAT : GL_FLOAT;
+	}
+
+}
 
 
 
@@ -13,9 +26,11 @@ namespace pix {
 			glm::vec4 color,
 			glm::vec2 top_left,
 			glm::vec2 bottom_right,
-			GLfloat depth
+			GLfloat depth,
+			PixelFormat format
 	):
-			Canvas::Canvas(w, h),
+			Canvas::Canvas(w, h, format),
+			dirty (w, h),
 			shader (sp),
 			vb (GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW),
 			z (depth),
@@ -25,7 +40,8 @@ namespace pix {
 				{ bottom_right[1], top_left[0],     1.0f, 1.0f },
 				{ bottom_right[1], bottom_right[0], 1.0f, 0.0f }
 			},
-			color (color)
+			color (color),
+			min_filter (GL_NEAREST)
 	{
 		vb.bufferData(vertices, 4 * 4 * sizeof(GLfloat));
 		va.assignVertexBuffer(
@@ -43,22 +59,48 @@ namespace pix {
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(
+				GL_TEXTURE_2D, 0, GL_RGBA,
+				Canvas::width, Canvas::height, 0,
+				GL_RGBA, gl_type(Canvas::format), nullptr
+		);
 		glBindTexture(GL_TEXTURE_2D, 0);
+		dirty.addAll();
 	}
 
 
 	void Box::updateTexture() {
-		if(! cached) {
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, texture_id);
-			glTexImage2D(
-					GL_TEXTURE_2D, 0, GL_RGBA,
-					Canvas::width, Canvas::height, 0,
-					GL_RGBA, GL_FLOAT, Canvas::data
+		if(dirty.empty())  return;
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture_id);
+
+		/* The rectangles are read in place from the canvas,
+		 * whose rows are (width) pixels long */
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, Canvas::width);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for(const Rect& r : dirty.rects()) {
+			glTexSubImage2D(
+					GL_TEXTURE_2D, 0,
+					r.x, r.y, r.width, r.height,
+					GL_RGBA, gl_type(Canvas::format),
+					Canvas::data + (pixel_size(Canvas::format) * (r.x + (r.y * Canvas::width)))
 			);
-			glGenerateMipmap(GL_TEXTURE_2D);
-			glBindTexture(GL_TEXTURE_2D, 0);
-			cached = true;
+		}
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+		if(usesMipmaps())  glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		dirty.clear();
+	}
+
+	void Box::setFilters(GLint min, GLint mag) {
+		glBindTexture(GL_TEXTURE_2D, texture_id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		if(min != min_filter) {
+			min_filter = min;
+			dirty.addAll(); // The mipmaps may be missing or stale
 		}
 	}
 
@@ -79,6 +121,45 @@ namespace pix {
 
 namespace pix {
 
+	GLBuffers::buffer_t GLBuffers::createBuffer(size_t bytes, void** mapping) {
+		constexpr GLbitfield flags =
+				GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, flags);
+		*mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return buffer;
+	}
+
+	void GLBuffers::destroyBuffer(buffer_t buffer) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+	}
+
+	GLBuffers::fence_t GLBuffers::insertFence() {
+		return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	bool GLBuffers::waitFence(fence_t fence) {
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if((status == GL_ALREADY_SIGNALED) || (status == GL_CONDITION_SATISFIED))
+			return false;
+		constexpr GLuint64 TIMEOUT_NS = 1000000;
+		do {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, TIMEOUT_NS);
+		} while(status == GL_TIMEOUT_EXPIRED);
+		return true;
+	}
+
+	void GLBuffers::deleteFence(fence_t fence) {
+		glDeleteSync(fence);
+	}
+
+
 	AsyncBox::AsyncBox(
 			gla::ShaderProgram& sp,
 			unsigned int w,
@@ -86,21 +167,104 @@ namespace pix {
 			glm::vec4 c,
 			glm::vec2 tl,
 			glm::vec2 br,
-			GLfloat d
+			GLfloat d,
+			PixelFormat f
 	):
-			Box::Box (sp, w, h, c, tl, br, d),
-			mutex ()
-	{ }
+			Box::Box (sp, w, h, c, tl, br, d, f),
+			mutex (),
+			buffers (),
+			ring (nullptr),
+			staging (),
+			upload_format (Canvas::format)
+	{
+		/* Persistent mappings need OpenGL 4.4 or ARB_buffer_storage;
+		 * without them, the texture is updated from client memory,
+		 * converted into (staging) if the upload format differs */
+		if(GLEW_ARB_buffer_storage) {
+			// Large enough for any upload format
+			size_t bytes = pixel_size(PixelFormat::RGBA32F) * static_cast<size_t>(w) * h;
+			ring = new BufferRing<GLBuffers>(buffers, RING_SLOTS, bytes);
+		}
+	}
+
+	AsyncBox::~AsyncBox() {
+		if(ring != nullptr) {
+			delete ring;  ring = nullptr;
+		}
+	}
 
 
 	void AsyncBox::draw() {
-		auto lock = std::unique_lock<std::mutex>();
+		auto lock = std::unique_lock<std::mutex>(mutex);
+		upload();
 		Box::draw();
 	}
 
 	void AsyncBox::updateTexture() {
-		auto lock = std::unique_lock<std::mutex>();
-		Box::updateTexture();
+		auto lock = std::unique_lock<std::mutex>(mutex);
+		upload();
+	}
+
+	void AsyncBox::upload() {
+		if(dirty.empty())  return;
+		if((ring == nullptr) && (upload_format == Canvas::format)) {
+			Box::updateTexture(); // Read in place, nothing to convert
+			return;
+		}
+
+		/* The rectangles are packed one after the other into the
+		 * ring's current buffer (or the staging one), converted to
+		 * the upload format, and each upload reads its part of the
+		 * buffer once the GPU gets to it */
+		uint8_t* mapping;
+		if(ring != nullptr) {
+			mapping = static_cast<uint8_t*>(ring->acquire());
+		} else {
+			staging.resize(pixel_size(upload_format) * Canvas::width * Canvas::height);
+			mapping = staging.data();
+		}
+		std::vector<Rect> rects = dirty.rects();
+		std::vector<size_t> offsets;  offsets.reserve(rects.size());
+		size_t offset = 0;
+		size_t src_size = pixel_size(Canvas::format);
+		size_t dst_size = pixel_size(upload_format);
+		for(const Rect& r : rects) {
+			offsets.push_back(offset);
+			for(unsigned y = r.y; y < r.y + r.height; ++y) {
+				const uint8_t* row = Canvas::data + (src_size * (r.x + (static_cast<size_t>(y) * Canvas::width)));
+				convert_pixels(row, Canvas::format, mapping + offset, upload_format, r.width);
+				offset += dst_size * r.width;
+			}
+		}
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture_id);
+		// With a pixel buffer bound, the offsets are relative to it
+		const uint8_t* base = nullptr;
+		if(ring != nullptr) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->buffer());
+		} else {
+			base = staging.data();
+		}
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		GLenum type = gl_type(upload_format);
+		for(size_t i=0; i < rects.size(); ++i) {
+			const Rect& r = rects[i];
+			glTexSubImage2D(
+					GL_TEXTURE_2D, 0,
+					r.x, r.y, r.width, r.height,
+					GL_RGBA, type, base + offsets[i]
+			);
+		}
+		if(ring != nullptr) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			ring->submit();
+		}
+
+		if(usesMipmaps())  glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		dirty.clear();
 	}
 
 }
@@ -1,17 +1,120 @@
 #include "pix/canvas.hpp"
 
+#include <algorithm>
+#include <vector>
+
 
 
 namespace {
-	constexpr unsigned int coords_to_index(unsigned x, unsigned y, unsigned width) {
-		return 4 * (x + (y * width));
+	constexpr size_t coords_to_offset(unsigned x, unsigned y, unsigned width, PixelFormat f) {
+		return pixel_size(f) * (x + (static_cast<size_t>(y) * width));
+	}
+
+	/* Float copies of the pixels of compact formats,
+	 * while they are being computed */
+	thread_local std::vector<float> staging;
+
+	float* staging_buffer(size_t values) {
+		if(staging.size() < values)  staging.resize(values);
+		return staging.data();
+	}
+
+	/* Rows per task of the parallel computePixels: enough to
+	 * amortize a task, while leaving plenty of them to steal */
+	constexpr unsigned int BAND_ROWS = 4;
+
+	struct Band {
+		uint8_t* pixels;
+		PixelFormat format;
+		unsigned int width, height;
+		void* data;
+		color_func_t func;
+		static_color_func_t static_func;
+	};
+
+	void compute_band(void* arg, size_t index) {
+		const Band& band = *static_cast<const Band*>(arg);
+		unsigned first = index * BAND_ROWS;
+		unsigned last = first + BAND_ROWS;
+		if(last > band.height)  last = band.height;
+		bool direct = (band.format == PixelFormat::RGBA32F);
+		for(unsigned y = first; y < last; ++y) {
+			uint8_t* dst = band.pixels + coords_to_offset(0, y, band.width, band.format);
+			float* row = direct?
+				reinterpret_cast<float*>(dst) :
+				staging_buffer(4 * static_cast<size_t>(band.width));
+			for(unsigned x=0; x < band.width; ++x) {
+				glm::vec4 color = (band.func != nullptr)?
+					band.func(band.data, x, y) :
+					band.static_func(x, y);
+				float* ptr = row + (4 * x);
+				ptr[0] = color[0];
+				ptr[1] = color[1];
+				ptr[2] = color[2];
+				ptr[3] = color[3];
+			}
+			if(! direct)  pack_pixels(row, band.format, dst, band.width);
+		}
+	}
+
+	struct Tiling {
+		uint8_t* pixels;
+		PixelFormat format;
+		unsigned int width, height;
+		unsigned int tile_size;
+		unsigned int columns;
+		void* data;
+		tile_func_t func;
+	};
+
+	void compute_tile(void* arg, size_t index) {
+		const Tiling& tiling = *static_cast<const Tiling*>(arg);
+		Tile tile;
+		tile.x = (index % tiling.columns) * tiling.tile_size;
+		tile.y = (index / tiling.columns) * tiling.tile_size;
+		tile.width  = std::min(tiling.tile_size, tiling.width  - tile.x);
+		tile.height = std::min(tiling.tile_size, tiling.height - tile.y);
+
+		uint8_t* origin = tiling.pixels + coords_to_offset(tile.x, tile.y, tiling.width, tiling.format);
+		size_t row_bytes = coords_to_offset(0, 1, tiling.width, tiling.format);
+		if(tiling.format == PixelFormat::RGBA32F) {
+			tile.pixels = reinterpret_cast<float*>(origin);
+			tile.stride = 4 * static_cast<size_t>(tiling.width);
+			tiling.func(tiling.data, tile);
+			return;
+		}
+
+		tile.stride = 4 * static_cast<size_t>(tile.width);
+		tile.pixels = staging_buffer(tile.stride * tile.height);
+		for(unsigned y=0; y < tile.height; ++y)
+			unpack_pixels(origin + (y * row_bytes), tiling.format, tile.pixels + (y * tile.stride), tile.width);
+		tiling.func(tiling.data, tile);
+		for(unsigned y=0; y < tile.height; ++y)
+			pack_pixels(tile.pixels + (y * tile.stride), tiling.format, origin + (y * row_bytes), tile.width);
+	}
+
+	Tiling make_tiling(
+			uint8_t* pixels, PixelFormat format, unsigned w, unsigned h,
+			unsigned tile_size, void* data, tile_func_t f
+	) {
+		if(tile_size < 1)  tile_size = 1;
+		return Tiling { pixels, format, w, h, tile_size, (w + tile_size - 1) / tile_size, data, f };
+	}
+
+	constexpr size_t tile_count(const Tiling& t) {
+		return static_cast<size_t>(t.columns) * ((t.height + t.tile_size - 1) / t.tile_size);
+	}
+
+	constexpr size_t band_count(unsigned height) {
+		return (height + BAND_ROWS - 1) / BAND_ROWS;
 	}
 }
 
 
-Canvas::Canvas(unsigned w, unsigned h):
+Canvas::Canvas(unsigned w, unsigned h, PixelFormat f):
 		width(w),  height(h),
-		data (new GLfloat[4 * w * h])
+		format (f),
+		data (new uint8_t[pixel_size(f) * w * h])
 { }
 
 Canvas::~Canvas() {
@@ -22,46 +125,60 @@ Canvas::~Canvas() {
 
 
 void Canvas::setPixel(unsigned x, unsigned y, glm::vec4 color) {
-	GLfloat* ptr = &data[coords_to_index(x, y, Canvas::width)];
-	ptr[0] = color[0];
-	ptr[1] = color[1];
-	ptr[2] = color[2];
-	ptr[3] = color[3];
+	pack_pixels(&color[0], format, &data[coords_to_offset(x, y, Canvas::width, format)], 1);
 }
 
 glm::vec4 Canvas::getPixel(unsigned x, unsigned y) const {
-	GLfloat* ptr = &data[coords_to_index(x, y, Canvas::width)];
-	return glm::vec4(ptr[0], ptr[1], ptr[2], ptr[3]);
+	glm::vec4 color;
+	unpack_pixels(&data[coords_to_offset(x, y, Canvas::width, format)], format, &color[0], 1);
+	return color;
 }
 
 
 void Canvas::computePixels(static_color_func_t computeColor) {
-	for(unsigned y=0; y < height; ++y) {
-		for(unsigned x=0; x < width; ++x) {
-			setPixel(x, y, computeColor(x, y));
-		}
-	}
+	Band band = { data, format, width, height, nullptr, nullptr, computeColor };
+	for(size_t i=0; i < band_count(height); ++i)
+		compute_band(&band, i);
 }
 
 void Canvas::computePixels(void* data, color_func_t computeColor) {
-	for(unsigned y=0; y < height; ++y) {
-		for(unsigned x=0; x < width; ++x) {
-			setPixel(x, y, computeColor(data, x, y));
-		}
-	}
+	Band band = { Canvas::data, format, width, height, data, computeColor, nullptr };
+	for(size_t i=0; i < band_count(height); ++i)
+		compute_band(&band, i);
+}
+
+void Canvas::computePixels(static_color_func_t computeColor, ThreadPool& pool) {
+	Band band = { data, format, width, height, nullptr, nullptr, computeColor };
+	pool.run(band_count(height), &band, compute_band);
+}
+
+void Canvas::computePixels(void* data, color_func_t computeColor, ThreadPool& pool) {
+	Band band = { Canvas::data, format, width, height, data, computeColor, nullptr };
+	pool.run(band_count(height), &band, compute_band);
+}
+
+void Canvas::computeTiles(void* data, tile_func_t computeTile, unsigned tile_size) {
+	Tiling tiling = make_tiling(Canvas::data, format, width, height, tile_size, data, computeTile);
+	size_t count = tile_count(tiling);
+	for(size_t i=0; i < count; ++i)
+		compute_tile(&tiling, i);
+}
+
+void Canvas::computeTiles(void* data, tile_func_t computeTile, ThreadPool& pool, unsigned tile_size) {
+	Tiling tiling = make_tiling(Canvas::data, format, width, height, tile_size, data, computeTile);
+	pool.run(tile_count(tiling), &tiling, compute_tile);
+}
+
+void Canvas::readRow(unsigned y, PixelFormat to, void* dst) const {
+	convert_pixels(&data[coords_to_offset(0, y, width, format)], format, dst, to, width);
 }
 
 void Canvas::fill(glm::vec4 color) {
-	GLfloat* ptr;
-	for(unsigned y=0; y < height; ++y) {
-		for(unsigned x=0; x < width; ++x) {
-			/* Same as Canvas::stPixel(x, y, color), but potentially
-			 * marginally optimized */
-			ptr = &data[coords_to_index(x, y, Canvas::width)];
-			ptr[0] = color[0];
-			ptr[1] = color[1];
-			ptr[2] = color[2];
-			ptr[3] = color[3];
-		}
-	}
+	/* The color is packed once, then copied to every pixel */
+	size_t size = pixel_size(format);
+	uint8_t packed[16];
+	pack_pixels(&color[0], format, packed, 1);
+	size_t count = static_cast<size_t>(width) * height;
+	for(size_t i=0; i < count; ++i)
+		std::copy(packed, packed + size, data + (i * size));
 }
@@ -0,0 +1,235 @@
+#include "pix/frame.hpp"
+
+
+
+namespace {
+
+	/* PNG needs zlib streams and CRC-32 checksums: the image data
+	 * is written as uncompressed (stored) deflate blocks, which
+	 * only needs the checksums, and no compression library */
+
+	uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+		static const std::vector<uint32_t> table = [] () {
+			std::vector<uint32_t> t = std::vector<uint32_t>(256);
+			for(uint32_t i=0; i < 256; ++i) {
+				uint32_t c = i;
+				for(unsigned k=0; k < 8; ++k)
+					c = (c & 1)? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+				t[i] = c;
+			}
+			return t;
+		} ();
+		crc = ~crc;
+		for(size_t i=0; i < size; ++i)
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	uint32_t adler32(const uint8_t* data, size_t size) {
+		uint32_t a = 1, b = 0;
+		for(size_t i=0; i < size; ++i) {
+			a = (a + data[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	void put_u32(std::vector<uint8_t>& v, uint32_t x) {
+		v.push_back(x >> 24);  v.push_back(x >> 16);
+		v.push_back(x >> 8);   v.push_back(x);
+	}
+
+	void write_chunk(FILE* file, const char* type, const std::vector<uint8_t>& data) {
+		std::vector<uint8_t> chunk;
+		chunk.reserve(data.size() + 12);
+		put_u32(chunk, data.size());
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		put_u32(chunk, crc32(chunk.data() + 4, data.size() + 4));
+		fwrite(chunk.data(), 1, chunk.size(), file);
+	}
+
+	// Combines a color channel with the background, by its alpha
+	inline uint8_t blend(uint8_t c, uint8_t alpha, float background) {
+		float a = alpha / 255.0f;
+		float v = ((c / 255.0f) * a) + (background * (1.0f - a));
+		return static_cast<uint8_t>((v * 255.0f) + 0.5f);
+	}
+
+}
+
+
+
+namespace pix {
+
+	bool parse_frame_format(const std::string& name, FrameFormat* format) {
+		if(name == "png") {  *format = FrameFormat::PNG;  return true; }
+		if(name == "ppm") {  *format = FrameFormat::PPM;  return true; }
+		if(name == "raw") {  *format = FrameFormat::RAW;  return true; }
+		return false;
+	}
+
+
+	FrameException::FrameException(const std::string& message):
+			msg (message)
+	{ }
+
+	const char * FrameException::what() const noexcept {
+		return msg.c_str();
+	}
+
+
+	FrameWriter::FrameWriter(const std::string& p, FrameFormat f):
+			path (p),
+			format (f),
+			prefix (),
+			suffix (),
+			numbered (false),
+			index_width (0),
+			index_pad (' '),
+			stream (nullptr),
+			frames (0),
+			background (1.0f),
+			image ()
+	{
+		if(format == FrameFormat::RAW) {
+			stream = (path == "-")? stdout : fopen(path.c_str(), "wb");
+			if(stream == nullptr)
+				throw FrameException("Could not open \"" + path + "\" for writing");
+			return;
+		}
+
+		/* The path is parsed here, rather than given to printf,
+		 * as it comes from the user */
+		std::string* out = &prefix;
+		for(size_t i=0; i < path.size(); ++i) {
+			if(path[i] != '%') {
+				out->push_back(path[i]);
+				continue;
+			}
+			if((i + 1 < path.size()) && (path[i+1] == '%')) {
+				out->push_back('%');
+				++i;
+				continue;
+			}
+			size_t j = i + 1;
+			if((j < path.size()) && (path[j] == '0'))  index_pad = '0';
+			while((j < path.size()) && (path[j] >= '0') && (path[j] <= '9')) {
+				index_width = (index_width * 10) + (path[j] - '0');
+				if(index_width > 64)
+					throw FrameException("Invalid frame index width in \"" + path + "\"");
+				++j;
+			}
+			if(numbered || (j >= path.size()) || ((path[j] != 'u') && (path[j] != 'd')))
+				throw FrameException(
+					"Invalid frame path \"" + path + "\": only one %u or %d is allowed, "
+					"and a literal '%' is written \"%%\"");
+			numbered = true;
+			out = &suffix;
+			i = j;
+		}
+	}
+
+	FrameWriter::~FrameWriter() {
+		if(stream != nullptr) {
+			if(stream == stdout) {
+				fflush(stream);
+			} else {
+				fclose(stream);
+			}
+			stream = nullptr;
+		}
+	}
+
+
+	std::string FrameWriter::framePath() const {
+		if(! numbered)  return prefix;
+		std::string index = std::to_string(frames);
+		if(index.size() < index_width)
+			index.insert(0, index_width - index.size(), index_pad);
+		return prefix + index + suffix;
+	}
+
+
+	void FrameWriter::write(const Canvas& canvas) {
+		unsigned width = canvas.getWidth();
+		unsigned height = canvas.getHeight();
+		size_t row_bytes = 4 * static_cast<size_t>(width);
+		image.resize(row_bytes * height);
+		for(unsigned y=0; y < height; ++y)
+			canvas.readRow(height - 1 - y, PixelFormat::RGBA8, image.data() + (y * row_bytes));
+
+		if(format == FrameFormat::RAW) {
+			if(fwrite(image.data(), 1, image.size(), stream) != image.size())
+				throw FrameException("Could not write to \"" + path + "\"");
+		} else {
+			std::string file_path = framePath();
+			FILE* file = fopen(file_path.c_str(), "wb");
+			if(file == nullptr)
+				throw FrameException("Could not open \"" + file_path + "\" for writing");
+			if(format == FrameFormat::PNG) {
+				writePng(file, width, height);
+			} else {
+				writePpm(file, width, height);
+			}
+			bool failed = ferror(file);
+			if((fclose(file) != 0) || failed)
+				throw FrameException("Could not write \"" + file_path + "\"");
+		}
+		++frames;
+	}
+
+
+	void FrameWriter::writePng(FILE* file, unsigned width, unsigned height) const {
+		static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		fwrite(signature, 1, 8, file);
+
+		std::vector<uint8_t> header;
+		put_u32(header, width);
+		put_u32(header, height);
+		header.push_back(8); // Bits per channel
+		header.push_back(6); // RGBA
+		header.push_back(0);  header.push_back(0);  header.push_back(0);
+		write_chunk(file, "IHDR", header);
+
+		/* Every row starts with its filter (0, none) */
+		size_t row_bytes = 4 * static_cast<size_t>(width);
+		std::vector<uint8_t> raw;
+		raw.reserve((row_bytes + 1) * height);
+		for(unsigned y=0; y < height; ++y) {
+			raw.push_back(0);
+			raw.insert(raw.end(), image.begin() + (y * row_bytes), image.begin() + ((y+1) * row_bytes));
+		}
+
+		constexpr size_t BLOCK = 65535;
+		std::vector<uint8_t> zlib;
+		zlib.reserve(raw.size() + (5 * (raw.size() / BLOCK + 1)) + 6);
+		zlib.push_back(0x78);  zlib.push_back(0x01);
+		size_t done = 0;
+		do {
+			size_t n = (raw.size() - done < BLOCK)? raw.size() - done : BLOCK;
+			zlib.push_back((done + n == raw.size())? 1 : 0); // Final block, stored
+			zlib.push_back(n & 0xff);   zlib.push_back(n >> 8);
+			zlib.push_back(~n & 0xff);  zlib.push_back((~n >> 8) & 0xff);
+			zlib.insert(zlib.end(), raw.begin() + done, raw.begin() + done + n);
+			done += n;
+		} while(done < raw.size());
+		put_u32(zlib, adler32(raw.data(), raw.size()));
+		write_chunk(file, "IDAT", zlib);
+		write_chunk(file, "IEND", { });
+	}
+
+	void FrameWriter::writePpm(FILE* file, unsigned width, unsigned height) const {
+		fprintf(file, "P6\n%u %u\n255\n", width, height);
+		std::vector<uint8_t> row = std::vector<uint8_t>(3 * static_cast<size_t>(width));
+		for(unsigned y=0; y < height; ++y) {
+			const uint8_t* src = image.data() + (4 * static_cast<size_t>(width) * y);
+			for(unsigned x=0; x < width; ++x) {
+				for(unsigned c=0; c < 3; ++c)
+					row[(3 * x) + c] = blend(src[(4 * x) + c], src[(4 * x) + 3], background[c]);
+			}
+			fwrite(row.data(), 1, row.size(), file);
+		}
+	}
+
+}
@@ -91,6 +91,14 @@ namespace pix {
 		glfwPollEvents();
 	}
 
+	void Window::waitEvents(double timeout_s) {
+		if(timeout_s > 0.0) {
+			glfwWaitEventsTimeout(timeout_s);
+		} else {
+			glfwPollEvents();
+		}
+	}
+
 	void Window::swapBuffers() {
 		glfwSwapBuffers(glfw_window);
 	}
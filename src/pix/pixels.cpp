@@ -0,0 +1,223 @@
+#include "pix/pixels.hpp"
+
+#include <cstring> // std::memcpy(...)
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define PIX_PIXELS_X86
+	#include <immintrin.h>
+#endif
+
+
+
+namespace {
+
+	/* Scalar conversions: the vectorized loops below
+	 * leave their remainders to these */
+
+	inline uint8_t to_byte(float x) {
+		x = (x > 0.0f)? x : 0.0f; // Also maps NaN to 0, as maxps does
+		x = (x < 1.0f)? x : 1.0f;
+		return static_cast<uint8_t>((x * 255.0f) + 0.5f);
+	}
+
+	inline float from_byte(uint8_t x) {
+		return static_cast<float>(x) * (1.0f / 255.0f);
+	}
+
+	inline uint32_t float_bits(float x) {
+		uint32_t r;  std::memcpy(&r, &x, sizeof(r));  return r;
+	}
+
+	inline float bits_float(uint32_t x) {
+		float r;  std::memcpy(&r, &x, sizeof(r));  return r;
+	}
+
+	uint16_t to_half(float f) {
+		uint32_t x = float_bits(f);
+		uint16_t sign = (x >> 16) & 0x8000;
+		x &= 0x7fffffff;
+		if(x >= 0x7f800000) {
+			// Infinities stay so, NaNs are quieted (as vcvtps2ph does)
+			return sign | 0x7c00 | ((x > 0x7f800000)? (0x200 | ((x >> 13) & 0x3ff)) : 0);
+		}
+		if(x >= 0x477ff000)  return sign | 0x7c00; // Rounds past 65504
+		if(x < 0x38800000) {
+			/* Subnormal halves: adding 0.5 aligns the value's bits to
+			 * the half's mantissa, and lets the FPU do the rounding */
+			return sign | (float_bits(bits_float(x) + 0.5f) - 0x3f000000);
+		}
+		x -= 0x38000000; // Rebias the exponent from 127 to 15
+		x += 0xfff + ((x >> 13) & 1);
+		return sign | (x >> 13);
+	}
+
+	float from_half(uint16_t h) {
+		uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+		uint32_t exponent = (h >> 10) & 0x1f;
+		uint32_t mantissa = h & 0x3ff;
+		if(exponent == 0) {
+			float r = static_cast<float>(mantissa) * (1.0f / 16777216.0f); // 2^-24
+			return bits_float(sign | float_bits(r));
+		}
+		if(exponent == 31) {
+			uint32_t quiet = (mantissa != 0)? 0x400000 : 0;
+			return bits_float(sign | 0x7f800000 | quiet | (mantissa << 13));
+		}
+		return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+	}
+
+
+	#ifdef PIX_PIXELS_X86
+
+		__attribute__((target("sse2")))
+		size_t pack_rgba8_sse2(const float* src, uint8_t* dst, size_t count) {
+			const __m128 zero  = _mm_setzero_ps();
+			const __m128 one   = _mm_set1_ps(1.0f);
+			const __m128 scale = _mm_set1_ps(255.0f);
+			const __m128 half  = _mm_set1_ps(0.5f);
+			size_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				__m128i q[4];
+				for(unsigned j=0; j < 4; ++j) {
+					__m128 v = _mm_loadu_ps(src + i + (4 * j));
+					v = _mm_min_ps(_mm_max_ps(v, zero), one);
+					q[j] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+				}
+				__m128i words = _mm_packs_epi32(q[0], q[1]);
+				__m128i bytes = _mm_packus_epi16(words, _mm_packs_epi32(q[2], q[3]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+			}
+			return i;
+		}
+
+		__attribute__((target("sse2")))
+		size_t unpack_rgba8_sse2(const uint8_t* src, float* dst, size_t count) {
+			const __m128i zero = _mm_setzero_si128();
+			const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+			size_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+				__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+				__m128i q[4] = {
+					_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+					_mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+				for(unsigned j=0; j < 4; ++j)
+					_mm_storeu_ps(dst + i + (4 * j), _mm_mul_ps(_mm_cvtepi32_ps(q[j]), scale));
+			}
+			return i;
+		}
+
+		__attribute__((target("avx,f16c")))
+		size_t pack_rgba16f_f16c(const float* src, uint16_t* dst, size_t count) {
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+			}
+			return i;
+		}
+
+		__attribute__((target("avx,f16c")))
+		size_t unpack_rgba16f_f16c(const uint16_t* src, float* dst, size_t count) {
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+			}
+			return i;
+		}
+
+		const bool has_sse2 = __builtin_cpu_supports("sse2");
+		const bool has_f16c = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+
+	#endif
+
+}
+
+
+
+namespace pix {
+
+	void pack_rgba8(const float* src, uint8_t* dst, size_t count) {
+		size_t i = 0;
+		#ifdef PIX_PIXELS_X86
+			if(has_sse2)  i = pack_rgba8_sse2(src, dst, count);
+		#endif
+		for(; i < count; ++i)
+			dst[i] = to_byte(src[i]);
+	}
+
+	void unpack_rgba8(const uint8_t* src, float* dst, size_t count) {
+		size_t i = 0;
+		#ifdef PIX_PIXELS_X86
+			if(has_sse2)  i = unpack_rgba8_sse2(src, dst, count);
+		#endif
+		for(; i < count; ++i)
+			dst[i] = from_byte(src[i]);
+	}
+
+	void pack_rgba16f(const float* src, uint16_t* dst, size_t count) {
+		size_t i = 0;
+		#ifdef PIX_PIXELS_X86
+			if(has_f16c)  i = pack_rgba16f_f16c(src, dst, count);
+		#endif
+		for(; i < count; ++i)
+			dst[i] = to_half(src[i]);
+	}
+
+	void unpack_rgba16f(const uint16_t* src, float* dst, size_t count) {
+		size_t i = 0;
+		#ifdef PIX_PIXELS_X86
+			if(has_f16c)  i = unpack_rgba16f_f16c(src, dst, count);
+		#endif
+		for(; i < count; ++i)
+			dst[i] = from_half(src[i]);
+	}
+
+
+	void pack_pixels(const float* src, PixelFormat format, void* dst, size_t pixels) {
+		switch(format) {
+			case PixelFormat::RGBA8:
+				pack_rgba8(src, static_cast<uint8_t*>(dst), 4 * pixels);  break;
+			case PixelFormat::RGBA16F:
+				pack_rgba16f(src, static_cast<uint16_t*>(dst), 4 * pixels);  break;
+			case PixelFormat::RGBA32F:
+				std::memcpy(dst, src, 4 * pixels * sizeof(float));  break;
+		}
+	}
+
+	void unpack_pixels(const void* src, PixelFormat format, float* dst, size_t pixels) {
+		switch(format) {
+			case PixelFormat::RGBA8:
+				unpack_rgba8(static_cast<const uint8_t*>(src), dst, 4 * pixels);  break;
+			case PixelFormat::RGBA16F:
+				unpack_rgba16f(static_cast<const uint16_t*>(src), dst, 4 * pixels);  break;
+			case PixelFormat::RGBA32F:
+				std::memcpy(dst, src, 4 * pixels * sizeof(float));  break;
+		}
+	}
+
+	void convert_pixels(const void* src, PixelFormat from, void* dst, PixelFormat to, size_t pixels) {
+		if(from == to) {
+			std::memcpy(dst, src, pixels * pixel_size(from));
+		} else if(from == PixelFormat::RGBA32F) {
+			pack_pixels(static_cast<const float*>(src), to, dst, pixels);
+		} else if(to == PixelFormat::RGBA32F) {
+			unpack_pixels(src, from, static_cast<float*>(dst), pixels);
+		} else {
+			/* Between two compact formats, through floats,
+			 * a bounded number of pixels at a time */
+			constexpr size_t CHUNK = 256;
+			float buffer[4 * CHUNK] = { }; // Initialized, as GCC cannot tell that n > 0
+			const char* in = static_cast<const char*>(src);
+			char* out = static_cast<char*>(dst);
+			for(size_t done = 0; done < pixels; done += CHUNK) {
+				size_t n = (pixels - done < CHUNK)? pixels - done : CHUNK;
+				unpack_pixels(in + (done * pixel_size(from)), from, buffer, n);
+				pack_pixels(buffer, to, out + (done * pixel_size(to)), n);
+			}
+		}
+	}
+
+}
@@ -0,0 +1,132 @@
+#include "pix/refine.hpp"
+
+
+
+namespace {
+
+	unsigned side_for(unsigned passes) {
+		unsigned side = 1;
+		while((side * side < passes) && (side * side < Refinement::MAX_PASSES))
+			side *= 2;
+		return side;
+	}
+
+	/* The most significant base-4 digit of a rank comes from the
+	 * least significant bits of the coordinates, in the order of
+	 * the 2x2 Bayer matrix { 0, 2; 3, 1 } */
+	std::vector<uint16_t> bayer_ranks(unsigned side) {
+		unsigned bits = 0;
+		while((1u << bits) < side)  ++bits;
+		std::vector<uint16_t> r = std::vector<uint16_t>(side * side);
+		for(unsigned y=0; y < side; ++y)
+			for(unsigned x=0; x < side; ++x) {
+				unsigned rank = 0;
+				for(unsigned i=0; i < bits; ++i) {
+					unsigned xi = (x >> i) & 1;
+					unsigned yi = (y >> i) & 1;
+					rank |= ((2 * (xi ^ yi)) + yi) << (2 * (bits - 1 - i));
+				}
+				r[(y * side) + x] = rank;
+			}
+		return r;
+	}
+
+}
+
+
+
+namespace pix {
+
+	Refinement::Refinement(unsigned passes):
+			side (side_for(passes)),
+			ranks (bayer_ranks(side)),
+			first (0),
+			count (0),
+			refined (0),
+			outdated (passCount()),
+			pass_time (0.0)
+	{ }
+
+
+	void Refinement::setPassCount(unsigned passes) {
+		unsigned new_side = side_for(passes);
+		if(new_side == side)  return;
+		bool was_coarse = coarse();
+		side = new_side;
+		ranks = bayer_ranks(side);
+		pass_time = 0.0; // Passes are not as big as before
+		count = 0;
+		if(was_coarse) {
+			restart();
+		} else {
+			first %= passCount();
+			invalidate();
+		}
+	}
+
+
+	void Refinement::restart() {
+		first = 0;
+		count = 0;
+		refined = 0;
+		outdated = passCount();
+	}
+
+
+	void Refinement::invalidate() {
+		outdated = passCount();
+	}
+
+
+	void Refinement::beginFrame(double budget_s) {
+		unsigned passes = passCount();
+		count = 1;
+		if((budget_s > 0.0) && (pass_time > 0.0)) {
+			double affordable = budget_s / pass_time;
+			count = (affordable >= passes)? passes : (affordable < 1.0)? 1 : static_cast<unsigned>(affordable);
+		}
+	}
+
+
+	void Refinement::fillTile(const Tile& tile) const {
+		if(! coarse())  return;
+		/* Computed since restart(): the ranks [0, computed),
+		 * which are a grid of some step plus part of the next one */
+		unsigned computed = refined + count;
+		if(computed >= passCount())  return;
+		for(unsigned y=0; y < tile.height; ++y) {
+			for(unsigned x=0; x < tile.width; ++x) {
+				unsigned cx = tile.x + x;
+				unsigned cy = tile.y + y;
+				if(rank(cx, cy) < computed)  continue;
+				/* The corner of every enclosing block is computed
+				 * before the pixels inside of it: the closest one
+				 * is the smallest block with a computed corner */
+				for(unsigned step = 2; step <= side; step *= 2) {
+					unsigned ax = cx & ~(step - 1);
+					unsigned ay = cy & ~(step - 1);
+					if(rank(ax, ay) < computed) {
+						const float* src = tile.pixels + ((ay - tile.y) * tile.stride) + (4 * (ax - tile.x));
+						float* dst = tile.pixels + (y * tile.stride) + (4 * x);
+						dst[0] = src[0];  dst[1] = src[1];
+						dst[2] = src[2];  dst[3] = src[3];
+						break;
+					}
+				}
+			}
+		}
+	}
+
+
+	void Refinement::endFrame(double elapsed_s) {
+		if(count == 0)  return;
+		unsigned passes = passCount();
+		first = (first + count) % passes;
+		refined = (refined + count < passes)? refined + count : passes;
+		outdated = (outdated > count)? outdated - count : 0;
+		double t = elapsed_s / count;
+		pass_time = (pass_time > 0.0)? (0.75 * pass_time) + (0.25 * t) : t;
+		count = 0;
+	}
+
+}
@@ -0,0 +1,64 @@
+#include "pix/scheduler.hpp"
+
+
+
+namespace {
+	constexpr double ESTIMATE_WEIGHT = 0.125; // Of each new measure
+}
+
+
+
+namespace pix {
+
+	FrameScheduler::FrameScheduler(double interval_s, double now):
+			interval (interval_s),
+			deadline (now),
+			phase_start (now),
+			phase (MAX_PHASES),
+			frames (0),
+			late (0)
+	{
+		for(unsigned i=0; i < MAX_PHASES; ++i)
+			estimates[i] = -1.0;
+	}
+
+
+	void FrameScheduler::endPhase(double now) {
+		if(phase >= MAX_PHASES)  return;
+		double elapsed = now - phase_start;
+		double& e = estimates[phase];
+		e = (e < 0.0)? elapsed : ((1.0 - ESTIMATE_WEIGHT) * e) + (ESTIMATE_WEIGHT * elapsed);
+		phase = MAX_PHASES;
+	}
+
+
+	void FrameScheduler::beginFrame(double now) {
+		if(now - deadline > interval)  deadline = now;
+		deadline += interval;
+		phase = MAX_PHASES;
+	}
+
+
+	void FrameScheduler::beginPhase(unsigned p, double now) {
+		endPhase(now);
+		if(p >= MAX_PHASES)  return;
+		phase = p;
+		phase_start = now;
+	}
+
+
+	void FrameScheduler::endFrame(double now) {
+		endPhase(now);
+		++frames;
+		if(now > deadline)  ++late;
+	}
+
+
+	double FrameScheduler::timeLeft(unsigned p, double now) const {
+		double left = deadline - now;
+		for(unsigned i = p + 1; i < MAX_PHASES; ++i)
+			left -= phaseTime(i);
+		return left;
+	}
+
+}
@@ -0,0 +1,147 @@
+#include "pix/threadpool.hpp"
+
+
+
+namespace pix {
+
+	ThreadPool::ThreadPool(size_t threads):
+			workers (),
+			queues (nullptr),
+			generation (0),
+			done_count (0),
+			stopping (false),
+			job_data (nullptr),
+			job_func (nullptr)
+	{
+		if(threads < 1)  threads = 1;
+		queues = new Queue[threads];
+		for(size_t i=0; i < threads; ++i)
+			queues[i].begin = queues[i].end = 0;
+		workers.reserve(threads - 1);
+		for(size_t i=0; i < threads - 1; ++i)
+			workers.emplace_back(&ThreadPool::work, this, i);
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			auto lock = std::unique_lock<std::mutex>(mutex);
+			stopping = true;
+		}
+		job_cond.notify_all();
+		for(std::thread& t : workers)
+			t.join();
+		delete[] queues;
+	}
+
+
+	ThreadPool& ThreadPool::shared() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+
+	void ThreadPool::run(size_t count, void* data, task_func_t func) {
+		if(count == 0)  return;
+		if(workers.empty() || count == 1) {
+			for(size_t i=0; i < count; ++i)
+				func(data, i);
+			return;
+		}
+
+		auto run_lock = std::unique_lock<std::mutex>(run_mutex);
+		size_t n_queues = threadCount();
+		for(size_t i=0; i < n_queues; ++i) {
+			auto lock = std::unique_lock<std::mutex>(queues[i].mutex);
+			queues[i].begin = (count * i) / n_queues;
+			queues[i].end   = (count * (i+1)) / n_queues;
+		}
+		{
+			auto lock = std::unique_lock<std::mutex>(mutex);
+			job_data = data;
+			job_func = func;
+			done_count = 0;
+			++generation;
+		}
+		job_cond.notify_all();
+
+		drain(workers.size());
+
+		/* The workers may still be reading the queues,
+		 * even after the last task is done */
+		auto lock = std::unique_lock<std::mutex>(mutex);
+		done_cond.wait(lock, [this] () { return done_count == workers.size(); });
+	}
+
+
+	void ThreadPool::work(size_t index) {
+		size_t seen = 0;
+		while(true) {
+			{
+				auto lock = std::unique_lock<std::mutex>(mutex);
+				job_cond.wait(lock, [&] () { return stopping || (generation != seen); });
+				if(stopping)  return;
+				seen = generation;
+			}
+
+			drain(index);
+
+			{
+				auto lock = std::unique_lock<std::mutex>(mutex);
+				++done_count;
+			}
+			done_cond.notify_one();
+		}
+	}
+
+	void ThreadPool::drain(size_t index) {
+		Queue& own = queues[index];
+		do {
+			while(true) {
+				size_t task;
+				{
+					auto lock = std::unique_lock<std::mutex>(own.mutex);
+					if(own.begin == own.end)  break;
+					task = own.begin++;
+				}
+				job_func(job_data, task);
+			}
+		} while(steal(index));
+	}
+
+	bool ThreadPool::steal(size_t index) {
+		/* The victim's share may shrink between the two locks,
+		 * in which case another one is looked for */
+		size_t n_queues = threadCount();
+		while(true) {
+			size_t victim = n_queues;
+			size_t biggest = 0;
+			for(size_t i=0; i < n_queues; ++i) {
+				if(i == index)  continue;
+				auto lock = std::unique_lock<std::mutex>(queues[i].mutex);
+				size_t left = queues[i].end - queues[i].begin;
+				if(left > biggest) {
+					biggest = left;
+					victim = i;
+				}
+			}
+			if(victim == n_queues)  return false;
+
+			size_t begin, end;
+			{
+				auto lock = std::unique_lock<std::mutex>(queues[victim].mutex);
+				size_t left = queues[victim].end - queues[victim].begin;
+				if(left == 0)  continue;
+				end = queues[victim].end;
+				begin = end - ((left + 1) / 2);
+				queues[victim].end = begin;
+			}
+			{
+				auto lock = std::unique_lock<std::mutex>(queues[index].mutex);
+				queues[index].begin = begin;
+				queues[index].end = end;
+			}
+			return true;
+		}
+	}
+
+}